@@ -0,0 +1,290 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : connectionpool.cpp
+// Contents  : client side SocketSTREAM connection pool implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "poll.h"
+#include "connectionpool.h"
+
+/**
+ * @brief Construct a new ConnectionPool object.
+ *
+ * @param maxIdle : The maximum number of idle connections kept per server, zero keeps none.
+ * @param warmSpares : The number of idle connections maintain() keeps open per server.
+ * @param idleTimeoutMs : The idle time in milli second(s) after which a connection is closed.
+ * @param connectTimeoutMs : The connect timeout in milli second(s), -1 for a blocking connect.
+ */
+ConnectionPool::ConnectionPool(uint32_t maxIdle /*=8*/, uint32_t warmSpares /*=0*/, uint32_t idleTimeoutMs /*=60000*/, int connectTimeoutMs /*=1000*/)
+   : mMaxIdle(maxIdle), mWarmSpares(warmSpares < maxIdle ? warmSpares : maxIdle), mIdleTimeoutMs(idleTimeoutMs), mConnectTimeoutMs(connectTimeoutMs)
+{
+}
+
+/**
+ * @brief Get a connected socket to the server.
+ *
+ * @param addr : The server socketaddr.
+ * @return SocketSTREAM : A connected socket, not open if the connect failed, errno is then set.
+ */
+SocketSTREAM ConnectionPool::acquire(const socketaddr &addr)
+{
+   std::vector<SocketSTREAM> stale;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto it = mIdle.find(addr);
+      if (it != mIdle.end())
+      {
+         auto &entries = it->second;
+         while (!entries.empty())
+         {
+            SocketSTREAM sock = std::move(entries.back().sock);
+            entries.pop_back();
+            if (isAlive(sock))
+               return sock;
+            stale.push_back(std::move(sock));
+         }
+      }
+   }
+   return connect(addr);
+}
+
+/**
+ * @brief Give a socket back to the pool.
+ *
+ * A socket with a pending request or response must not be released as
+ * reusable, it is closed.
+ *
+ * @param sock : A socket returned by acquire().
+ * @param reusable : false to close the socket.
+ */
+void ConnectionPool::release(SocketSTREAM &&sock, bool reusable /*=true*/)
+{
+   if (!reusable || !sock.isOpen())
+   {
+      sock.close();
+      return;
+   }
+
+   // No idle connection is kept
+   if (mMaxIdle == 0)
+   {
+      sock.close();
+      return;
+   }
+
+   SocketSTREAM closed;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto &entries = mIdle[sock.getSocketaddr()];
+      if (entries.size() >= mMaxIdle)
+      {
+         // Drop the oldest one, the most recently used has the largest congestion window
+         closed = std::move(entries.front().sock);
+         entries.pop_front();
+      }
+      Entry entry = {std::move(sock), Clock::now()};
+      entries.push_back(std::move(entry));
+   }
+}
+
+/**
+ * @brief Open connections up to the number of warm spares.
+ *
+ * @param addr : The server socketaddr.
+ */
+void ConnectionPool::warmUp(const socketaddr &addr)
+{
+   size_t missing = 0;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto &entries = mIdle[addr];
+      if (entries.size() < mWarmSpares)
+         missing = mWarmSpares - entries.size();
+   }
+
+   for (size_t i = 0; i < missing; i++)
+   {
+      auto sock = connect(addr);
+      if (!sock.isOpen())
+         break;
+      release(std::move(sock));
+   }
+}
+
+/**
+ * @brief Evict the idle and dead connections, then open the warm spares.
+ *
+ * @return uint32_t : The number of evicted connections.
+ */
+uint32_t ConnectionPool::maintain()
+{
+   std::vector<SocketSTREAM> evicted;
+   std::vector<socketaddr> servers;
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      auto deadline = Clock::now() - std::chrono::milliseconds(mIdleTimeoutMs);
+      for (auto &server : mIdle)
+      {
+         auto &entries = server.second;
+         for (auto it = entries.begin(); it != entries.end();)
+         {
+            if (it->since <= deadline || !isAlive(it->sock))
+            {
+               evicted.push_back(std::move(it->sock));
+               it = entries.erase(it);
+            }
+            else
+               ++it;
+         }
+         servers.push_back(server.first);
+      }
+   }
+
+   if (mWarmSpares > 0)
+   {
+      for (const auto &addr : servers)
+         warmUp(addr);
+   }
+   return static_cast<uint32_t>(evicted.size());
+}
+
+/**
+ * @brief Close all the idle connections.
+ */
+void ConnectionPool::clear()
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   mIdle.clear();
+}
+
+/**
+ * @brief Number of idle connections.
+ */
+size_t ConnectionPool::idle() const
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   size_t n = 0;
+   for (const auto &server : mIdle)
+      n += server.second.size();
+   return n;
+}
+
+/**
+ * @brief Number of idle connections to a server.
+ */
+size_t ConnectionPool::idle(const socketaddr &addr) const
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   auto it = mIdle.find(addr);
+   return it == mIdle.end() ? 0 : it->second.size();
+}
+
+/**
+ * @brief Cheap liveness check of an idle connection.
+ *
+ * An idle connection must not be readable: pending bytes mean a desynchronised
+ * protocol, a readable EOF or error means the peer closed the connection.
+ * The MSG_PEEK|MSG_DONTWAIT probe costs one syscall and never consumes data.
+ *
+ * @param sock : An idle connected socket.
+ * @return true : The connection can be reused.
+ */
+bool ConnectionPool::isAlive(SocketSTREAM &sock) noexcept
+{
+   if (!sock.isOpen())
+      return false;
+
+#ifdef MSG_DONTWAIT
+   char c;
+   int rc = ::recv(sock.getHandle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+   return rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#else
+   pollfd pfd;
+   pfd.fd = sock.getHandle();
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+   return poll(&pfd, 1, 0) == 0;
+#endif
+}
+
+bool ConnectionPool::Less::operator()(const socketaddr &a, const socketaddr &b) const noexcept
+{
+   if (a.size != b.size)
+      return a.size < b.size;
+   return memcmp(&a.ss, &b.ss, a.size) < 0;
+}
+
+SocketSTREAM ConnectionPool::connect(const socketaddr &addr)
+{
+   SocketSTREAM sock(addr.sa.sa_family);
+   if (sock.setAddr(addr) == -1 || sock.open() == INVALID_SOCKET)
+      return sock;
+
+   if (mConnectTimeoutMs < 0)
+   {
+      if (sock.connect() == -1)
+      {
+         int err = errno;
+         sock.close();
+         errno = err;
+      }
+      return sock;
+   }
+
+   int err = 0;
+   sock.setNONBLOCK(true);
+   if (sock.connect() == -1)
+   {
+#ifdef OS_WINDOWS
+      err = (WSAGetLastError() == WSAEWOULDBLOCK) ? EINPROGRESS : WSAGetLastError();
+#else
+      err = errno;
+#endif
+      if (err == EINPROGRESS)
+      {
+         pollfd pfd;
+         pfd.fd = sock.getHandle();
+         pfd.events = POLLOUT;
+         pfd.revents = 0;
+
+         // A signal must not shorten the connect timeout
+         auto deadline = Clock::now() + std::chrono::milliseconds(mConnectTimeoutMs);
+         int rc;
+         int timeoutMs = mConnectTimeoutMs;
+         while ((rc = poll(&pfd, 1, timeoutMs)) == -1 && errno == EINTR)
+         {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            timeoutMs = remaining > 0 ? static_cast<int>(remaining) : 0;
+         }
+         if (rc == 0)
+            err = ETIMEDOUT;
+         else if (rc == -1)
+            err = errno;
+         else
+         {
+            int len = sizeof(err);
+            if (sock.getOption(SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+               err = errno;
+         }
+      }
+   }
+
+   if (err != 0)
+   {
+      sock.close();
+      errno = err;
+      return sock;
+   }
+   sock.setNONBLOCK(false);
+   return sock;
+}
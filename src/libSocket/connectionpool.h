@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : connectionpool.h
+// Contents  : client side SocketSTREAM connection pool interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+
+#include "socketstream.h"
+
+/**
+ * @brief A pool of connected SocketSTREAM, keyed by the server socketaddr.
+ *
+ * acquire() hands out an idle connection, the most recently used first,
+ * and only connects a new one when no live idle connection remains.
+ * release() gives the connection back to the pool.
+ *
+ * The liveness check is a non-blocking MSG_PEEK: an idle connection with
+ * pending bytes or a pending EOF is stale and is closed.
+ *
+ * maintain() evicts the idle connections older than idleTimeoutMs and
+ * opens the warm spares, it should be called periodically, for example
+ * from a Reactor timer.
+ *
+ * The methods are thread safe, connect never happens under the lock.
+ */
+class LIBSOCKET_EXPORT ConnectionPool
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   explicit ConnectionPool(uint32_t maxIdle = 8, uint32_t warmSpares = 0, uint32_t idleTimeoutMs = 60000, int connectTimeoutMs = 1000);
+   ConnectionPool(const ConnectionPool &) = delete;
+   ConnectionPool &operator=(const ConnectionPool &) = delete;
+   ~ConnectionPool() = default;
+
+   SocketSTREAM acquire(const socketaddr &addr);
+   void release(SocketSTREAM &&sock, bool reusable = true);
+   void warmUp(const socketaddr &addr);
+   uint32_t maintain();
+   void clear();
+
+   size_t idle() const;
+   size_t idle(const socketaddr &addr) const;
+
+   static bool isAlive(SocketSTREAM &sock) noexcept;
+
+private:
+   struct Less
+   {
+      bool operator()(const socketaddr &a, const socketaddr &b) const noexcept;
+   };
+
+   struct Entry
+   {
+      SocketSTREAM sock;
+      Clock::time_point since;
+   };
+
+   SocketSTREAM connect(const socketaddr &addr);
+
+   uint32_t mMaxIdle;
+   uint32_t mWarmSpares;
+   uint32_t mIdleTimeoutMs;
+   int mConnectTimeoutMs;
+
+   mutable std::mutex mMutex;
+   std::map<socketaddr, std::deque<Entry>, Less> mIdle;
+};
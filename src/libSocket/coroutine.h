@@ -0,0 +1,367 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : coroutine.h
+// Contents  : C++20 coroutine awaitables for socket I/O
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// The library is built in C++11, this header only is available to C++20 code.
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+
+#include <cerrno>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <coroutine>
+#include <exception>
+#include <unordered_map>
+
+#include "reactor.h"
+#include "socketstream.h"
+
+template <typename T = void>
+class Task;
+
+namespace coro_detail
+{
+   struct PromiseBase
+   {
+      std::coroutine_handle<> continuation;
+      std::exception_ptr exception;
+      bool detached = false;
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+
+      void unhandled_exception() noexcept
+      {
+         // Like a std::thread, an exception must not escape a detached task
+         if (detached)
+            std::terminate();
+         exception = std::current_exception();
+      }
+   };
+
+   template <typename T>
+   struct Promise : PromiseBase
+   {
+      std::optional<T> value;
+
+      void return_value(T v) { value.emplace(std::move(v)); }
+
+      T result()
+      {
+         if (exception)
+            std::rethrow_exception(exception);
+         return std::move(*value);
+      }
+   };
+
+   template <>
+   struct Promise<void> : PromiseBase
+   {
+      void return_void() noexcept {}
+
+      void result()
+      {
+         if (exception)
+            std::rethrow_exception(exception);
+      }
+   };
+}
+
+/**
+ * @brief A lazy coroutine returning a T.
+ *
+ * The coroutine starts when it is co_awaited, or when it is detached
+ * with IoContext::spawn.
+ */
+template <typename T>
+class Task
+{
+public:
+   struct promise_type;
+   using handle_type = std::coroutine_handle<promise_type>;
+
+   struct FinalAwaiter
+   {
+      bool await_ready() noexcept { return false; }
+
+      std::coroutine_handle<> await_suspend(handle_type h) noexcept
+      {
+         auto &p = h.promise();
+         if (p.continuation)
+            return p.continuation;
+         if (p.detached)
+            h.destroy();
+         return std::noop_coroutine();
+      }
+
+      void await_resume() noexcept {}
+   };
+
+   struct promise_type : coro_detail::Promise<T>
+   {
+      Task get_return_object() noexcept { return Task(handle_type::from_promise(*this)); }
+      FinalAwaiter final_suspend() noexcept { return {}; }
+   };
+
+   Task(Task &&other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) {}
+   Task(const Task &) = delete;
+   Task &operator=(const Task &) = delete;
+   ~Task()
+   {
+      if (mHandle)
+         mHandle.destroy();
+   }
+
+   bool await_ready() const noexcept { return !mHandle || mHandle.done(); }
+
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+   {
+      mHandle.promise().continuation = caller;
+      return mHandle;
+   }
+
+   T await_resume() { return mHandle.promise().result(); }
+
+   /// Start the coroutine, it destroys itself when it completes.
+   void detach()
+   {
+      auto h = std::exchange(mHandle, nullptr);
+      h.promise().detached = true;
+      h.resume();
+   }
+
+private:
+   explicit Task(handle_type h) noexcept : mHandle(h) {}
+   handle_type mHandle;
+};
+
+/**
+ * @brief Coroutine socket I/O driven by a Reactor.
+ *
+ * Each operation first tries the non-blocking syscall, and only suspends
+ * the coroutine on EAGAIN, until the reactor reports the socket ready.
+ * A suspended operation fails with errno ETIMEDOUT when its timeout expires,
+ * or with ECANCELED when cancel() is called for its socket.
+ *
+ * Only one reader and one writer can wait on a socket at a time.
+ * A socket must be removed with remove() before being closed.
+ */
+class IoContext
+{
+public:
+   explicit IoContext(Reactor &reactor) : mReactor(reactor) {}
+   IoContext(const IoContext &) = delete;
+   IoContext &operator=(const IoContext &) = delete;
+
+   ~IoContext()
+   {
+      while (!mWaiters.empty())
+         remove(*mWaiters.begin()->second.sock);
+   }
+
+   Reactor &reactor() noexcept { return mReactor; }
+
+   /// Start a detached coroutine, it runs until its first suspension.
+   void spawn(Task<void> task) { task.detach(); }
+
+   Task<int> recv(Socket &sock, void *buffer, uint32_t size, int timeoutMs = -1)
+   {
+      if (enroll(sock) == -1)
+         co_return -1;
+      while (true)
+      {
+         int rc = sock.recv(buffer, size);
+         if (rc >= 0 || !wouldBlock(sock.error()))
+            co_return rc;
+         if (int err = co_await Wait{*this, sock, false, timeoutMs})
+            co_return fail(err);
+      }
+   }
+
+   Task<int> send(Socket &sock, const void *buffer, uint32_t size, int timeoutMs = -1)
+   {
+      if (enroll(sock) == -1)
+         co_return -1;
+      while (true)
+      {
+         int rc = sock.send(buffer, size);
+         if (rc >= 0 || !wouldBlock(sock.error()))
+            co_return rc;
+         if (int err = co_await Wait{*this, sock, true, timeoutMs})
+            co_return fail(err);
+      }
+   }
+
+   Task<SocketSTREAM> accept(SocketSTREAM &listener, int timeoutMs = -1)
+   {
+      if (enroll(listener) == -1)
+         co_return SocketSTREAM();
+      std::vector<SocketSTREAM> clients;
+      while (true)
+      {
+         int err = 0;
+         if (listener.acceptBatch(clients, 1, &err) == 1)
+            co_return std::move(clients.front());
+         if (err != 0 && err != ECONNABORTED && err != EPROTO)
+         {
+            fail(err);
+            co_return SocketSTREAM();
+         }
+         if (err == 0)
+         {
+            if ((err = co_await Wait{*this, listener, false, timeoutMs}))
+            {
+               fail(err);
+               co_return SocketSTREAM();
+            }
+         }
+      }
+   }
+
+   Task<int> connect(SocketSTREAM &sock, int timeoutMs = -1)
+   {
+      if (enroll(sock) == -1)
+         co_return -1;
+      if (sock.connect() == 0)
+         co_return 0;
+      if (sock.error() != EINPROGRESS)
+         co_return -1;
+      if (int err = co_await Wait{*this, sock, true, timeoutMs})
+         co_return fail(err);
+
+      int soError = 0;
+      int len = sizeof(soError);
+      if (sock.getOption(SOL_SOCKET, SO_ERROR, &soError, &len) == -1)
+         co_return -1;
+      if (soError != 0)
+         co_return fail(soError);
+      co_return 0;
+   }
+
+   /// Wake up the coroutines waiting on the socket, their operation fails with ECANCELED.
+   void cancel(Socket &sock)
+   {
+      wake(sock.getHandle(), false, ECANCELED);
+      wake(sock.getHandle(), true, ECANCELED);
+   }
+
+   /// Cancel the pending operations and unregister the socket from the reactor.
+   void remove(Socket &sock)
+   {
+      cancel(sock);
+      mWaiters.erase(sock.getHandle());
+      mReactor.remove(sock);
+   }
+
+private:
+   struct Wait
+   {
+      IoContext &ctx;
+      Socket &sock;
+      bool write;
+      int timeoutMs;
+      int error = 0;
+      std::coroutine_handle<> handle = nullptr;
+      Timer timer = Timer();
+
+      bool await_ready() noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<> h)
+      {
+         auto &slot = ctx.slot(sock.getHandle(), write);
+         if (slot != nullptr)
+         {
+            error = EBUSY;
+            return false;
+         }
+         handle = h;
+         slot = this;
+         if (timeoutMs >= 0)
+         {
+            SOCKET fd = sock.getHandle();
+            IoContext *pctx = &ctx;
+            bool w = write;
+            timer.setCallback([pctx, fd, w]() { pctx->wake(fd, w, ETIMEDOUT); });
+            ctx.mReactor.timers().arm(timer, static_cast<uint32_t>(timeoutMs));
+         }
+         return true;
+      }
+
+      int await_resume() noexcept
+      {
+         timer.cancel();
+         return error;
+      }
+   };
+
+   struct Waiters
+   {
+      Socket *sock = nullptr;
+      Wait *reader = nullptr;
+      Wait *writer = nullptr;
+   };
+
+   static bool wouldBlock(int err) noexcept
+   {
+      return err == EAGAIN || err == EWOULDBLOCK;
+   }
+
+   static int fail(int err) noexcept
+   {
+      errno = err;
+      return -1;
+   }
+
+   int enroll(Socket &sock)
+   {
+      SOCKET fd = sock.getHandle();
+      if (mWaiters.count(fd))
+         return 0;
+
+      int rc = mReactor.add(sock, Reactor::READ | Reactor::WRITE | Reactor::HANGUP,
+                            [this](Socket &s, uint32_t events) {
+                               SOCKET fd = s.getHandle();
+                               if (events & (Reactor::READ | Reactor::ERROR | Reactor::HANGUP))
+                                  wake(fd, false, 0);
+                               if (events & (Reactor::WRITE | Reactor::ERROR | Reactor::HANGUP))
+                                  wake(fd, true, 0);
+                            });
+      if (rc == 0)
+         mWaiters[fd].sock = &sock;
+      return rc;
+   }
+
+   Wait *&slot(SOCKET fd, bool write)
+   {
+      auto &w = mWaiters[fd];
+      return write ? w.writer : w.reader;
+   }
+
+   void wake(SOCKET fd, bool write, int error)
+   {
+      auto it = mWaiters.find(fd);
+      if (it == mWaiters.end())
+         return;
+      Wait *&s = write ? it->second.writer : it->second.reader;
+      Wait *wait = s;
+      if (wait == nullptr)
+         return;
+      s = nullptr;
+      wait->error = error;
+      wait->handle.resume();
+   }
+
+   Reactor &mReactor;
+   std::unordered_map<SOCKET, Waiters> mWaiters;
+};
+
+#endif
@@ -0,0 +1,190 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : fanoutgroup.cpp
+// Contents  : AF_PACKET fanout capture group implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <pthread.h>
+#include <sched.h>
+
+#include "fanoutgroup.h"
+
+/**
+ * @brief Construct a new FanoutGroup object: open the members and join the group.
+ *
+ * @param ifIndex : The interface index.
+ * @param members : Number of members, zero means one per CPU.
+ * @param mode : The fanout mode.
+ * @param protocol : The ethernet protocol to capture, host order.
+ * @param flags : The fanout flags, PACKET_FANOUT_FLAG_DEFRAG keeps the IP fragments of a datagram together.
+ * @param blockSize : The block size of each member ring.
+ * @param blockCount : The number of blocks of each member ring.
+ * @param groupId : The fanout group id, zero to let the kernel pick an id unused on the system.
+ */
+FanoutGroup::FanoutGroup(int ifIndex, uint32_t members /*=0*/, Mode mode /*=HASH*/, uint16_t protocol /*=ETH_P_ALL*/,
+                         uint16_t flags /*=PACKET_FANOUT_FLAG_DEFRAG*/, uint32_t blockSize /*=1 << 20*/,
+                         uint32_t blockCount /*=64*/, uint16_t groupId /*=0*/)
+   : mGroupId(groupId), mRunning(false), mError(0)
+{
+   if (members == 0)
+      members = std::thread::hardware_concurrency();
+   if (members == 0)
+      members = 1;
+
+   for (uint32_t i = 0; i < members; i++)
+   {
+      std::unique_ptr<PacketRing> ring(new PacketRing(ifIndex, protocol, blockSize, blockCount));
+      if (mGroupId == 0)
+      {
+         // The first member creates the group with a unique id, the others join it
+         uint32_t arg = 0;
+         int len = sizeof(arg);
+         if (ring->joinFanout(0, mode, flags | PACKET_FANOUT_FLAG_UNIQUEID) == -1 ||
+             ring->socket().getOption(SOL_PACKET, PACKET_FANOUT, &arg, &len) == -1)
+            throw std::system_error(errno, std::system_category(), "PACKET_FANOUT");
+         mGroupId = static_cast<uint16_t>(arg & 0xFFFF);
+      }
+      else if (ring->joinFanout(mGroupId, mode, flags) == -1)
+         throw std::system_error(errno, std::system_category(), "PACKET_FANOUT");
+      mMembers.push_back(std::move(ring));
+   }
+}
+
+FanoutGroup::~FanoutGroup()
+{
+   stop();
+}
+
+/**
+ * @brief Set the classic BPF program of a CBPF group.
+ *
+ * The program returns the member index of each frame, modulo the group size.
+ *
+ * @param code : The program.
+ * @param len : The number of instructions.
+ * @return int : zero on success.
+ */
+int FanoutGroup::setProgram(const sock_filter *code, uint16_t len) noexcept
+{
+   sock_fprog prog = {};
+   prog.len = len;
+   prog.filter = const_cast<sock_filter *>(code);
+   return mMembers.front()->socket().setOption(SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog));
+}
+
+/**
+ * @brief Start one capture thread per member.
+ *
+ * @param handler : Called from the member thread for each frame.
+ * @param pinThreads : Pin the thread of member i on the CPU i.
+ */
+void FanoutGroup::start(Handler handler, bool pinThreads /*=true*/)
+{
+   if (mRunning)
+      throw std::runtime_error("FanoutGroup already started");
+
+   mHandler = std::move(handler);
+   mError = 0;
+   mRunning = true;
+   for (uint32_t i = 0; i < mMembers.size(); i++)
+      mWorkers.emplace_back(&FanoutGroup::worker, this, i, pinThreads);
+}
+
+/**
+ * @brief Stop and join the capture threads.
+ *
+ * A thread notices the stop within the 100ms poll timeout.
+ */
+void FanoutGroup::stop()
+{
+   if (!mRunning)
+      return;
+
+   mRunning = false;
+   for (auto &th : mWorkers)
+      th.join();
+   mWorkers.clear();
+}
+
+/**
+ * @brief The sum of the members PACKET_STATISTICS counters.
+ */
+PacketRing::Stats FanoutGroup::stats() noexcept
+{
+   PacketRing::Stats total;
+   for (auto &ring : mMembers)
+   {
+      auto st = ring->stats();
+      total.packets += st.packets;
+      total.drops += st.drops;
+      total.freezes += st.freezes;
+   }
+   return total;
+}
+
+/**
+ * @brief Number of members.
+ */
+uint32_t FanoutGroup::size() const noexcept
+{
+   return static_cast<uint32_t>(mMembers.size());
+}
+
+/**
+ * @brief The fanout group id.
+ */
+uint16_t FanoutGroup::groupId() const noexcept
+{
+   return mGroupId;
+}
+
+/**
+ * @brief The errno that stopped a capture thread, zero while they all run.
+ */
+int FanoutGroup::error() const noexcept
+{
+   return mError.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Access a member ring, to poll it from a user thread instead of start().
+ */
+PacketRing &FanoutGroup::member(uint32_t index)
+{
+   return *mMembers.at(index);
+}
+
+void FanoutGroup::worker(uint32_t index, bool pin)
+{
+   if (pin)
+   {
+      uint32_t nbCpu = std::thread::hardware_concurrency();
+      if (nbCpu != 0)
+      {
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET(index % nbCpu, &set);
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      }
+   }
+
+   auto &ring = *mMembers[index];
+   while (mRunning)
+   {
+      if (ring.poll([this, index](const PacketRing::Frame &frame) { mHandler(frame, index); }, 100) == -1 && errno != EINTR)
+      {
+         // The member no longer captures, report it through error()
+         mError.store(errno, std::memory_order_relaxed);
+         break;
+      }
+   }
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : fanoutgroup.h
+// Contents  : AF_PACKET fanout capture group interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <linux/filter.h>
+
+#include "packetring.h"
+
+/**
+ * @brief N PacketRing on the same interface, joined to a PACKET_FANOUT group.
+ *
+ * The kernel spreads the frames over the members according to the mode,
+ * each member is serviced by its own worker thread, optionally pinned to a CPU.
+ * With the HASH mode all the frames of a flow go to the same member, so the
+ * per flow order is kept.
+ */
+class LIBSOCKET_EXPORT FanoutGroup
+{
+public:
+   enum Mode : uint16_t
+   {
+      HASH     = PACKET_FANOUT_HASH,       ///< By flow hash, keeps the per flow order.
+      LB       = PACKET_FANOUT_LB,         ///< Round robin.
+      CPU      = PACKET_FANOUT_CPU,        ///< By the CPU that received the frame.
+      ROLLOVER = PACKET_FANOUT_ROLLOVER,   ///< Fill a member, then the next one.
+      QM       = PACKET_FANOUT_QM,         ///< By NIC receive queue.
+      CBPF     = PACKET_FANOUT_CBPF,       ///< By a classic BPF program, see setProgram.
+   };
+
+   using Handler = std::function<void(const PacketRing::Frame &frame, uint32_t member)>;
+
+   explicit FanoutGroup(int ifIndex, uint32_t members = 0, Mode mode = HASH, uint16_t protocol = ETH_P_ALL,
+                        uint16_t flags = PACKET_FANOUT_FLAG_DEFRAG, uint32_t blockSize = 1 << 20,
+                        uint32_t blockCount = 64, uint16_t groupId = 0);
+   FanoutGroup(const FanoutGroup &) = delete;
+   FanoutGroup &operator=(const FanoutGroup &) = delete;
+   ~FanoutGroup();
+
+   int setProgram(const sock_filter *code, uint16_t len) noexcept;
+   void start(Handler handler, bool pinThreads = true);
+   void stop();
+
+   PacketRing::Stats stats() noexcept;
+   uint32_t size() const noexcept;
+   uint16_t groupId() const noexcept;
+   int error() const noexcept;
+   PacketRing &member(uint32_t index);
+
+private:
+   void worker(uint32_t index, bool pin);
+
+   uint16_t mGroupId;
+   std::atomic<bool> mRunning;
+   std::atomic<int> mError;   ///< The errno that stopped a worker.
+   Handler mHandler;
+   std::vector<std::unique_ptr<PacketRing>> mMembers;
+   std::vector<std::thread> mWorkers;
+};
@@ -0,0 +1,419 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : feedarbiter.cpp
+// Contents  : A/B feed line arbitration implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "config.h"
+#include "feedarbiter.h"
+
+namespace
+{
+   uint32_t roundUpPow2(uint32_t value, uint32_t minimum)
+   {
+      uint32_t n = minimum;
+      while (n < value)
+         n <<= 1;
+      return n;
+   }
+
+   // Index of the lowest set bit, word must not be zero
+   uint32_t lowestBit(uint64_t word) noexcept
+   {
+#if defined(__GNUC__) || defined(__clang__)
+      return static_cast<uint32_t>(__builtin_ctzll(word));
+#else
+      uint32_t n = 0;
+      while ((word & 1) == 0)
+      {
+         word >>= 1;
+         n++;
+      }
+      return n;
+#endif
+   }
+}
+
+/**
+ * @brief Construct a new FeedArbiter object.
+ *
+ * @param field : The sequence number field of the datagrams.
+ * @param windowSize : The reorder window, in sequence numbers, rounded up to a power of 2 (minimum 64).
+ * @param slotSize : The maximum datagram size.
+ * @param ringSize : The number of datagrams queued per line, at least MMSG_BATCH_SIZE, rounded up to a power of 2.
+ * @param gapTimeoutUs : The time a later datagram waits for a missing one, in micro second(s).
+ */
+FeedArbiter::FeedArbiter(const SequenceField &field, uint32_t windowSize /*=1024*/, uint32_t slotSize /*=2048*/,
+                         uint32_t ringSize /*=4096*/, uint32_t gapTimeoutUs /*=1000*/)
+   : mField(field), mSlotSize(slotSize), mRingSize(roundUpPow2(std::max<uint32_t>(ringSize, MMSG_BATCH_SIZE), 1)),
+     mGapTimeout(gapTimeoutUs), mRunning(false)
+{
+   uint32_t window = roundUpPow2(windowSize, 64);
+   mWindowMask = window - 1;
+   mBitmap.resize(window / 64, 0);
+   mWindow.resize(static_cast<size_t>(window) * slotSize);
+   mWindowLength.resize(window, 0);
+   mWindowLine.resize(window, 0);
+}
+
+FeedArbiter::~FeedArbiter()
+{
+   stop();
+}
+
+/**
+ * @brief Add a line, the socket must be open and bound.
+ *
+ * Lines must be added before start() or the first receive().
+ *
+ * @param sock : The socket of the line.
+ * @return uint32_t : The line index.
+ */
+uint32_t FeedArbiter::addLine(SocketDGRAM &sock)
+{
+   if (mRunning)
+      throw std::runtime_error("FeedArbiter already started");
+
+   std::unique_ptr<Line> line(new Line());
+   line->sock = &sock;
+   line->buffer.resize(static_cast<size_t>(mRingSize) * mSlotSize);
+   line->slots.resize(mRingSize);
+   for (uint32_t i = 0; i < mRingSize; i++)
+   {
+      memset(&line->slots[i], 0, sizeof(datagram));
+      line->slots[i].buffer = line->buffer.data() + static_cast<size_t>(i) * mSlotSize;
+      line->slots[i].size = mSlotSize;
+   }
+   line->head = 0;
+   line->overruns = 0;
+   line->error = 0;
+   line->tail = 0;
+   mLines.push_back(std::move(line));
+   return static_cast<uint32_t>(mLines.size() - 1);
+}
+
+/**
+ * @brief Set the next expected sequence number.
+ *
+ * By default the first received sequence number starts the feed.
+ * Consumer thread only, before the first poll().
+ *
+ * @param seq : The next sequence number.
+ */
+void FeedArbiter::setNext(uint64_t seq) noexcept
+{
+   mNext = seq;
+   mStarted = true;
+}
+
+/**
+ * @brief Receive a batch of datagrams of a line into its ring.
+ *
+ * Only one thread may call receive for a given line.
+ *
+ * @param line : The line index.
+ * @param timeoutMs : The time to wait for the first datagram in milli second(s), -1 to block.
+ * @return int : The number of queued datagrams, 0 on timeout or when the ring is full, -1 on error.
+ */
+int FeedArbiter::receive(uint32_t line, int timeoutMs /*=-1*/) noexcept
+{
+   if (line >= mLines.size())
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   Line &l = *mLines[line];
+   uint64_t head = l.head.load(std::memory_order_relaxed);
+   uint64_t free = mRingSize - (head - l.tail.load(std::memory_order_acquire));
+   if (free == 0)
+   {
+      // The consumer is late, the datagrams wait in the socket buffer
+      l.overruns.fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::yield();
+      return 0;
+   }
+
+   // recvBatch needs contiguous slots, stop at the end of the ring
+   uint32_t index = static_cast<uint32_t>(head & (mRingSize - 1));
+   uint64_t count = mRingSize - index;
+   if (count > free)
+      count = free;
+   if (count > MMSG_BATCH_SIZE)
+      count = MMSG_BATCH_SIZE;
+
+   int n = l.sock->recvBatch(&l.slots[index], static_cast<uint32_t>(count), timeoutMs);
+   if (n > 0)
+      l.head.store(head + n, std::memory_order_release);
+   return n;
+}
+
+/**
+ * @brief Start one receive thread per line.
+ */
+void FeedArbiter::start()
+{
+   if (mRunning)
+      throw std::runtime_error("FeedArbiter already started");
+
+   mRunning = true;
+   for (uint32_t i = 0; i < mLines.size(); i++)
+   {
+      mThreads.emplace_back([this, i]() {
+         while (mRunning)
+         {
+            if (receive(i, 100) != -1)
+               continue;
+
+            int err = errno;
+            if (err == EINTR)
+               continue;
+            if (err == EAGAIN || err == EWOULDBLOCK || err == ENOMEM || err == ENOBUFS || err == ECONNREFUSED)
+            {
+               // Transient, give the system time to recover instead of spinning
+               std::this_thread::sleep_for(std::chrono::milliseconds(1));
+               continue;
+            }
+
+            // The socket is unusable, see error()
+            mLines[i]->error.store(err, std::memory_order_relaxed);
+            break;
+         }
+      });
+   }
+}
+
+/**
+ * @brief Stop and join the receive threads.
+ */
+void FeedArbiter::stop()
+{
+   mRunning = false;
+   for (auto &th : mThreads)
+      th.join();
+   mThreads.clear();
+}
+
+/**
+ * @brief Arbitrate the queued datagrams of all the lines.
+ *
+ * @param handler : Called once per sequence number, in order.
+ * @param gapHandler : Called for each range of sequence numbers lost on every line.
+ * @return uint32_t : The number of datagrams read from the rings.
+ */
+uint32_t FeedArbiter::poll(const Handler &handler, const GapHandler &gapHandler /*=nullptr*/)
+{
+   uint32_t n = 0;
+   for (uint32_t i = 0; i < mLines.size(); i++)
+   {
+      Line &l = *mLines[i];
+      uint64_t tail = l.tail.load(std::memory_order_relaxed);
+      uint64_t head = l.head.load(std::memory_order_acquire);
+      for (; tail != head; tail++)
+      {
+         process(l.slots[tail & (mRingSize - 1)], i, handler, gapHandler);
+         n++;
+      }
+      l.tail.store(tail, std::memory_order_release);
+   }
+
+   if (mPending > 0 && Clock::now() - mBlockedSince >= mGapTimeout)
+   {
+      uint64_t seq;
+      if (firstPending(seq))
+         skipTo(seq, handler, gapHandler);
+   }
+   return n;
+}
+
+/**
+ * @brief The next expected sequence number.
+ */
+uint64_t FeedArbiter::next() const noexcept
+{
+   return mNext;
+}
+
+/**
+ * @brief The counters, consumer thread only.
+ */
+const FeedArbiter::Stats &FeedArbiter::stats() const noexcept
+{
+   return mStats;
+}
+
+/**
+ * @brief Number of receive calls that found the ring of a line full.
+ */
+uint64_t FeedArbiter::overruns(uint32_t line) const noexcept
+{
+   return line < mLines.size() ? mLines[line]->overruns.load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief The errno that stopped the receive thread of a line, zero while it runs.
+ */
+int FeedArbiter::error(uint32_t line) const noexcept
+{
+   return line < mLines.size() ? mLines[line]->error.load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief Number of lines.
+ */
+uint32_t FeedArbiter::lines() const noexcept
+{
+   return static_cast<uint32_t>(mLines.size());
+}
+
+void FeedArbiter::process(const datagram &msg, uint32_t line, const Handler &handler, const GapHandler &gapHandler)
+{
+   uint64_t seq;
+   if (msg.truncated || !mField.read(msg.buffer, msg.length, seq))
+   {
+      mStats.malformed++;
+      return;
+   }
+
+   Line &l = *mLines[line];
+   if (!l.seen || seq > l.highest)
+   {
+      l.highest = seq;
+      l.seen = true;
+   }
+
+   if (!mStarted)
+   {
+      mNext = seq;
+      mStarted = true;
+   }
+
+   if (seq < mNext)
+   {
+      mStats.duplicates++;
+      return;
+   }
+
+   // The window is full, the oldest missing sequence numbers are lost.
+   // When every line already reached seq, the whole range before it is.
+   if (seq - mNext > mWindowMask)
+      skipTo(allLinesReached(seq) ? seq : seq - mWindowMask, handler, gapHandler);
+
+   // Fast path, the expected datagram is delivered from the line ring
+   if (seq == mNext)
+   {
+      handler(seq, msg.buffer, msg.length, line);
+      mStats.delivered++;
+      mNext++;
+      if (mPending > 0)
+         drain(handler);
+      return;
+   }
+
+   if (isSet(seq))
+      mStats.duplicates++;
+   else
+      store(seq, msg, line);
+
+   if (allLinesReached(mNext + 1))
+   {
+      uint64_t first;
+      if (firstPending(first))
+         skipTo(first, handler, gapHandler);
+   }
+}
+
+void FeedArbiter::store(uint64_t seq, const datagram &msg, uint32_t line)
+{
+   uint64_t index = seq & mWindowMask;
+   memcpy(&mWindow[index * mSlotSize], msg.buffer, msg.length);
+   mWindowLength[index] = msg.length;
+   mWindowLine[index] = line;
+   set(seq);
+   if (mPending++ == 0)
+      mBlockedSince = Clock::now();
+}
+
+void FeedArbiter::drain(const Handler &handler)
+{
+   while (mPending > 0 && isSet(mNext))
+   {
+      uint64_t index = mNext & mWindowMask;
+      handler(mNext, &mWindow[index * mSlotSize], mWindowLength[index], mWindowLine[index]);
+      mStats.delivered++;
+      clear(mNext);
+      mPending--;
+      mNext++;
+   }
+   if (mPending > 0)
+      mBlockedSince = Clock::now();
+}
+
+void FeedArbiter::skipTo(uint64_t seq, const Handler &handler, const GapHandler &gapHandler)
+{
+   // Only the buffered sequence numbers are visited, the cost does not
+   // depend on the size of the jump
+   while (mNext < seq)
+   {
+      uint64_t pending;
+      uint64_t end = (seq - mNext > mWindowMask) ? mNext + mWindowMask + 1 : seq;
+      uint64_t first = mNext;
+      mNext = findSet(mNext, end, pending) ? pending : seq;
+      if (mNext > first)
+      {
+         mStats.gaps++;
+         mStats.missing += mNext - first;
+         if (gapHandler)
+            gapHandler(first, mNext - first);
+      }
+      drain(handler);
+   }
+   drain(handler);
+}
+
+bool FeedArbiter::findSet(uint64_t from, uint64_t end, uint64_t &seq) const noexcept
+{
+   // end - from is at most the window size, a bit found before end is a buffered sequence number
+   while (from < end)
+   {
+      uint64_t word = mBitmap[(from & mWindowMask) >> 6] >> (from & 63);
+      if (word != 0)
+      {
+         from += lowestBit(word);
+         if (from >= end)
+            return false;
+         seq = from;
+         return true;
+      }
+      from = (from | 63) + 1;
+   }
+   return false;
+}
+
+bool FeedArbiter::firstPending(uint64_t &seq) const noexcept
+{
+   if (mPending == 0)
+      return false;
+   return findSet(mNext, mNext + mWindowMask + 1, seq);
+}
+
+bool FeedArbiter::allLinesReached(uint64_t seq) const noexcept
+{
+   for (const auto &line : mLines)
+   {
+      if (!line->seen || line->highest < seq)
+         return false;
+   }
+   return true;
+}
@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : feedarbiter.h
+// Contents  : A/B feed line arbitration interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "socketdgram.h"
+#include "sequencefield.h"
+
+/**
+ * @brief Merge N redundant datagram feeds into one, in sequence order.
+ *
+ * Each line (a SocketDGRAM) is read by its own producer, receive() or the
+ * thread started by start(), into a single producer single consumer ring.
+ * The consumer calls poll(): it reads the sequence number of each datagram,
+ * drops the duplicates, buffers the early datagrams in a reorder window
+ * and calls the handler once per sequence number, in order.
+ *
+ * A missing sequence number is reported as a gap when every line has
+ * delivered a later one, when the reorder window is full, or when a later
+ * datagram waited gapTimeoutUs.
+ *
+ * The rings and the window are allocated by the constructor and addLine,
+ * poll and receive never allocate nor lock.
+ * The sequence numbers must not wrap.
+ */
+class LIBSOCKET_EXPORT FeedArbiter
+{
+public:
+   using Clock = std::chrono::steady_clock;
+   using Handler = std::function<void(uint64_t seq, const void *data, uint32_t length, uint32_t line)>;
+   using GapHandler = std::function<void(uint64_t first, uint64_t count)>;
+
+   /// The counters, owned by the consumer thread.
+   struct Stats
+   {
+      uint64_t delivered = 0;    ///< Sequence numbers passed to the handler.
+      uint64_t duplicates = 0;   ///< Datagrams already delivered or buffered.
+      uint64_t gaps = 0;         ///< Gaps reported.
+      uint64_t missing = 0;      ///< Sequence numbers lost on every line.
+      uint64_t malformed = 0;    ///< Datagrams too short for the sequence field, or truncated.
+   };
+
+   explicit FeedArbiter(const SequenceField &field, uint32_t windowSize = 1024, uint32_t slotSize = 2048,
+                        uint32_t ringSize = 4096, uint32_t gapTimeoutUs = 1000);
+   FeedArbiter(const FeedArbiter &) = delete;
+   FeedArbiter &operator=(const FeedArbiter &) = delete;
+   ~FeedArbiter();
+
+   uint32_t addLine(SocketDGRAM &sock);
+   void setNext(uint64_t seq) noexcept;
+
+   // producer side, one thread per line
+   int receive(uint32_t line, int timeoutMs = -1) noexcept;
+   void start();
+   void stop();
+
+   // consumer side
+   uint32_t poll(const Handler &handler, const GapHandler &gapHandler = nullptr);
+   uint64_t next() const noexcept;
+   const Stats &stats() const noexcept;
+   uint64_t overruns(uint32_t line) const noexcept;
+   int error(uint32_t line) const noexcept;
+   uint32_t lines() const noexcept;
+
+private:
+   struct Line
+   {
+      SocketDGRAM *sock = nullptr;
+      std::vector<uint8_t> buffer;
+      std::vector<datagram> slots;
+      uint64_t highest = 0;   ///< consumer only
+      bool seen = false;      ///< consumer only
+
+      char pad0[64];
+      std::atomic<uint64_t> head;      ///< written by the producer
+      std::atomic<uint64_t> overruns;  ///< written by the producer
+      std::atomic<int> error;          ///< written by the producer thread
+      char pad1[64];
+      std::atomic<uint64_t> tail;      ///< written by the consumer
+      char pad2[64];
+   };
+
+   void process(const datagram &msg, uint32_t line, const Handler &handler, const GapHandler &gapHandler);
+   void store(uint64_t seq, const datagram &msg, uint32_t line);
+   void drain(const Handler &handler);
+   void skipTo(uint64_t seq, const Handler &handler, const GapHandler &gapHandler);
+   bool findSet(uint64_t from, uint64_t end, uint64_t &seq) const noexcept;
+   bool firstPending(uint64_t &seq) const noexcept;
+   bool allLinesReached(uint64_t seq) const noexcept;
+
+   bool isSet(uint64_t seq) const noexcept { return (mBitmap[(seq & mWindowMask) >> 6] >> (seq & 63)) & 1; }
+   void set(uint64_t seq) noexcept { mBitmap[(seq & mWindowMask) >> 6] |= uint64_t(1) << (seq & 63); }
+   void clear(uint64_t seq) noexcept { mBitmap[(seq & mWindowMask) >> 6] &= ~(uint64_t(1) << (seq & 63)); }
+
+   SequenceField mField;
+   uint32_t mSlotSize;
+   uint32_t mRingSize;
+   std::chrono::microseconds mGapTimeout;
+
+   std::vector<std::unique_ptr<Line>> mLines;
+   std::atomic<bool> mRunning;
+   std::vector<std::thread> mThreads;
+
+   // The reorder window, a ring indexed by sequence number
+   uint64_t mWindowMask;
+   std::vector<uint64_t> mBitmap;
+   std::vector<uint8_t> mWindow;
+   std::vector<uint32_t> mWindowLength;
+   std::vector<uint32_t> mWindowLine;
+   uint32_t mPending = 0;
+   Clock::time_point mBlockedSince;
+
+   uint64_t mNext = 0;
+   bool mStarted = false;
+   Stats mStats;
+};
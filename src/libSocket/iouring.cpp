@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : iouring.cpp
+// Contents  : io_uring batched socket operations implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "iouring.h"
+
+namespace
+{
+   constexpr uint32_t NO_OP = 0xffffffff;
+
+   int io_uring_setup(unsigned entries, io_uring_params *p)
+   {
+      return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+   }
+
+   int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+   {
+      return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+   }
+
+   int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nrArgs)
+   {
+      return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+   }
+
+   template <typename T>
+   T *offset(void *base, uint32_t off)
+   {
+      return reinterpret_cast<T *>(static_cast<char *>(base) + off);
+   }
+}
+
+/**
+ * @brief Construct a new IoUring object.
+ *
+ * @param entries : The submission queue size, the completion queue is twice bigger.
+ */
+IoUring::IoUring(uint32_t entries /*=256*/)
+{
+   mRing = io_uring_setup(entries, &mParams);
+   if (mRing == -1)
+      throw std::system_error(errno, std::system_category(), "io_uring_setup");
+
+   mSqSize = mParams.sq_off.array + mParams.sq_entries * sizeof(unsigned);
+   mCqSize = mParams.cq_off.cqes + mParams.cq_entries * sizeof(io_uring_cqe);
+   if (mParams.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      if (mCqSize > mSqSize)
+         mSqSize = mCqSize;
+      mCqSize = mSqSize;
+   }
+
+   mSqPtr = mmap(nullptr, mSqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_SQ_RING);
+   if (mSqPtr == MAP_FAILED)
+   {
+      int err = errno;
+      ::close(mRing);
+      throw std::system_error(err, std::system_category(), "mmap sq ring");
+   }
+
+   if (mParams.features & IORING_FEAT_SINGLE_MMAP)
+      mCqPtr = mSqPtr;
+   else
+   {
+      mCqPtr = mmap(nullptr, mCqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_CQ_RING);
+      if (mCqPtr == MAP_FAILED)
+      {
+         int err = errno;
+         munmap(mSqPtr, mSqSize);
+         ::close(mRing);
+         throw std::system_error(err, std::system_category(), "mmap cq ring");
+      }
+   }
+
+   mSqesSize = mParams.sq_entries * sizeof(io_uring_sqe);
+   void *sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_SQES);
+   if (sqes == MAP_FAILED)
+   {
+      int err = errno;
+      if (mCqPtr != mSqPtr)
+         munmap(mCqPtr, mCqSize);
+      munmap(mSqPtr, mSqSize);
+      ::close(mRing);
+      throw std::system_error(err, std::system_category(), "mmap sqes");
+   }
+   mSqes = static_cast<io_uring_sqe *>(sqes);
+
+   mSqHead  = offset<unsigned>(mSqPtr, mParams.sq_off.head);
+   mSqTail  = offset<unsigned>(mSqPtr, mParams.sq_off.tail);
+   mSqMask  = offset<unsigned>(mSqPtr, mParams.sq_off.ring_mask);
+   mSqArray = offset<unsigned>(mSqPtr, mParams.sq_off.array);
+   mCqHead  = offset<unsigned>(mCqPtr, mParams.cq_off.head);
+   mCqTail  = offset<unsigned>(mCqPtr, mParams.cq_off.tail);
+   mCqMask  = offset<unsigned>(mCqPtr, mParams.cq_off.ring_mask);
+   mCqes    = offset<io_uring_cqe>(mCqPtr, mParams.cq_off.cqes);
+
+   // One operation slot per completion entry, chained in a free list
+   mOps.resize(mParams.cq_entries);
+   for (uint32_t i = 0; i < mOps.size(); i++)
+      mOps[i].next = i + 1;
+   mOps.back().next = NO_OP;
+   mFreeOp = 0;
+}
+
+IoUring::~IoUring()
+{
+   munmap(mSqes, mSqesSize);
+   if (mCqPtr != mSqPtr)
+      munmap(mCqPtr, mCqSize);
+   munmap(mSqPtr, mSqSize);
+   ::close(mRing);
+}
+
+/**
+ * @brief Register buffers for sendFixed/recvFixed.
+ *
+ * The kernel pins the pages once, instead of mapping them on each operation.
+ *
+ * @param iov : The buffers to register.
+ * @param nr : Number of buffers, the index of a buffer is its iov position.
+ * @return int : zero on success.
+ */
+int IoUring::registerBuffers(const iovec *iov, uint32_t nr) noexcept
+{
+   return io_uring_register(mRing, IORING_REGISTER_BUFFERS, iov, nr);
+}
+
+int IoUring::unregisterBuffers() noexcept
+{
+   return io_uring_register(mRing, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+}
+
+/**
+ * @brief Register sockets as fixed files.
+ *
+ * Operations queued on a registered socket use its fixed file index,
+ * which saves the file reference counting on each operation.
+ *
+ * @param socks : The opened sockets to register.
+ * @param nr : Number of sockets.
+ * @return int : zero on success.
+ */
+int IoUring::registerSockets(Socket *const *socks, uint32_t nr)
+{
+   std::vector<int> fds(nr);
+   for (uint32_t i = 0; i < nr; i++)
+      fds[i] = socks[i]->getHandle();
+
+   int rc = io_uring_register(mRing, IORING_REGISTER_FILES, fds.data(), nr);
+   if (rc == 0)
+   {
+      mFixedFiles.clear();
+      for (uint32_t i = 0; i < nr; i++)
+         mFixedFiles[fds[i]] = static_cast<int>(i);
+   }
+   return rc;
+}
+
+int IoUring::unregisterSockets() noexcept
+{
+   mFixedFiles.clear();
+   return io_uring_register(mRing, IORING_UNREGISTER_FILES, nullptr, 0);
+}
+
+io_uring_sqe *IoUring::getSqe(Socket &sock, uint8_t opcode, Callback &callback)
+{
+   unsigned tail = *mSqTail;
+   unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+   if (tail - head >= mParams.sq_entries || mFreeOp == NO_OP)
+   {
+      errno = EBUSY;
+      return nullptr;
+   }
+
+   uint32_t index = mFreeOp;
+   mFreeOp = mOps[index].next;
+   mOps[index].callback = std::move(callback);
+   mOps[index].client = nullptr;
+
+   unsigned slot = tail & *mSqMask;
+   io_uring_sqe *sqe = &mSqes[slot];
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode = opcode;
+   sqe->user_data = index;
+
+   auto it = mFixedFiles.find(sock.getHandle());
+   if (it != mFixedFiles.end())
+   {
+      sqe->fd = it->second;
+      sqe->flags |= IOSQE_FIXED_FILE;
+   }
+   else
+      sqe->fd = sock.getHandle();
+
+   mSqArray[slot] = slot;
+   __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+   mPending++;
+   mInflight++;
+   return sqe;
+}
+
+/**
+ * @brief Queue a send.
+ *
+ * @return int : zero on success, -1 if the queue is full.
+ */
+int IoUring::send(Socket &sock, const void *buffer, uint32_t size, Callback callback)
+{
+   auto sqe = getSqe(sock, IORING_OP_SEND, callback);
+   if (sqe == nullptr)
+      return -1;
+
+   sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+   sqe->len = size;
+   sqe->msg_flags = sock.getSendFlags();
+   return 0;
+}
+
+/**
+ * @brief Queue a recv.
+ *
+ * @return int : zero on success, -1 if the queue is full.
+ */
+int IoUring::recv(Socket &sock, void *buffer, uint32_t size, Callback callback)
+{
+   auto sqe = getSqe(sock, IORING_OP_RECV, callback);
+   if (sqe == nullptr)
+      return -1;
+
+   sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+   sqe->len = size;
+   sqe->msg_flags = sock.getRecvFlags();
+   return 0;
+}
+
+/**
+ * @brief Queue a send from a registered buffer.
+ *
+ * @param bufIndex : The index of the registered buffer that contains buffer.
+ * @return int : zero on success, -1 if the queue is full.
+ */
+int IoUring::sendFixed(Socket &sock, uint16_t bufIndex, const void *buffer, uint32_t size, Callback callback)
+{
+   auto sqe = getSqe(sock, IORING_OP_WRITE_FIXED, callback);
+   if (sqe == nullptr)
+      return -1;
+
+   sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+   sqe->len = size;
+   sqe->buf_index = bufIndex;
+   return 0;
+}
+
+/**
+ * @brief Queue a recv into a registered buffer.
+ *
+ * @param bufIndex : The index of the registered buffer that contains buffer.
+ * @return int : zero on success, -1 if the queue is full.
+ */
+int IoUring::recvFixed(Socket &sock, uint16_t bufIndex, void *buffer, uint32_t size, Callback callback)
+{
+   auto sqe = getSqe(sock, IORING_OP_READ_FIXED, callback);
+   if (sqe == nullptr)
+      return -1;
+
+   sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+   sqe->len = size;
+   sqe->buf_index = bufIndex;
+   return 0;
+}
+
+/**
+ * @brief Queue an accept.
+ *
+ * On completion, the client socket handle and address are set before
+ * the callback is called.
+ *
+ * @param listener : A listening socket.
+ * @param client : A closed socket which receives the accepted connection.
+ * @return int : zero on success, -1 if the queue is full.
+ */
+int IoUring::accept(Socket &listener, Socket &client, Callback callback)
+{
+   auto sqe = getSqe(listener, IORING_OP_ACCEPT, callback);
+   if (sqe == nullptr)
+      return -1;
+
+   client.mAddr = {};
+   client.mAddr.size = sizeof(client.mAddr.ss);
+   sqe->addr = reinterpret_cast<uintptr_t>(&client.mAddr.sa);
+   sqe->addr2 = reinterpret_cast<uintptr_t>(&client.mAddr.size);
+   sqe->accept_flags = SOCK_CLOEXEC;
+   mOps[sqe->user_data].client = &client;
+   return 0;
+}
+
+/**
+ * @brief Queue a connect to the socket configured address.
+ *
+ * @return int : zero on success, -1 if the queue is full.
+ */
+int IoUring::connect(Socket &sock, Callback callback)
+{
+   auto sqe = getSqe(sock, IORING_OP_CONNECT, callback);
+   if (sqe == nullptr)
+      return -1;
+
+   sqe->addr = reinterpret_cast<uintptr_t>(&sock.mAddr.sa);
+   sqe->off = sock.mAddr.size;
+   return 0;
+}
+
+/**
+ * @brief Number of queued operations not yet submitted.
+ */
+uint32_t IoUring::pending() const noexcept
+{
+   return mPending;
+}
+
+/**
+ * @brief Number of operations waiting for their completion.
+ */
+uint32_t IoUring::inflight() const noexcept
+{
+   return mInflight;
+}
+
+/**
+ * @brief Submit all queued operations with one io_uring_enter.
+ *
+ * @param waitNr : Minimum number of completions to wait for.
+ * @return int : The number of submitted operations, -1 on error.
+ */
+int IoUring::submit(uint32_t waitNr /*=0*/) noexcept
+{
+   if (mPending == 0 && waitNr == 0)
+      return 0;
+
+   int rc = io_uring_enter(mRing, mPending, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0);
+   if (rc >= 0)
+      mPending -= static_cast<uint32_t>(rc);
+   return rc;
+}
+
+/**
+ * @brief Dispatch the available completions to their callbacks.
+ *
+ * A callback can queue new operations, they are submitted on the next submit().
+ *
+ * @param waitNr : Minimum number of completions to wait for.
+ * @return int : The number of dispatched completions, -1 on error.
+ */
+int IoUring::complete(uint32_t waitNr /*=0*/)
+{
+   if (waitNr && submit(waitNr) == -1 && errno != EINTR)
+      return -1;
+
+   int n = 0;
+   unsigned head = *mCqHead;
+   unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+   while (head != tail)
+   {
+      const io_uring_cqe &cqe = mCqes[head & *mCqMask];
+      uint32_t index = static_cast<uint32_t>(cqe.user_data);
+      int result = cqe.res;
+      head++;
+      __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+      // Release the slot before the call, the callback may queue a new operation
+      Operation &op = mOps[index];
+      Callback callback = std::move(op.callback);
+      if (op.client != nullptr && result >= 0)
+         op.client->mSock = result;
+      op.callback = nullptr;
+      op.next = mFreeOp;
+      mFreeOp = index;
+      mInflight--;
+      n++;
+
+      if (callback)
+         callback(result);
+
+      tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+   }
+   return n;
+}
@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : iouring.h
+// Contents  : io_uring batched socket operations interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <linux/io_uring.h>
+
+#include "socket.h"
+
+/**
+ * @brief Queue many socket operations and submit them with one syscall.
+ *
+ * Operations are queued with send/recv/accept/connect, then submit() hands
+ * the whole batch to the kernel with one io_uring_enter. Completions are
+ * dispatched by complete() to the callback of each operation, the callback
+ * receives the operation result: a byte count, a socket handle for accept,
+ * or a negative errno value.
+ *
+ * The buffers and the sockets must stay alive until the completion.
+ * The sockets should be in blocking mode, the kernel does the waiting.
+ *
+ * This class wraps the raw io_uring syscalls, liburing is not needed.
+ */
+class LIBSOCKET_EXPORT IoUring
+{
+public:
+   using Callback = std::function<void(int result)>;
+
+   explicit IoUring(uint32_t entries = 256);
+   IoUring(const IoUring &) = delete;
+   IoUring &operator=(const IoUring &) = delete;
+   ~IoUring();
+
+   int registerBuffers(const iovec *iov, uint32_t nr) noexcept;
+   int unregisterBuffers() noexcept;
+   int registerSockets(Socket *const *socks, uint32_t nr);
+   int unregisterSockets() noexcept;
+
+   int send(Socket &sock, const void *buffer, uint32_t size, Callback callback);
+   int recv(Socket &sock, void *buffer, uint32_t size, Callback callback);
+   int sendFixed(Socket &sock, uint16_t bufIndex, const void *buffer, uint32_t size, Callback callback);
+   int recvFixed(Socket &sock, uint16_t bufIndex, void *buffer, uint32_t size, Callback callback);
+   int accept(Socket &listener, Socket &client, Callback callback);
+   int connect(Socket &sock, Callback callback);
+
+   uint32_t pending() const noexcept;
+   uint32_t inflight() const noexcept;
+
+   int submit(uint32_t waitNr = 0) noexcept;
+   int complete(uint32_t waitNr = 0);
+
+private:
+   struct Operation
+   {
+      Callback callback;
+      Socket  *client;
+      uint32_t next;
+   };
+
+   io_uring_sqe *getSqe(Socket &sock, uint8_t opcode, Callback &callback);
+
+   int mRing = -1;
+   io_uring_params mParams = {};
+
+   void    *mSqPtr = nullptr;
+   size_t   mSqSize = 0;
+   void    *mCqPtr = nullptr;
+   size_t   mCqSize = 0;
+   io_uring_sqe *mSqes = nullptr;
+   size_t   mSqesSize = 0;
+
+   unsigned *mSqHead = nullptr;
+   unsigned *mSqTail = nullptr;
+   unsigned *mSqMask = nullptr;
+   unsigned *mSqArray = nullptr;
+   unsigned *mCqHead = nullptr;
+   unsigned *mCqTail = nullptr;
+   unsigned *mCqMask = nullptr;
+   io_uring_cqe *mCqes = nullptr;
+
+   uint32_t mPending = 0;
+   uint32_t mInflight = 0;
+   uint32_t mFreeOp = 0;
+   std::vector<Operation> mOps;
+   std::unordered_map<SOCKET, int> mFixedFiles;
+};
@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : multicastdemux.cpp
+// Contents  : multi group multicast receiver implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "config.h"
+#include "multicastdemux.h"
+
+/**
+ * @brief Construct a new MulticastDemux object.
+ *
+ * IP_PKTINFO is enabled on the socket, it must be open: a std::system_error
+ * is thrown when it cannot be enabled.
+ *
+ * @param sock : An open socket, bound to the any address and the groups port.
+ * @param bufferSize : The receive buffer size of one datagram.
+ * @param batchSize : The number of datagrams received per poll, up to MMSG_BATCH_SIZE.
+ */
+MulticastDemux::MulticastDemux(SocketDGRAM &sock, uint32_t bufferSize /*=2048*/, uint32_t batchSize /*=32*/)
+   : mSock(sock)
+{
+   if (batchSize == 0)
+      batchSize = 1;
+   if (batchSize > MMSG_BATCH_SIZE)
+      batchSize = MMSG_BATCH_SIZE;
+
+   mBuffer.resize(static_cast<size_t>(bufferSize) * batchSize);
+   mMsgs.resize(batchSize);
+   for (uint32_t i = 0; i < batchSize; i++)
+   {
+      memset(&mMsgs[i], 0, sizeof(mMsgs[i]));
+      mMsgs[i].buffer = mBuffer.data() + static_cast<size_t>(i) * bufferSize;
+      mMsgs[i].size = bufferSize;
+   }
+   // Without the destination address every datagram would go to the default handler
+   if (mSock.enablePktInfo(true) == -1)
+      throw std::system_error(errno, std::system_category(), "IP_PKTINFO");
+}
+
+/**
+ * @brief Join a group and register its handler.
+ *
+ * @param GroupAddr : The group address.
+ * @param IfIndex : The interface index, 0 to let the kernel choose and match any interface.
+ * @param handler : Called for each datagram sent to the group.
+ * @return int : zero on success, -1 with errno EADDRINUSE if already subscribed.
+ */
+int MulticastDemux::subscribe(const std::string &GroupAddr, int IfIndex, Handler handler)
+{
+   if (mSock.igmpJoin(GroupAddr, IfIndex) == -1)
+      return -1;
+   if (add(GroupAddr, IfIndex, handler) == -1)
+   {
+      int err = errno;
+      mSock.igmpLeave(GroupAddr, IfIndex);
+      errno = err;
+      return -1;
+   }
+   return 0;
+}
+
+/**
+ * @brief Join a source specific group and register its handler.
+ *
+ * The handlers are keyed by destination, the sources of a group share
+ * the handler of the first subscription.
+ *
+ * @param sourceAddr : The source address.
+ * @param GroupAddr : The group address.
+ * @param IfIndex : The interface index, 0 to let the kernel choose and match any interface.
+ * @param handler : Called for each datagram sent to the group.
+ * @return int : zero on success.
+ */
+int MulticastDemux::subscribe(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex, Handler handler)
+{
+   if (mSock.igmpJoin(sourceAddr, GroupAddr, IfIndex) == -1)
+      return -1;
+   if (add(GroupAddr, IfIndex, handler) == -1)
+   {
+      int err = errno;
+      mSock.igmpLeave(sourceAddr, GroupAddr, IfIndex);
+      errno = err;
+      return -1;
+   }
+   return 0;
+}
+
+/**
+ * @brief Leave a group and remove its handler.
+ *
+ * @param GroupAddr : The group address.
+ * @param IfIndex : The interface index of the subscription.
+ * @return int : zero on success, -1 with errno EADDRNOTAVAIL if not subscribed.
+ */
+int MulticastDemux::unsubscribe(const std::string &GroupAddr, int IfIndex)
+{
+   if (mSock.igmpLeave(GroupAddr, IfIndex) == -1)
+      return -1;
+   return release(GroupAddr, IfIndex);
+}
+
+/**
+ * @brief Leave a source specific group, the handler is removed with the last source.
+ *
+ * @param sourceAddr : The source address.
+ * @param GroupAddr : The group address.
+ * @param IfIndex : The interface index of the subscription.
+ * @return int : zero on success, -1 with errno EADDRNOTAVAIL if not subscribed.
+ */
+int MulticastDemux::unsubscribe(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex)
+{
+   if (mSock.igmpLeave(sourceAddr, GroupAddr, IfIndex) == -1)
+      return -1;
+   return release(GroupAddr, IfIndex);
+}
+
+/**
+ * @brief Set the handler of the datagrams of no subscribed group.
+ *
+ * @param handler : The handler, nullptr to drop these datagrams.
+ */
+void MulticastDemux::setDefaultHandler(Handler handler)
+{
+   mDefault = std::move(handler);
+}
+
+/**
+ * @brief Receive one batch of datagrams and dispatch them.
+ *
+ * @param timeoutMs : The time to wait for the first datagram in milli second(s), -1 to block.
+ * @return int : The number of received datagrams, 0 on timeout, -1 on error.
+ */
+int MulticastDemux::poll(int timeoutMs /*=-1*/)
+{
+   int n = mSock.recvBatch(mMsgs.data(), static_cast<uint32_t>(mMsgs.size()), timeoutMs);
+   for (int i = 0; i < n; i++)
+   {
+      const Handler *registered = find(mMsgs[i]);
+      if (registered != nullptr && *registered)
+      {
+         // Called through a copy : the handler may unsubscribe its own group,
+         // which destroys the registered one
+         Handler handler(*registered);
+         handler(mMsgs[i]);
+      }
+   }
+   return n;
+}
+
+/**
+ * @brief Number of registered handlers.
+ */
+size_t MulticastDemux::size() const noexcept
+{
+   return mHandlers.size();
+}
+
+bool MulticastDemux::Key::operator==(const Key &other) const noexcept
+{
+   return ifIndex == other.ifIndex && memcmp(addr, other.addr, sizeof(addr)) == 0;
+}
+
+size_t MulticastDemux::Hash::operator()(const Key &key) const noexcept
+{
+   // FNV-1a
+   uint64_t h = 14695981039346656037ull;
+   for (auto b : key.addr)
+      h = (h ^ b) * 1099511628211ull;
+   h = (h ^ static_cast<uint32_t>(key.ifIndex)) * 1099511628211ull;
+   return static_cast<size_t>(h);
+}
+
+bool MulticastDemux::makeKey(const socketaddr &addr, int IfIndex, Key &key) noexcept
+{
+   // IPV4 addresses are stored as IPV4 mapped IPV6 addresses
+   memset(&key, 0, sizeof(key));
+   key.ifIndex = IfIndex;
+   if (addr.sa.sa_family == AF_INET)
+   {
+      key.addr[10] = 0xFF;
+      key.addr[11] = 0xFF;
+      memcpy(key.addr + 12, &addr.s4.sin_addr, 4);
+      return true;
+   }
+   if (addr.sa.sa_family == AF_INET6)
+   {
+      memcpy(key.addr, &addr.s6.sin6_addr, 16);
+      return true;
+   }
+   return false;
+}
+
+int MulticastDemux::add(const std::string &GroupAddr, int IfIndex, Handler &handler)
+{
+   Key key;
+   if (!makeKey(SockAddr(GroupAddr), IfIndex, key))
+   {
+      errno = EINVAL;
+      return -1;
+   }
+   auto it = mHandlers.find(key);
+   if (it != mHandlers.end())
+   {
+      it->second.joins++;
+      return 0;
+   }
+   Entry entry = {std::move(handler), 1};
+   mHandlers.emplace(key, std::move(entry));
+   return 0;
+}
+
+int MulticastDemux::release(const std::string &GroupAddr, int IfIndex)
+{
+   Key key;
+   if (!makeKey(SockAddr(GroupAddr), IfIndex, key))
+   {
+      errno = EINVAL;
+      return -1;
+   }
+   auto it = mHandlers.find(key);
+   if (it == mHandlers.end())
+   {
+      errno = EADDRNOTAVAIL;
+      return -1;
+   }
+   if (--it->second.joins == 0)
+      mHandlers.erase(it);
+   return 0;
+}
+
+const MulticastDemux::Handler *MulticastDemux::find(const datagram &msg) const noexcept
+{
+   Key key;
+   if (msg.dst.size != 0 && makeKey(msg.dst, msg.ifIndex, key))
+   {
+      auto it = mHandlers.find(key);
+      if (it == mHandlers.end())
+      {
+         key.ifIndex = 0;
+         it = mHandlers.find(key);
+      }
+      if (it != mHandlers.end())
+         return &it->second.handler;
+   }
+   return &mDefault;
+}
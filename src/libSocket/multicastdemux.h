@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : multicastdemux.h
+// Contents  : multi group multicast receiver interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "socketdgram.h"
+
+/**
+ * @brief Receive many multicast groups on one SocketDGRAM.
+ *
+ * The socket is bound to the any address and the groups port, the groups
+ * are joined on it and IP_PKTINFO gives the destination address of each
+ * datagram. poll() receives a batch with recvBatch and calls the handler
+ * registered for the (group, interface) of each datagram.
+ *
+ * A handler registered with the interface index 0 matches any interface.
+ * The datagrams of no registered group go to the default handler, if any.
+ *
+ * The datagram passed to a handler, and its buffer, are only valid during the call.
+ * Linux only.
+ */
+class LIBSOCKET_EXPORT MulticastDemux
+{
+public:
+   using Handler = std::function<void(const datagram &msg)>;
+
+   explicit MulticastDemux(SocketDGRAM &sock, uint32_t bufferSize = 2048, uint32_t batchSize = 32);
+   MulticastDemux(const MulticastDemux &) = delete;
+   MulticastDemux &operator=(const MulticastDemux &) = delete;
+   ~MulticastDemux() = default;
+
+   int subscribe(const std::string &GroupAddr, int IfIndex, Handler handler);
+   int subscribe(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex, Handler handler);
+   int unsubscribe(const std::string &GroupAddr, int IfIndex);
+   int unsubscribe(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex);
+   void setDefaultHandler(Handler handler);
+
+   int poll(int timeoutMs = -1);
+   size_t size() const noexcept;
+
+private:
+   struct Key
+   {
+      uint8_t addr[16];
+      int ifIndex;
+      bool operator==(const Key &other) const noexcept;
+   };
+
+   struct Hash
+   {
+      size_t operator()(const Key &key) const noexcept;
+   };
+
+   struct Entry
+   {
+      Handler handler;
+      uint32_t joins;   ///< The (source, group) joins sharing the destination.
+   };
+
+   static bool makeKey(const socketaddr &addr, int IfIndex, Key &key) noexcept;
+   int add(const std::string &GroupAddr, int IfIndex, Handler &handler);
+   int release(const std::string &GroupAddr, int IfIndex);
+   const Handler *find(const datagram &msg) const noexcept;
+
+   SocketDGRAM &mSock;
+   std::vector<uint8_t> mBuffer;
+   std::vector<datagram> mMsgs;
+   std::unordered_map<Key, Entry, Hash> mHandlers;
+   Handler mDefault;
+};
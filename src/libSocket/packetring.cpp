@@ -0,0 +1,452 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : packetring.cpp
+// Contents  : AF_PACKET memory mapped receive and transmit rings implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <system_error>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "poll.h"
+#include "packetring.h"
+
+/**
+ * @brief Construct a new PacketRing object: open, map and bind the socket.
+ *
+ * The blockSize must be a multiple of the page size, it is the unit handed
+ * to user space. A small retire timeout gives a low latency at a low rate.
+ *
+ * @param ifIndex : The interface index, 0 for all the interfaces.
+ * @param protocol : The ethernet protocol to capture, ETH_P_ALL for all, host order.
+ * @param blockSize : The size of a block.
+ * @param blockCount : The number of blocks of the ring.
+ * @param retireTimeoutMs : The time after which a block not full is handed to user space.
+ */
+PacketRing::PacketRing(int ifIndex /*=0*/, uint16_t protocol /*=ETH_P_ALL*/, uint32_t blockSize /*=1 << 20*/,
+                       uint32_t blockCount /*=64*/, uint32_t retireTimeoutMs /*=10*/)
+   : mSock(AF_PACKET, SOCK_RAW, htons(protocol)), mBlockSize(blockSize), mBlockCount(blockCount)
+{
+   if (mSock.open() == INVALID_SOCKET)
+      throw std::system_error(errno, std::system_category(), "socket AF_PACKET");
+
+   int version = TPACKET_V3;
+   if (mSock.setOption(SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1)
+      throw std::system_error(errno, std::system_category(), "PACKET_VERSION");
+
+   tpacket_req3 req = {};
+   req.tp_block_size = blockSize;
+   req.tp_block_nr = blockCount;
+   req.tp_frame_size = 2048;   // TPACKET_V3 frames have a variable size, only used by the ring size checks
+   req.tp_frame_nr = static_cast<unsigned int>((static_cast<uint64_t>(blockSize) * blockCount) / req.tp_frame_size);
+   req.tp_retire_blk_tov = retireTimeoutMs;
+   req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+   if (mSock.setOption(SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1)
+      throw std::system_error(errno, std::system_category(), "PACKET_RX_RING");
+
+   mRingSize = static_cast<size_t>(blockSize) * blockCount;
+   void *ring = mmap(nullptr, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, mSock.getHandle(), 0);
+   if (ring == MAP_FAILED)
+      ring = mmap(nullptr, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, mSock.getHandle(), 0);
+   if (ring == MAP_FAILED)
+      throw std::system_error(errno, std::system_category(), "mmap PACKET_RX_RING");
+   mRing = static_cast<uint8_t *>(ring);
+
+   sockaddr_ll sll = {};
+   sll.sll_family = AF_PACKET;
+   sll.sll_protocol = htons(protocol);
+   sll.sll_ifindex = ifIndex;
+   if (mSock.setAddr(sll) == -1 || mSock.bind() == -1)
+   {
+      int err = errno;
+      munmap(mRing, mRingSize);
+      mRing = nullptr;
+      throw std::system_error(err, std::system_category(), "bind AF_PACKET");
+   }
+}
+
+PacketRing::~PacketRing()
+{
+   if (mRing != nullptr)
+      munmap(mRing, mRingSize);
+   mSock.close();
+}
+
+/**
+ * @brief Wait for the next block and pass its frames to the handler.
+ *
+ * The block is given back to the kernel when the handler returns
+ * for the last frame, the frame views must not be kept.
+ *
+ * @param handler : Called for each frame of the block.
+ * @param timeoutMs : The time to wait in milli second(s), -1 to block.
+ * @return int : The number of frames, 0 on timeout, -1 on error.
+ */
+int PacketRing::poll(const Handler &handler, int timeoutMs /*=-1*/)
+{
+   // Finish the block partially read by next(), or give back the one it read up to the end
+   if (mFramesLeft == 0)
+   {
+      if (mFrame != nullptr)
+         releaseBlock();
+      int rc = waitBlock(timeoutMs);
+      if (rc <= 0)
+         return rc;
+   }
+
+   int n = 0;
+   Frame f;
+   while (mFramesLeft > 0)
+   {
+      frame(mFrame, f);
+      mFrame = reinterpret_cast<const tpacket3_hdr *>(reinterpret_cast<const uint8_t *>(mFrame) + mFrame->tp_next_offset);
+      mFramesLeft--;
+      handler(f);
+      n++;
+   }
+   releaseBlock();
+   return n;
+}
+
+/**
+ * @brief Get the next frame, one block after the other.
+ *
+ * The frame view is valid until the next call, its block is given back to
+ * the kernel when the next frame is in another block.
+ *
+ * @param frame : The frame view.
+ * @param timeoutMs : The time to wait in milli second(s), -1 to block.
+ * @return int : 1 for a frame, 0 on timeout, -1 on error.
+ */
+int PacketRing::next(Frame &frame, int timeoutMs /*=-1*/)
+{
+   if (mFramesLeft == 0)
+   {
+      if (mFrame != nullptr)
+         releaseBlock();
+      int rc = waitBlock(timeoutMs);
+      if (rc <= 0)
+         return rc;
+   }
+
+   this->frame(mFrame, frame);
+   mFrame = reinterpret_cast<const tpacket3_hdr *>(reinterpret_cast<const uint8_t *>(mFrame) + mFrame->tp_next_offset);
+   mFramesLeft--;
+   return 1;
+}
+
+/**
+ * @brief Read the PACKET_STATISTICS counters.
+ *
+ * The kernel resets its counters on each read, they are accumulated here.
+ *
+ * @return Stats : The counters since the ring creation.
+ */
+PacketRing::Stats PacketRing::stats() noexcept
+{
+   tpacket_stats_v3 st = {};
+   int len = sizeof(st);
+   if (mSock.getOption(SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+   {
+      mStats.packets += st.tp_packets;
+      mStats.drops += st.tp_drops;
+      mStats.freezes += st.tp_freeze_q_cnt;
+   }
+   return mStats;
+}
+
+/**
+ * @brief Join a PACKET_FANOUT group, the frames are spread over its sockets.
+ *
+ * All the sockets of a group must be bound to the same interface and
+ * protocol, and join with the same mode and flags. See FanoutGroup.
+ *
+ * @param groupId : The group id, unique per network namespace.
+ * @param mode : PACKET_FANOUT_HASH, PACKET_FANOUT_LB, PACKET_FANOUT_CPU...
+ * @param flags : PACKET_FANOUT_FLAG_DEFRAG, PACKET_FANOUT_FLAG_ROLLOVER...
+ * @return int : zero on success.
+ */
+int PacketRing::joinFanout(uint16_t groupId, uint16_t mode, uint16_t flags /*=0*/) noexcept
+{
+   uint32_t arg = (static_cast<uint32_t>(mode | flags) << 16) | groupId;
+   return mSock.setOption(SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg));
+}
+
+/**
+ * @brief The underlying AF_PACKET socket.
+ */
+SocketDGRAM &PacketRing::socket() noexcept
+{
+   return mSock;
+}
+
+/**
+ * @brief The block size.
+ */
+uint32_t PacketRing::blockSize() const noexcept
+{
+   return mBlockSize;
+}
+
+/**
+ * @brief The number of blocks.
+ */
+uint32_t PacketRing::blockCount() const noexcept
+{
+   return mBlockCount;
+}
+
+tpacket_block_desc *PacketRing::block(uint32_t index) const noexcept
+{
+   return reinterpret_cast<tpacket_block_desc *>(mRing + static_cast<size_t>(index) * mBlockSize);
+}
+
+int PacketRing::waitBlock(int timeoutMs) noexcept
+{
+   while (true)
+   {
+      auto desc = block(mBlock);
+      if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+      {
+         pollfd pfd;
+         pfd.fd = mSock.getHandle();
+         pfd.events = POLLIN | POLLERR;
+         pfd.revents = 0;
+         int rc = ::poll(&pfd, 1, timeoutMs);
+         if (rc <= 0)
+            return rc;
+         if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+         {
+            if (timeoutMs >= 0)
+               return 0;
+            continue;
+         }
+      }
+
+      mFramesLeft = desc->hdr.bh1.num_pkts;
+      mFrame = reinterpret_cast<const tpacket3_hdr *>(reinterpret_cast<uint8_t *>(desc) + desc->hdr.bh1.offset_to_first_pkt);
+      if (mFramesLeft > 0)
+         return static_cast<int>(mFramesLeft);
+      releaseBlock();
+   }
+}
+
+void PacketRing::releaseBlock() noexcept
+{
+   __atomic_store_n(&block(mBlock)->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+   mBlock = (mBlock + 1) % mBlockCount;
+   mFrame = nullptr;
+   mFramesLeft = 0;
+}
+
+void PacketRing::frame(const tpacket3_hdr *hdr, Frame &frame) const noexcept
+{
+   auto base = reinterpret_cast<const uint8_t *>(hdr);
+   auto sll = reinterpret_cast<const sockaddr_ll *>(base + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+   frame.data = base + hdr->tp_mac;
+   frame.length = hdr->tp_snaplen;
+   frame.wireLength = hdr->tp_len;
+   frame.stamp.tv_sec = hdr->tp_sec;
+   frame.stamp.tv_nsec = hdr->tp_nsec;
+   frame.ifIndex = sll->sll_ifindex;
+   frame.protocol = ntohs(sll->sll_protocol);
+   frame.pktType = sll->sll_pkttype;
+   frame.vlanTci = (hdr->tp_status & TP_STATUS_VLAN_VALID) ? hdr->hv1.tp_vlan_tci : 0;
+   frame.status = hdr->tp_status;
+}
+
+/**
+ * @brief Construct a new PacketTxRing object: open, map and bind the socket.
+ *
+ * @param ifIndex : The interface index.
+ * @param frameSize : The slot size, rounded up to a power of 2, the frames are capacity() bytes max.
+ * @param frameCount : The number of slots.
+ * @param protocol : The ethernet protocol of the socket, host order.
+ * @param qdiscBypass : Send directly to the driver, without the traffic control layer (PACKET_QDISC_BYPASS).
+ */
+PacketTxRing::PacketTxRing(int ifIndex, uint32_t frameSize /*=2048*/, uint32_t frameCount /*=1024*/,
+                           uint16_t protocol /*=ETH_P_ALL*/, bool qdiscBypass /*=false*/)
+   : mSock(AF_PACKET, SOCK_RAW, htons(protocol)), mFrameSize(frameSize), mFrameCount(frameCount)
+{
+   if (mSock.open() == INVALID_SOCKET)
+      throw std::system_error(errno, std::system_category(), "socket AF_PACKET");
+
+   int value = TPACKET_V2;
+   if (mSock.setOption(SOL_PACKET, PACKET_VERSION, &value, sizeof(value)) == -1)
+      throw std::system_error(errno, std::system_category(), "PACKET_VERSION");
+
+   value = 1;
+   if (mSock.setOption(SOL_PACKET, PACKET_LOSS, &value, sizeof(value)) == -1)
+      throw std::system_error(errno, std::system_category(), "PACKET_LOSS");
+
+   if (qdiscBypass && mSock.setOption(SOL_PACKET, PACKET_QDISC_BYPASS, &value, sizeof(value)) == -1)
+      throw std::system_error(errno, std::system_category(), "PACKET_QDISC_BYPASS");
+
+   // Power of 2 frames and blocks : no slot straddles two blocks, the slot i is at i * frameSize
+   uint32_t size = TPACKET_ALIGNMENT;
+   while (size < frameSize)
+      size <<= 1;
+   mFrameSize = frameSize = size;
+
+   uint32_t blockSize = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+   while (blockSize < frameSize)
+      blockSize <<= 1;
+
+   tpacket_req req = {};
+   req.tp_block_size = blockSize;
+   req.tp_frame_size = frameSize;
+   req.tp_frame_nr = frameCount;
+   req.tp_block_nr = static_cast<unsigned int>((static_cast<uint64_t>(frameSize) * frameCount + blockSize - 1) / blockSize);
+   mFrameCount = req.tp_frame_nr = req.tp_block_nr * (blockSize / frameSize);
+   if (mSock.setOption(SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) == -1)
+      throw std::system_error(errno, std::system_category(), "PACKET_TX_RING");
+
+   mRingSize = static_cast<size_t>(blockSize) * req.tp_block_nr;
+   void *ring = mmap(nullptr, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, mSock.getHandle(), 0);
+   if (ring == MAP_FAILED)
+      throw std::system_error(errno, std::system_category(), "mmap PACKET_TX_RING");
+   mRing = static_cast<uint8_t *>(ring);
+
+   sockaddr_ll sll = {};
+   sll.sll_family = AF_PACKET;
+   sll.sll_protocol = htons(protocol);
+   sll.sll_ifindex = ifIndex;
+   if (mSock.setAddr(sll) == -1 || mSock.bind() == -1)
+   {
+      int err = errno;
+      munmap(mRing, mRingSize);
+      mRing = nullptr;
+      throw std::system_error(err, std::system_category(), "bind AF_PACKET");
+   }
+}
+
+PacketTxRing::~PacketTxRing()
+{
+   if (mRing != nullptr)
+      munmap(mRing, mRingSize);
+   mSock.close();
+}
+
+/**
+ * @brief Get the next free slot.
+ *
+ * The frame, from its link layer header, is written at the returned address,
+ * then commit() marks it ready. Calling acquire again before commit returns
+ * the same slot.
+ *
+ * @return uint8_t* : The slot, capacity() bytes, nullptr if the ring is full.
+ */
+uint8_t *PacketTxRing::acquire() noexcept
+{
+   auto hdr = slot(mHead);
+   if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE)
+      return nullptr;
+   return reinterpret_cast<uint8_t *>(hdr) + TPACKET_ALIGN(sizeof(tpacket2_hdr));
+}
+
+/**
+ * @brief Mark the acquired slot ready to send.
+ *
+ * @param length : The frame length.
+ * @return int : zero on success, -1 with errno ENOBUFS if no slot is acquired, EMSGSIZE if the frame is too long.
+ */
+int PacketTxRing::commit(uint32_t length) noexcept
+{
+   if (length > capacity())
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+   auto hdr = slot(mHead);
+   if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE)
+   {
+      errno = ENOBUFS;
+      return -1;
+   }
+   hdr->tp_len = length;
+   __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+   mHead = (mHead + 1) % mFrameCount;
+   mPending++;
+   return 0;
+}
+
+/**
+ * @brief Send the committed frames.
+ *
+ * @param block : Wait until the kernel has sent them all.
+ * @return int : The number of bytes handed to the driver, -1 on error.
+ */
+int PacketTxRing::flush(bool block /*=false*/) noexcept
+{
+   int rc = static_cast<int>(sendto(mSock.getHandle(), nullptr, 0, block ? 0 : MSG_DONTWAIT, nullptr, 0));
+   if (rc >= 0 || errno == EAGAIN)
+      mPending = 0;
+   return rc;
+}
+
+/**
+ * @brief Wait for the next slot to be free.
+ *
+ * @param timeoutMs : The time to wait in milli second(s), -1 to block.
+ * @return int : 1 if a slot is free, 0 on timeout, -1 on error.
+ */
+int PacketTxRing::wait(int timeoutMs /*=-1*/) noexcept
+{
+   if (acquire() != nullptr)
+      return 1;
+   pollfd pfd;
+   pfd.fd = mSock.getHandle();
+   pfd.events = POLLOUT;
+   pfd.revents = 0;
+   int rc = ::poll(&pfd, 1, timeoutMs);
+   if (rc <= 0)
+      return rc;
+   return acquire() != nullptr ? 1 : 0;
+}
+
+/**
+ * @brief Number of free slots, from the next one.
+ */
+uint32_t PacketTxRing::available() const noexcept
+{
+   uint32_t n = 0;
+   while (n < mFrameCount && __atomic_load_n(&slot((mHead + n) % mFrameCount)->tp_status, __ATOMIC_ACQUIRE) == TP_STATUS_AVAILABLE)
+      n++;
+   return n;
+}
+
+/**
+ * @brief Number of committed frames not flushed yet.
+ */
+uint32_t PacketTxRing::pending() const noexcept
+{
+   return mPending;
+}
+
+/**
+ * @brief The maximum frame length.
+ */
+uint32_t PacketTxRing::capacity() const noexcept
+{
+   return mFrameSize - static_cast<uint32_t>(TPACKET_ALIGN(sizeof(tpacket2_hdr)));
+}
+
+/**
+ * @brief The underlying AF_PACKET socket.
+ */
+SocketDGRAM &PacketTxRing::socket() noexcept
+{
+   return mSock;
+}
+
+tpacket2_hdr *PacketTxRing::slot(uint32_t index) const noexcept
+{
+   return reinterpret_cast<tpacket2_hdr *>(mRing + static_cast<size_t>(index) * mFrameSize);
+}
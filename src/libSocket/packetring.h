@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : packetring.h
+// Contents  : AF_PACKET memory mapped receive and transmit rings interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <ctime>
+#include <functional>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "socketdgram.h"
+
+/**
+ * @brief Capture the frames of an interface through a TPACKET_V3 mmap ring.
+ *
+ * The kernel fills blocks of frames in a ring shared with the process, a
+ * block is handed to user space when it is full or when its retire timeout
+ * expires. poll() waits for the next block, calls the handler for each
+ * frame of the block, then gives the block back to the kernel.
+ * There is no copy and no syscall per frame.
+ *
+ * The socket needs the CAP_NET_RAW capability.
+ */
+class LIBSOCKET_EXPORT PacketRing
+{
+public:
+   /// A frame view, valid until its block is released.
+   struct Frame
+   {
+      const uint8_t *data;      ///< The frame, from the link layer header.
+      uint32_t length;          ///< The captured length.
+      uint32_t wireLength;      ///< The frame length on the wire.
+      timespec stamp;           ///< The kernel receive timestamp.
+      int      ifIndex;         ///< The interface index.
+      uint16_t protocol;        ///< The ethernet protocol, host order.
+      uint8_t  pktType;         ///< PACKET_HOST, PACKET_BROADCAST, PACKET_OUTGOING...
+      uint16_t vlanTci;         ///< The VLAN tag control information, if TP_STATUS_VLAN_VALID.
+      uint32_t status;          ///< The tp_status flags, TP_STATUS_VLAN_VALID, TP_STATUS_LOSING...
+   };
+
+   /// The PACKET_STATISTICS counters, accumulated since open.
+   struct Stats
+   {
+      uint64_t packets = 0;   ///< Frames seen by the socket, including the dropped ones.
+      uint64_t drops = 0;     ///< Frames dropped because the ring was full.
+      uint64_t freezes = 0;   ///< Times the ring was frozen, all its blocks in user space.
+   };
+
+   using Handler = std::function<void(const Frame &frame)>;
+
+   explicit PacketRing(int ifIndex = 0, uint16_t protocol = ETH_P_ALL, uint32_t blockSize = 1 << 20,
+                       uint32_t blockCount = 64, uint32_t retireTimeoutMs = 10);
+   PacketRing(const PacketRing &) = delete;
+   PacketRing &operator=(const PacketRing &) = delete;
+   ~PacketRing();
+
+   int poll(const Handler &handler, int timeoutMs = -1);
+   int next(Frame &frame, int timeoutMs = -1);
+   Stats stats() noexcept;
+   int joinFanout(uint16_t groupId, uint16_t mode, uint16_t flags = 0) noexcept;
+
+   SocketDGRAM &socket() noexcept;
+   uint32_t blockSize() const noexcept;
+   uint32_t blockCount() const noexcept;
+
+private:
+   tpacket_block_desc *block(uint32_t index) const noexcept;
+   int waitBlock(int timeoutMs) noexcept;
+   void releaseBlock() noexcept;
+   void frame(const tpacket3_hdr *hdr, Frame &frame) const noexcept;
+
+   SocketDGRAM mSock;
+   uint8_t *mRing = nullptr;
+   size_t mRingSize = 0;
+   uint32_t mBlockSize;
+   uint32_t mBlockCount;
+
+   uint32_t mBlock = 0;                        ///< The current block.
+   const tpacket3_hdr *mFrame = nullptr;       ///< The next frame of the current block, see next().
+   uint32_t mFramesLeft = 0;
+   Stats mStats;
+};
+
+/**
+ * @brief Send raw frames through a TPACKET_V2 mmap transmit ring.
+ *
+ * The frames are written in place in the ring shared with the kernel:
+ * acquire() returns the next free slot, commit() marks it ready, and one
+ * flush() syscall sends all the committed frames. A slot is free again
+ * once the kernel has sent its frame, see available() and wait().
+ *
+ * Malformed frames are skipped (PACKET_LOSS). The socket needs the
+ * CAP_NET_RAW capability.
+ */
+class LIBSOCKET_EXPORT PacketTxRing
+{
+public:
+   explicit PacketTxRing(int ifIndex, uint32_t frameSize = 2048, uint32_t frameCount = 1024,
+                         uint16_t protocol = ETH_P_ALL, bool qdiscBypass = false);
+   PacketTxRing(const PacketTxRing &) = delete;
+   PacketTxRing &operator=(const PacketTxRing &) = delete;
+   ~PacketTxRing();
+
+   uint8_t *acquire() noexcept;
+   int commit(uint32_t length) noexcept;
+   int flush(bool block = false) noexcept;
+   int wait(int timeoutMs = -1) noexcept;
+
+   uint32_t available() const noexcept;
+   uint32_t pending() const noexcept;
+   uint32_t capacity() const noexcept;
+   SocketDGRAM &socket() noexcept;
+
+private:
+   tpacket2_hdr *slot(uint32_t index) const noexcept;
+
+   SocketDGRAM mSock;
+   uint8_t *mRing = nullptr;
+   size_t mRingSize = 0;
+   uint32_t mFrameSize;
+   uint32_t mFrameCount;
+   uint32_t mHead = 0;      ///< The next slot to fill.
+   uint32_t mPending = 0;   ///< The committed slots not flushed yet.
+};
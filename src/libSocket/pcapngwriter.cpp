@@ -0,0 +1,504 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : pcapngwriter.cpp
+// Contents  : memory mapped pcapng capture writer implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include "pcapngwriter.h"
+
+namespace
+{
+   const uint32_t SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+   const uint32_t INTERFACE_BLOCK = 1;
+   const uint32_t ENHANCED_PACKET_BLOCK = 6;
+   const uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+   const uint16_t OPT_ENDOFOPT = 0;
+   const uint16_t OPT_IF_NAME = 2;
+   const uint16_t OPT_IF_TSRESOL = 9;
+   const uint32_t EPB_SIZE = 32;   ///< The enhanced packet block without its data.
+
+   uint32_t pad4(uint32_t length) noexcept
+   {
+      return (length + 3) & ~3u;
+   }
+
+   template <typename T>
+   void put(std::vector<uint8_t> &block, T value)
+   {
+      auto p = reinterpret_cast<const uint8_t *>(&value);
+      block.insert(block.end(), p, p + sizeof(value));
+   }
+
+   void putOption(std::vector<uint8_t> &block, uint16_t code, const void *value, uint16_t length)
+   {
+      put(block, code);
+      put(block, length);
+      auto p = static_cast<const uint8_t *>(value);
+      block.insert(block.end(), p, p + length);
+      block.resize(block.size() + pad4(length) - length, 0);
+   }
+
+   // The IPv4 address of an AF_INET or v4-mapped AF_INET6 socketaddr
+   bool ipv4(const socketaddr &sa, in_addr &addr) noexcept
+   {
+      if (sa.size != 0 && sa.sa.sa_family == AF_INET)
+      {
+         addr = sa.s4.sin_addr;
+         return true;
+      }
+      if (sa.size != 0 && sa.sa.sa_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&sa.s6.sin6_addr))
+      {
+         memcpy(&addr, &sa.s6.sin6_addr.s6_addr[12], sizeof(addr));
+         return true;
+      }
+      return false;
+   }
+
+   uint16_t checksum(const void *data, size_t length) noexcept
+   {
+      auto p = static_cast<const uint8_t *>(data);
+      uint32_t sum = 0;
+      for (size_t i = 0; i + 1 < length; i += 2)
+         sum += (uint32_t(p[i]) << 8) | p[i + 1];
+      while (sum >> 16)
+         sum = (sum & 0xFFFF) + (sum >> 16);
+      return htons(static_cast<uint16_t>(~sum));
+   }
+}
+
+/**
+ * @brief Construct a new PcapngWriter object: create the first file and start the flusher thread.
+ *
+ * @param prefix : The files path prefix.
+ * @param segmentSize : The size of a file, a packet must fit in one file.
+ * @param maxFiles : The number of files kept, 0 to keep them all.
+ * @param flushIntervalMs : The interval of the background write back, in milli second(s).
+ */
+PcapngWriter::PcapngWriter(const std::string &prefix, uint32_t segmentSize /*=64 << 20*/, uint32_t maxFiles /*=0*/,
+                           uint32_t flushIntervalMs /*=100*/)
+   : mPrefix(prefix), mSegmentSize(segmentSize), mMaxFiles(maxFiles), mFlushIntervalMs(flushIntervalMs),
+     mUsed(0), mEnabled(true)
+{
+   put(mHeader, SECTION_HEADER_BLOCK);
+   put(mHeader, uint32_t(28));
+   put(mHeader, BYTE_ORDER_MAGIC);
+   put(mHeader, uint16_t(1));
+   put(mHeader, uint16_t(0));
+   put(mHeader, uint64_t(0xFFFFFFFFFFFFFFFFull));   // section length not specified
+   put(mHeader, uint32_t(28));
+
+   if (openSegment(mNextIndex++, mCurrent) == -1)
+      throw std::system_error(errno, std::system_category(), "PcapngWriter " + fileName(0));
+   append(mHeader.data(), mHeader.size());
+
+   mFlusher = std::thread(&PcapngWriter::flusher, this);
+}
+
+PcapngWriter::~PcapngWriter()
+{
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mRunning = false;
+   }
+   mCond.notify_all();
+   mFlusher.join();
+
+   for (auto &seg : mRetired)
+      closeSegment(seg);
+   closeSegment(mCurrent);
+   closeSegment(mSpare);
+}
+
+/**
+ * @brief Declare an interface, the packets refer to it by its id.
+ *
+ * @param linkType : ETHERNET for the PacketRing frames, RAW for the datagrams.
+ * @param name : The interface name, informative.
+ * @param snapLength : The maximum number of bytes written per packet.
+ * @return int : The interface id, -1 on error.
+ */
+int PcapngWriter::addInterface(LinkType linkType, const std::string &name /*=std::string()*/, uint32_t snapLength /*=65535*/)
+{
+   std::vector<uint8_t> block;
+   put(block, INTERFACE_BLOCK);
+   put(block, uint32_t(0));   // total length, set below
+   put(block, static_cast<uint16_t>(linkType));
+   put(block, uint16_t(0));
+   put(block, snapLength);
+   if (!name.empty())
+      putOption(block, OPT_IF_NAME, name.data(), static_cast<uint16_t>(name.size()));
+   uint8_t tsresol = 9;   // nano seconds
+   putOption(block, OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+   putOption(block, OPT_ENDOFOPT, nullptr, 0);
+   put(block, uint32_t(0));
+   uint32_t length = static_cast<uint32_t>(block.size());
+   memcpy(&block[4], &length, sizeof(length));
+   memcpy(&block[length - 4], &length, sizeof(length));
+
+   if (mHeader.size() + length + EPB_SIZE > mSegmentSize)
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+
+   // Each file starts with all the interfaces, the current one gets the new one appended
+   mHeader.insert(mHeader.end(), block.begin(), block.end());
+   mInterfaces.push_back({static_cast<uint16_t>(linkType), snapLength});
+   if (mCurrent.used + length > mSegmentSize)
+   {
+      if (rotate() == -1)
+         return -1;
+   }
+   else
+      append(block.data(), block.size());
+   mUsed.store(mCurrent.used, std::memory_order_release);
+   return static_cast<int>(mInterfaces.size() - 1);
+}
+
+/**
+ * @brief Write a packet.
+ *
+ * @param interfaceId : The interface id, see addInterface.
+ * @param data : The packet, from the header of the interface link type.
+ * @param length : The captured length, truncated to the interface snap length.
+ * @param wireLength : The original length.
+ * @param stamp : The receive timestamp, zero for the current time.
+ * @return int : zero on success, -1 with errno EINVAL for an unknown interface, EMSGSIZE if the packet can't fit in a file.
+ */
+int PcapngWriter::write(uint32_t interfaceId, const void *data, uint32_t length, uint32_t wireLength, const timespec &stamp) noexcept
+{
+   return writeBlock(interfaceId, nullptr, 0, data, length, wireLength, stamp);
+}
+
+/**
+ * @brief Write a PacketRing frame, on an ETHERNET interface.
+ */
+int PcapngWriter::write(const PacketRing::Frame &frame, uint32_t interfaceId /*=0*/) noexcept
+{
+   return writeBlock(interfaceId, nullptr, 0, frame.data, frame.length, frame.wireLength, frame.stamp);
+}
+
+/**
+ * @brief Write a received UDP datagram, on a RAW interface.
+ *
+ * The IP and UDP headers are synthesized from the datagram peer and
+ * destination, see SocketDGRAM::enablePktInfo, or from the local socket
+ * address when the destination is unknown.
+ *
+ * @param dg : The datagram.
+ * @param local : The receiving socket address, see getSocketaddr.
+ * @param interfaceId : The interface id.
+ * @return int : zero on success, -1 with errno EAFNOSUPPORT if the peer is not an IP address.
+ */
+int PcapngWriter::write(const datagram &dg, const socketaddr &local, uint32_t interfaceId /*=0*/) noexcept
+{
+   if (!mEnabled.load(std::memory_order_relaxed))
+      return 0;
+
+   union
+   {
+      uint8_t bytes[sizeof(ip6_hdr) + sizeof(udphdr)];
+      iphdr ip4;
+      ip6_hdr ip6;
+   } head;
+   memset(&head, 0, sizeof(head));
+   uint32_t udpLength = static_cast<uint32_t>(sizeof(udphdr)) + dg.length;
+   uint32_t headLength;
+
+   // sin_port and sin6_port are at the same offset
+   const socketaddr &dst = dg.dst.size != 0 ? dg.dst : local;
+   udphdr *udp;
+   in_addr src4;
+   if (ipv4(dg.peer, src4))
+   {
+      in_addr dst4 = {};
+      if (!ipv4(dst, dst4))
+         ipv4(local, dst4);
+      head.ip4.version = 4;
+      head.ip4.ihl = sizeof(iphdr) / 4;
+      head.ip4.tot_len = htons(static_cast<uint16_t>(sizeof(iphdr) + udpLength));
+      head.ip4.frag_off = htons(IP_DF);
+      head.ip4.ttl = 64;
+      head.ip4.protocol = IPPROTO_UDP;
+      head.ip4.saddr = src4.s_addr;
+      head.ip4.daddr = dst4.s_addr;
+      head.ip4.check = checksum(&head.ip4, sizeof(iphdr));
+      udp = reinterpret_cast<udphdr *>(head.bytes + sizeof(iphdr));
+      headLength = sizeof(iphdr) + sizeof(udphdr);
+   }
+   else if (dg.peer.sa.sa_family == AF_INET6)
+   {
+      head.ip6.ip6_flow = htonl(6u << 28);
+      head.ip6.ip6_plen = htons(static_cast<uint16_t>(udpLength));
+      head.ip6.ip6_nxt = IPPROTO_UDP;
+      head.ip6.ip6_hlim = 64;
+      head.ip6.ip6_src = dg.peer.s6.sin6_addr;
+      if (dst.sa.sa_family == AF_INET6)
+         head.ip6.ip6_dst = dst.s6.sin6_addr;
+      else if (local.sa.sa_family == AF_INET6)
+         head.ip6.ip6_dst = local.s6.sin6_addr;
+      udp = reinterpret_cast<udphdr *>(head.bytes + sizeof(ip6_hdr));
+      headLength = sizeof(ip6_hdr) + sizeof(udphdr);
+   }
+   else
+   {
+      errno = EAFNOSUPPORT;
+      return -1;
+   }
+
+   udp->source = dg.peer.s4.sin_port;
+   udp->dest = local.s4.sin_port;
+   udp->len = htons(static_cast<uint16_t>(udpLength));
+   return writeBlock(interfaceId, head.bytes, headLength, dg.buffer, dg.length, headLength + dg.length, dg.stamp);
+}
+
+/**
+ * @brief Switch the capture on or off, the write methods do nothing when it is off.
+ */
+void PcapngWriter::enable(bool on /*=true*/) noexcept
+{
+   mEnabled.store(on, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The capture is on.
+ */
+bool PcapngWriter::isEnabled() const noexcept
+{
+   return mEnabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Start the write back of the current file now, without waiting for it.
+ */
+void PcapngWriter::flush() noexcept
+{
+   sync_file_range(mCurrent.fd, 0, static_cast<off64_t>(mCurrent.used), SYNC_FILE_RANGE_WRITE);
+}
+
+/**
+ * @brief Number of packets written.
+ */
+uint64_t PcapngWriter::packets() const noexcept
+{
+   return mPackets;
+}
+
+/**
+ * @brief The index of the file being written.
+ */
+uint32_t PcapngWriter::fileIndex() const noexcept
+{
+   return mCurrent.index;
+}
+
+/**
+ * @brief The path of a file, prefix-NNNNN.pcapng.
+ */
+std::string PcapngWriter::fileName(uint32_t index) const
+{
+   char suffix[32];
+   snprintf(suffix, sizeof(suffix), "-%05u.pcapng", index);
+   return mPrefix + suffix;
+}
+
+int PcapngWriter::openSegment(uint32_t index, Segment &seg) noexcept
+{
+   std::string path = fileName(index);
+   int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd == -1)
+      return -1;
+
+   // Reserve the blocks : a full disk fails here, not with a SIGBUS on a memcpy
+   int rc = posix_fallocate(fd, 0, static_cast<off_t>(mSegmentSize));
+   if (rc == EOPNOTSUPP || rc == EINVAL)
+      rc = (ftruncate(fd, static_cast<off_t>(mSegmentSize)) == 0) ? 0 : errno;
+
+   void *map = MAP_FAILED;
+   if (rc == 0)
+   {
+      map = mmap(nullptr, mSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+      if (map == MAP_FAILED)
+         rc = errno;
+   }
+   if (rc != 0)
+   {
+      ::close(fd);
+      unlink(path.c_str());
+      errno = rc;
+      return -1;
+   }
+
+   seg.fd = fd;
+   seg.map = static_cast<uint8_t *>(map);
+   seg.used = 0;
+   seg.index = index;
+   return 0;
+}
+
+void PcapngWriter::closeSegment(Segment &seg) noexcept
+{
+   if (seg.fd == -1)
+      return;
+
+   munmap(seg.map, mSegmentSize);
+   if (seg.used == 0)
+      unlink(fileName(seg.index).c_str());
+   // On failure the file keeps its zeroed tail, a reader stops on the zero block type
+   else if (ftruncate(seg.fd, static_cast<off_t>(seg.used)) == 0)
+      sync_file_range(seg.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+   ::close(seg.fd);
+   seg = Segment();
+}
+
+int PcapngWriter::rotate() noexcept
+{
+   {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCond.wait(lock, [this] { return !mPreparing; });
+
+      Segment next;
+      if (mSpare.fd != -1)
+      {
+         next = mSpare;
+         mSpare = Segment();
+      }
+      else if (openSegment(mNextIndex, next) == -1)
+         return -1;
+      else
+         mNextIndex++;
+
+      mRetired.push_back(mCurrent);
+      mCurrent = next;
+      mUsed.store(0, std::memory_order_release);
+   }
+   mCond.notify_all();
+
+   append(mHeader.data(), mHeader.size());
+   return 0;
+}
+
+int PcapngWriter::writeBlock(uint32_t interfaceId, const void *head, uint32_t headLength, const void *data, uint32_t length,
+                             uint32_t wireLength, const timespec &stamp) noexcept
+{
+   if (!mEnabled.load(std::memory_order_relaxed))
+      return 0;
+   if (interfaceId >= mInterfaces.size())
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   uint32_t captured = headLength + length;
+   if (captured > mInterfaces[interfaceId].snapLength)
+      captured = mInterfaces[interfaceId].snapLength;
+   uint32_t blockLength = EPB_SIZE + pad4(captured);
+   if (mHeader.size() + blockLength > mSegmentSize)
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+   if (mCurrent.used + blockLength > mSegmentSize && rotate() == -1)
+      return -1;
+
+   timespec ts = stamp;
+   if (ts.tv_sec == 0 && ts.tv_nsec == 0)
+      clock_gettime(CLOCK_REALTIME, &ts);
+   uint64_t ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+
+   uint32_t epb[7] = {ENHANCED_PACKET_BLOCK, blockLength, interfaceId, static_cast<uint32_t>(ns >> 32),
+                      static_cast<uint32_t>(ns), captured, wireLength < captured ? captured : wireLength};
+   append(epb, sizeof(epb));
+
+   uint32_t headPart = headLength < captured ? headLength : captured;
+   append(head, headPart);
+   append(data, captured - headPart);
+   memset(mCurrent.map + mCurrent.used, 0, pad4(captured) - captured);
+   mCurrent.used += pad4(captured) - captured;
+   append(&blockLength, sizeof(blockLength));
+
+   mUsed.store(mCurrent.used, std::memory_order_release);
+   mPackets++;
+   return 0;
+}
+
+void PcapngWriter::append(const void *data, size_t length) noexcept
+{
+   if (length == 0)
+      return;
+   memcpy(mCurrent.map + mCurrent.used, data, length);
+   mCurrent.used += length;
+}
+
+void PcapngWriter::flusher()
+{
+   uint32_t syncedIndex = 0;
+   size_t synced = 0;
+
+   std::unique_lock<std::mutex> lock(mMutex);
+   while (mRunning)
+   {
+      std::vector<Segment> retired;
+      retired.swap(mRetired);
+      bool prepare = (mSpare.fd == -1);
+      uint32_t index = prepare ? mNextIndex++ : 0;
+      mPreparing = prepare;
+      int fd = mCurrent.fd;
+      uint32_t current = mCurrent.index;
+      size_t used = mUsed.load(std::memory_order_acquire);
+      lock.unlock();
+
+      for (auto &seg : retired)
+      {
+         uint32_t retiredIndex = seg.index;
+         closeSegment(seg);
+         if (mMaxFiles != 0 && retiredIndex + 1 >= mMaxFiles)
+            unlink(fileName(retiredIndex + 1 - mMaxFiles).c_str());
+      }
+
+      Segment spare;
+      int rc = prepare ? openSegment(index, spare) : 0;
+
+      // Start the write back of the pages written since the last pass
+      if (current != syncedIndex)
+      {
+         syncedIndex = current;
+         synced = 0;
+      }
+      if (used > synced)
+      {
+         sync_file_range(fd, static_cast<off64_t>(synced), static_cast<off64_t>(used - synced), SYNC_FILE_RANGE_WRITE);
+         synced = used;
+      }
+
+      lock.lock();
+      if (prepare)
+      {
+         mPreparing = false;
+         if (rc == 0)
+            mSpare = spare;
+         else
+            mNextIndex = index;
+      }
+      mCond.notify_all();
+      mCond.wait_for(lock, std::chrono::milliseconds(mFlushIntervalMs), [this] { return !mRunning || !mRetired.empty(); });
+   }
+}
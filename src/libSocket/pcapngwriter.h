@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : pcapngwriter.h
+// Contents  : memory mapped pcapng capture writer interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "packetring.h"
+#include "socketdgram.h"
+
+/**
+ * @brief Write the frames and datagrams already received by the process to pcapng files.
+ *
+ * The files are written through pre-allocated memory mapped segments of
+ * segmentSize bytes, a packet costs one memcpy and no syscall. When a packet
+ * does not fit, the writer switches to the next segment, the files are named
+ * prefix-00000.pcapng, prefix-00001.pcapng...
+ *
+ * A background thread prepares the next segment in advance, starts the write
+ * back of the written pages every flushIntervalMs, and truncates, closes and
+ * rotates the full segments. With maxFiles, only the last maxFiles files are
+ * kept, plus the one prepared in advance.
+ *
+ * Each packet keeps its kernel receive timestamp when there is one, the
+ * current time otherwise. The datagrams are written as IPv4 or IPv6 packets
+ * (LINKTYPE_RAW) with a synthesized UDP header, so the usual tools decode them.
+ *
+ * The capture can be switched on and off at runtime with enable(). The write
+ * methods are not thread safe, there is one writer thread per PcapngWriter.
+ */
+class LIBSOCKET_EXPORT PcapngWriter
+{
+public:
+   enum LinkType : uint16_t
+   {
+      ETHERNET = 1,   ///< LINKTYPE_ETHERNET, frames from the ethernet header, see PacketRing.
+      RAW = 101,      ///< LINKTYPE_RAW, IPv4 or IPv6 packets, see write(const datagram&...).
+   };
+
+   explicit PcapngWriter(const std::string &prefix, uint32_t segmentSize = 64 << 20, uint32_t maxFiles = 0,
+                         uint32_t flushIntervalMs = 100);
+   PcapngWriter(const PcapngWriter &) = delete;
+   PcapngWriter &operator=(const PcapngWriter &) = delete;
+   ~PcapngWriter();
+
+   int addInterface(LinkType linkType, const std::string &name = std::string(), uint32_t snapLength = 65535);
+
+   int write(uint32_t interfaceId, const void *data, uint32_t length, uint32_t wireLength, const timespec &stamp) noexcept;
+   int write(const PacketRing::Frame &frame, uint32_t interfaceId = 0) noexcept;
+   int write(const datagram &dg, const socketaddr &local, uint32_t interfaceId = 0) noexcept;
+
+   void enable(bool on = true) noexcept;
+   bool isEnabled() const noexcept;
+   void flush() noexcept;
+
+   uint64_t packets() const noexcept;
+   uint32_t fileIndex() const noexcept;
+   std::string fileName(uint32_t index) const;
+
+private:
+   struct Segment
+   {
+      int fd = -1;
+      uint8_t *map = nullptr;
+      size_t used = 0;
+      uint32_t index = 0;
+   };
+
+   struct Interface
+   {
+      uint16_t linkType;
+      uint32_t snapLength;
+   };
+
+   int openSegment(uint32_t index, Segment &seg) noexcept;
+   void closeSegment(Segment &seg) noexcept;
+   int rotate() noexcept;
+   int writeBlock(uint32_t interfaceId, const void *head, uint32_t headLength, const void *data, uint32_t length,
+                  uint32_t wireLength, const timespec &stamp) noexcept;
+   void append(const void *data, size_t length) noexcept;
+   void flusher();
+
+   std::string mPrefix;
+   size_t mSegmentSize;
+   uint32_t mMaxFiles;
+   uint32_t mFlushIntervalMs;
+
+   std::vector<Interface> mInterfaces;
+   std::vector<uint8_t> mHeader;    ///< The section header and interface blocks, written at the start of each file.
+   Segment mCurrent;                ///< Owned by the writer thread, swapped under mMutex.
+   std::atomic<size_t> mUsed;       ///< mCurrent.used published to the flusher.
+   std::atomic<bool> mEnabled;
+   uint64_t mPackets = 0;
+
+   std::mutex mMutex;
+   std::condition_variable mCond;
+   bool mRunning = true;
+   bool mPreparing = false;         ///< The flusher is opening the next segment.
+   uint32_t mNextIndex = 0;
+   Segment mSpare;                  ///< The next segment, prepared by the flusher.
+   std::vector<Segment> mRetired;   ///< The full segments, closed by the flusher.
+   std::thread mFlusher;
+};
@@ -23,7 +23,7 @@
 #include <winsock2.h>
 #define nfds_t ULONG
 
-int poll(struct pollfd* fds, nfds_t nfds, int timeout)
+inline int poll(struct pollfd* fds, nfds_t nfds, int timeout)
 {
    return WSAPoll(fds, nfds, timeout);
 }
@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : reactor.cpp
+// Contents  : edge-triggered epoll reactor implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <sys/eventfd.h>
+
+#include "reactor.h"
+
+/**
+ * @brief Construct a new Reactor object.
+ *
+ * @param maxEvents : Maximum number of events retrieved by one epoll_wait.
+ * @param tickMs : The timer wheel resolution in milli second(s).
+ */
+Reactor::Reactor(uint32_t maxEvents /*=256*/, uint32_t tickMs /*=1*/)
+   : mRunning(true), mEvents(maxEvents ? maxEvents : 1), mTimers(tickMs)
+{
+   mEpoll = epoll_create1(EPOLL_CLOEXEC);
+   if (mEpoll == -1)
+      throw std::system_error(errno, std::system_category(), "epoll_create1");
+
+   mWakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (mWakeup == -1)
+   {
+      int err = errno;
+      ::close(mEpoll);
+      throw std::system_error(err, std::system_category(), "eventfd");
+   }
+
+   // The wakeup eventfd is the only entry with a null data.ptr
+   epoll_event ev = {};
+   ev.events = EPOLLIN;
+   ev.data.ptr = nullptr;
+   if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWakeup, &ev) == -1)
+   {
+      int err = errno;
+      ::close(mWakeup);
+      ::close(mEpoll);
+      throw std::system_error(err, std::system_category(), "epoll_ctl");
+   }
+}
+
+Reactor::~Reactor()
+{
+   ::close(mWakeup);
+   ::close(mEpoll);
+}
+
+/**
+ * @brief Register a socket.
+ *
+ * The socket is registered edge-triggered and switched to non-blocking mode,
+ * its mode is left untouched if the registration fails.
+ * ERROR and HANGUP events are always reported, even if not requested.
+ *
+ * @param sock : An opened socket.
+ * @param events : A bitmask of Reactor::Event.
+ * @param callback : Called from poll() with the socket and the ready events.
+ * @return int : zero on success.
+ */
+int Reactor::add(Socket &sock, uint32_t events, Callback callback)
+{
+   SOCKET fd = sock.getHandle();
+   if (fd == INVALID_SOCKET)
+   {
+      errno = EBADF;
+      return -1;
+   }
+   if (mHandlers.count(fd))
+   {
+      errno = EEXIST;
+      return -1;
+   }
+
+   std::unique_ptr<Handler> handler(new Handler{&sock, fd, std::move(callback), false});
+
+   epoll_event ev = {};
+   ev.events = events | EPOLLET;
+   ev.data.ptr = handler.get();
+   if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &ev) == -1)
+      return -1;
+
+   // Only once registered : a failed add leaves the socket mode untouched
+   sock.setNONBLOCK(true);
+   mHandlers.emplace(fd, std::move(handler));
+   return 0;
+}
+
+/**
+ * @brief Change the events monitored for a registered socket.
+ *
+ * @param sock : A registered socket.
+ * @param events : A bitmask of Reactor::Event.
+ * @return int : zero on success.
+ */
+int Reactor::modify(Socket &sock, uint32_t events) noexcept
+{
+   auto it = mHandlers.find(sock.getHandle());
+   if (it == mHandlers.end())
+   {
+      errno = ENOENT;
+      return -1;
+   }
+
+   epoll_event ev = {};
+   ev.events = events | EPOLLET;
+   ev.data.ptr = it->second.get();
+   return epoll_ctl(mEpoll, EPOLL_CTL_MOD, it->first, &ev);
+}
+
+/**
+ * @brief Unregister a socket.
+ *
+ * It is safe to call this method from a callback, even for another socket
+ * whose event is pending in the current batch.
+ *
+ * @param sock : A registered socket.
+ * @return int : zero on success.
+ */
+int Reactor::remove(Socket &sock) noexcept
+{
+   auto it = mHandlers.find(sock.getHandle());
+   if (it == mHandlers.end())
+   {
+      errno = ENOENT;
+      return -1;
+   }
+
+   int rc = epoll_ctl(mEpoll, EPOLL_CTL_DEL, it->first, nullptr);
+
+   // Keep the handler alive until the end of the current dispatch loop
+   it->second->removed = true;
+   mRemoved.push_back(std::move(it->second));
+   mHandlers.erase(it);
+   return rc;
+}
+
+/**
+ * @brief Test if a socket is registered.
+ */
+bool Reactor::contains(const Socket &sock) const noexcept
+{
+   return mHandlers.count(sock.getHandle()) != 0;
+}
+
+/**
+ * @brief Number of registered sockets.
+ */
+size_t Reactor::size() const noexcept
+{
+   return mHandlers.size();
+}
+
+/**
+ * @brief The timers fired by this reactor.
+ */
+TimerWheel &Reactor::timers() noexcept
+{
+   return mTimers;
+}
+
+/**
+ * @brief Wait for events, fire the expired timers, then dispatch the events.
+ *
+ * One epoll_wait retrieves up to maxEvents ready sockets, the cost is
+ * proportional to the number of ready sockets, not to the registered ones.
+ *
+ * @param timeoutMs : epoll_wait timeout, -1 waits forever.
+ * @return int : The number of dispatched events and fired timers, -1 on error.
+ */
+int Reactor::poll(int timeoutMs /*=-1*/)
+{
+   int next = mTimers.nextTimeout();
+   if (next >= 0 && (timeoutMs < 0 || next < timeoutMs))
+      timeoutMs = next;
+
+   int n = epoll_wait(mEpoll, mEvents.data(), static_cast<int>(mEvents.size()), timeoutMs);
+   if (n == -1)
+      return (errno == EINTR) ? 0 : -1;
+
+   // Move the wheel clock before the callbacks : a timer armed from a
+   // callback counts its delay from now, not from the previous wake up.
+   int dispatched = static_cast<int>(mTimers.advance());
+   for (int i = 0; i < n; i++)
+   {
+      auto handler = static_cast<Handler *>(mEvents[i].data.ptr);
+      if (handler == nullptr)
+      {
+         uint64_t value;
+         while (::read(mWakeup, &value, sizeof(value)) > 0)
+            ;
+         continue;
+      }
+
+      if (handler->removed)
+         continue;
+
+      handler->callback(*handler->sock, mEvents[i].events);
+      dispatched++;
+   }
+
+   mRemoved.clear();
+   return dispatched;
+}
+
+/**
+ * @brief Dispatch events until stop() is called.
+ */
+void Reactor::run()
+{
+   while (mRunning)
+   {
+      if (poll(-1) == -1)
+         throw std::system_error(errno, std::system_category(), "epoll_wait");
+   }
+   mRunning = true;
+}
+
+/**
+ * @brief Stop the run() loop.
+ *
+ * This method can be called from any thread.
+ */
+void Reactor::stop() noexcept
+{
+   mRunning = false;
+   uint64_t value = 1;
+   auto rc = ::write(mWakeup, &value, sizeof(value));
+   (void)rc;
+}
@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : reactor.h
+// Contents  : edge-triggered epoll reactor interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <sys/epoll.h>
+
+#include "socket.h"
+#include "timerwheel.h"
+
+/**
+ * @brief Dispatch readiness events of many sockets from one thread.
+ *
+ * The reactor uses edge-triggered epoll: a callback is only fired when the
+ * readiness state changes, thus a READ callback must recv until EAGAIN and
+ * a WRITE callback must send until EAGAIN, otherwise no new event will come.
+ *
+ * The reactor does not own the registered sockets, a socket must stay alive
+ * and must be removed from the reactor before being closed.
+ *
+ * The reactor drives a TimerWheel: the epoll_wait timeout is shortened to
+ * the next timer expiration and the expired timers are fired by poll().
+ * Per connection deadlines are implemented with timers instead of
+ * SO_RCVTIMEO/SO_SNDTIMEO, without any syscall.
+ */
+class LIBSOCKET_EXPORT Reactor
+{
+public:
+   enum Event : uint32_t
+   {
+      READ   = EPOLLIN,
+      WRITE  = EPOLLOUT,
+      ERROR  = EPOLLERR,
+      HANGUP = EPOLLHUP | EPOLLRDHUP,
+   };
+
+   using Callback = std::function<void(Socket &sock, uint32_t events)>;
+
+   explicit Reactor(uint32_t maxEvents = 256, uint32_t tickMs = 1);
+   Reactor(const Reactor &) = delete;
+   Reactor &operator=(const Reactor &) = delete;
+   ~Reactor();
+
+   int add(Socket &sock, uint32_t events, Callback callback);
+   int modify(Socket &sock, uint32_t events) noexcept;
+   int remove(Socket &sock) noexcept;
+   bool contains(const Socket &sock) const noexcept;
+   size_t size() const noexcept;
+   TimerWheel &timers() noexcept;
+
+   int poll(int timeoutMs = -1);
+   void run();
+   void stop() noexcept;
+
+private:
+   struct Handler
+   {
+      Socket  *sock;
+      SOCKET   fd;
+      Callback callback;
+      bool     removed;
+   };
+
+   int mEpoll = -1;
+   int mWakeup = -1;
+   std::atomic<bool> mRunning;
+   std::vector<epoll_event> mEvents;
+   std::unordered_map<SOCKET, std::unique_ptr<Handler>> mHandlers;
+   std::vector<std::unique_ptr<Handler>> mRemoved;
+   TimerWheel mTimers;
+};
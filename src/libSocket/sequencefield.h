@@ -0,0 +1,79 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : sequencefield.h
+// Contents  : datagram sequence number field
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "_endian.h"
+
+/**
+ * @brief The position of a sequence number in a datagram payload.
+ *
+ * The field is an unsigned integer of 1, 2, 4 or 8 bytes, at a fixed offset,
+ * big endian (network order) or little endian.
+ */
+struct SequenceField
+{
+   uint32_t offset;
+   uint8_t  size;
+   bool     bigEndian;
+
+   explicit SequenceField(uint32_t offset = 0, uint8_t size = 4, bool bigEndian = true) noexcept
+      : offset(offset), size(size), bigEndian(bigEndian) {}
+
+   /**
+    * @brief Read the sequence number of a datagram.
+    *
+    * @param buffer : The datagram payload.
+    * @param length : The payload length.
+    * @param seq : The sequence number.
+    * @return true : The datagram is long enough.
+    */
+   bool read(const void *buffer, uint32_t length, uint64_t &seq) const noexcept
+   {
+      if (length < offset || length - offset < size)
+         return false;
+
+      auto p = static_cast<const uint8_t *>(buffer) + offset;
+      switch (size)
+      {
+      case 1:
+         seq = *p;
+         return true;
+      case 2:
+      {
+         uint16_t v;
+         memcpy(&v, p, sizeof(v));
+         seq = bigEndian ? be16toh(v) : le16toh(v);
+         return true;
+      }
+      case 4:
+      {
+         uint32_t v;
+         memcpy(&v, p, sizeof(v));
+         seq = bigEndian ? be32toh(v) : le32toh(v);
+         return true;
+      }
+      case 8:
+      {
+         uint64_t v;
+         memcpy(&v, p, sizeof(v));
+         seq = bigEndian ? be64toh(v) : le64toh(v);
+         return true;
+      }
+      default:
+         return false;
+      }
+   }
+};
@@ -0,0 +1,142 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : sequencetracker.cpp
+// Contents  : datagram sequence gap and loss statistics implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include "sequencetracker.h"
+
+constexpr uint32_t SequenceTracker::HISTOGRAM_SIZE;
+
+/**
+ * @brief Construct a new SequenceTracker object.
+ *
+ * @param field : The sequence number field of the datagrams.
+ */
+SequenceTracker::SequenceTracker(const SequenceField &field)
+   : mField(field), mReceived(0), mDuplicates(0), mOutOfOrder(0), mGaps(0),
+     mMissing(0), mMalformed(0), mKernelDrops(0), mHighest(0)
+{
+   for (auto &count : mGapSizes)
+      count.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Account a received datagram.
+ *
+ * @param buffer : The datagram payload.
+ * @param length : The payload length.
+ */
+void SequenceTracker::update(const void *buffer, uint32_t length) noexcept
+{
+   uint64_t seq;
+   if (mField.read(buffer, length, seq))
+      update(seq);
+   else
+      inc(mMalformed);
+}
+
+/**
+ * @brief Account a received sequence number.
+ *
+ * @param seq : The sequence number.
+ */
+void SequenceTracker::update(uint64_t seq) noexcept
+{
+   inc(mReceived);
+   uint64_t highest = mHighest.load(std::memory_order_relaxed);
+   if (!mStarted)
+   {
+      mStarted = true;
+      mRecent = 1;
+      mHighest.store(seq, std::memory_order_relaxed);
+      return;
+   }
+
+   if (seq > highest)
+   {
+      uint64_t shift = seq - highest;
+      mRecent = (shift < 64) ? (mRecent << shift) | 1 : 1;
+      mHighest.store(seq, std::memory_order_relaxed);
+      if (shift > 1)
+      {
+         inc(mGaps);
+         inc(mMissing, shift - 1);
+         inc(mGapSizes[bucket(shift - 1)]);
+      }
+      return;
+   }
+
+   uint64_t age = highest - seq;
+   if (age < 64)
+   {
+      uint64_t bit = uint64_t(1) << age;
+      if (mRecent & bit)
+      {
+         inc(mDuplicates);
+         return;
+      }
+      mRecent |= bit;
+   }
+   // Too old to tell, counted as out of order
+   inc(mOutOfOrder);
+   uint64_t missing = mMissing.load(std::memory_order_relaxed);
+   if (missing > 0)
+      mMissing.store(missing - 1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Set the kernel drop counter.
+ *
+ * @param drops : The SO_RXQ_OVFL value, the number of datagrams dropped since the socket creation.
+ */
+void SequenceTracker::setKernelDrops(uint32_t drops) noexcept
+{
+   mKernelDrops.store(drops, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Read the counters, from any thread.
+ *
+ * The counters are read one by one, they may be a few datagrams apart.
+ *
+ * @return Snapshot : The counters.
+ */
+SequenceTracker::Snapshot SequenceTracker::snapshot() const noexcept
+{
+   Snapshot s;
+   s.received = mReceived.load(std::memory_order_relaxed);
+   s.duplicates = mDuplicates.load(std::memory_order_relaxed);
+   s.outOfOrder = mOutOfOrder.load(std::memory_order_relaxed);
+   s.gaps = mGaps.load(std::memory_order_relaxed);
+   s.missing = mMissing.load(std::memory_order_relaxed);
+   s.malformed = mMalformed.load(std::memory_order_relaxed);
+   s.kernelDrops = mKernelDrops.load(std::memory_order_relaxed);
+   s.highest = mHighest.load(std::memory_order_relaxed);
+   for (uint32_t i = 0; i < HISTOGRAM_SIZE; i++)
+      s.gapSizes[i] = mGapSizes[i].load(std::memory_order_relaxed);
+   return s;
+}
+
+/**
+ * @brief The histogram bucket of a gap size.
+ *
+ * @param gap : The number of missing sequence numbers, at least 1.
+ * @return uint32_t : floor(log2(gap)), capped to HISTOGRAM_SIZE - 1.
+ */
+uint32_t SequenceTracker::bucket(uint64_t gap) noexcept
+{
+   uint32_t i = 0;
+   while (gap > 1 && i < HISTOGRAM_SIZE - 1)
+   {
+      gap >>= 1;
+      i++;
+   }
+   return i;
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : sequencetracker.h
+// Contents  : datagram sequence gap and loss statistics interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <libSocket/export.h>
+
+#include "sequencefield.h"
+
+/**
+ * @brief Loss statistics of a sequenced datagram feed.
+ *
+ * update() is called by the receiving thread for each datagram, see
+ * SocketDGRAM::setSequenceTracker. It only does relaxed atomic loads and
+ * stores, no read-modify-write, so there must be one writer thread.
+ * snapshot() can be called from any thread.
+ *
+ * A sequence number higher than expected opens a gap, its size goes to a
+ * log2 histogram. A lower one is a duplicate if it was already received in
+ * the last 64 sequence numbers, else it is out of order and the missing
+ * counter is decremented.
+ */
+class LIBSOCKET_EXPORT SequenceTracker
+{
+public:
+   /// Bucket i counts the gaps of [2^i, 2^(i+1)) sequence numbers, the last one the larger gaps.
+   static constexpr uint32_t HISTOGRAM_SIZE = 16;
+
+   struct Snapshot
+   {
+      uint64_t received;     ///< Datagrams with a sequence number.
+      uint64_t duplicates;   ///< Sequence numbers received twice.
+      uint64_t outOfOrder;   ///< Sequence numbers received after a higher one.
+      uint64_t gaps;         ///< Gap events.
+      uint64_t missing;      ///< Sequence numbers not received yet.
+      uint64_t malformed;    ///< Datagrams too short for the sequence field.
+      uint64_t kernelDrops;  ///< The SO_RXQ_OVFL counter, datagrams dropped by the kernel.
+      uint64_t highest;      ///< The highest sequence number received.
+      uint64_t gapSizes[HISTOGRAM_SIZE];
+   };
+
+   explicit SequenceTracker(const SequenceField &field);
+   SequenceTracker(const SequenceTracker &) = delete;
+   SequenceTracker &operator=(const SequenceTracker &) = delete;
+
+   void update(const void *buffer, uint32_t length) noexcept;
+   void update(uint64_t seq) noexcept;
+   void setKernelDrops(uint32_t drops) noexcept;
+
+   Snapshot snapshot() const noexcept;
+   static uint32_t bucket(uint64_t gap) noexcept;
+
+private:
+   static void inc(std::atomic<uint64_t> &counter, uint64_t n = 1) noexcept
+   {
+      counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+   }
+
+   SequenceField mField;
+   bool mStarted = false;
+   uint64_t mRecent = 0;   ///< bit i : highest - i received
+
+   std::atomic<uint64_t> mReceived;
+   std::atomic<uint64_t> mDuplicates;
+   std::atomic<uint64_t> mOutOfOrder;
+   std::atomic<uint64_t> mGaps;
+   std::atomic<uint64_t> mMissing;
+   std::atomic<uint64_t> mMalformed;
+   std::atomic<uint64_t> mKernelDrops;
+   std::atomic<uint64_t> mHighest;
+   std::atomic<uint64_t> mGapSizes[HISTOGRAM_SIZE];
+};
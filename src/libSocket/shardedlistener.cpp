@@ -0,0 +1,225 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : shardedlistener.cpp
+// Contents  : SO_REUSEPORT sharded listener implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/filter.h>
+
+#include "shardedlistener.h"
+
+constexpr int ShardedListener::AcceptBackoffMs;
+
+/**
+ * @brief Construct a new ShardedListener object.
+ *
+ * @param shards : Number of listening sockets, zero means one per CPU.
+ */
+ShardedListener::ShardedListener(uint32_t shards /*=0*/) : mRunning(false)
+{
+   if (shards == 0)
+      shards = std::thread::hardware_concurrency();
+   if (shards == 0)
+      shards = 1;
+
+   for (uint32_t i = 0; i < shards; i++)
+      mShards.emplace_back(new SocketSTREAM());
+}
+
+ShardedListener::~ShardedListener()
+{
+   stop();
+   close();
+}
+
+/**
+ * @brief set the listeners address to ANY ADDR.
+ *
+ * @param domain : AF_INET for IPV4, AF_INET6 for IPV6.
+ * @param port : the port to bind.
+ * @return int : zero on success.
+ */
+int ShardedListener::setAnyAddr(int domain, uint16_t port) noexcept
+{
+   int rc = 0;
+   for (auto &sock : mShards)
+      rc |= sock->setAnyAddr(domain, port);
+   return rc;
+}
+
+/**
+ * @brief set the listeners address.
+ *
+ * @param sa : A filled socketaddr.
+ * @return int : zero on success.
+ */
+int ShardedListener::setAddr(const socketaddr &sa) noexcept
+{
+   int rc = 0;
+   for (auto &sock : mShards)
+      rc |= sock->setAddr(sa);
+   return rc;
+}
+
+/**
+ * @brief Open, bind and listen all the shards.
+ *
+ * The shards join the reuseport group in index order, which is the
+ * order used by attachCpuSteering.
+ *
+ * @param n : Maximum number of connections queued per shard.
+ * @return int : zero on success.
+ */
+int ShardedListener::listen(int n /*=128*/)
+{
+   for (auto &sock : mShards)
+   {
+      if (sock->open() == INVALID_SOCKET)
+         return -1;
+      if (sock->setReusePort() != 0)
+         return -1;
+      if (sock->bind() != 0)
+         return -1;
+      if (sock->listen(n) != 0)
+         return -1;
+   }
+   return 0;
+}
+
+/**
+ * @brief Attach a reuseport CBPF program that selects the shard by CPU.
+ *
+ * A connection received on CPU c is queued on the shard c % size().
+ * Must be called after listen().
+ *
+ * @return int : zero on success.
+ */
+int ShardedListener::attachCpuSteering() noexcept
+{
+   sock_filter code[] = {
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(mShards.size())},
+      {BPF_RET | BPF_A, 0, 0, 0},
+   };
+   sock_fprog prog = {};
+   prog.len = sizeof(code) / sizeof(code[0]);
+   prog.filter = code;
+
+   return mShards.front()->setOption(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+/**
+ * @brief Start one accept thread per shard.
+ *
+ * @param callback : Called from the shard thread for each accepted client,
+ *                   the client can be moved out of the callback.
+ * @param pinThreads : Pin the thread of shard i on the CPU i.
+ */
+void ShardedListener::start(Callback callback, bool pinThreads /*=true*/)
+{
+   if (mRunning)
+      throw std::runtime_error("ShardedListener already started");
+
+   mCallback = std::move(callback);
+   mRunning = true;
+   for (uint32_t i = 0; i < mShards.size(); i++)
+      mWorkers.emplace_back(&ShardedListener::worker, this, i, pinThreads);
+}
+
+/**
+ * @brief Stop and join the accept threads.
+ *
+ * The listeners are shut down to wake up the pending accepts,
+ * thus they are no more usable.
+ */
+void ShardedListener::stop()
+{
+   if (!mRunning)
+      return;
+
+   mRunning = false;
+   for (auto &sock : mShards)
+      ::shutdown(sock->getHandle(), SHUT_RDWR);
+
+   for (auto &th : mWorkers)
+      th.join();
+   mWorkers.clear();
+}
+
+/**
+ * @brief Close all the shards.
+ *
+ * @return int : zero on success.
+ */
+int ShardedListener::close() noexcept
+{
+   int rc = 0;
+   for (auto &sock : mShards)
+      rc |= sock->close();
+   return rc;
+}
+
+/**
+ * @brief Number of shards.
+ */
+uint32_t ShardedListener::size() const noexcept
+{
+   return static_cast<uint32_t>(mShards.size());
+}
+
+/**
+ * @brief Access a shard listening socket.
+ */
+SocketSTREAM &ShardedListener::shard(uint32_t index)
+{
+   return *mShards.at(index);
+}
+
+void ShardedListener::worker(uint32_t index, bool pin)
+{
+   if (pin)
+   {
+      uint32_t nbCpu = std::thread::hardware_concurrency();
+      if (nbCpu != 0)
+      {
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET(index % nbCpu, &set);
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      }
+   }
+
+   auto &listener = *mShards[index];
+   while (mRunning)
+   {
+      try
+      {
+         SocketSTREAM client = listener.accept();
+         if (client.isOpen())
+            mCallback(client, index);
+      }
+      catch (const std::system_error &e)
+      {
+         if (!mRunning)
+            break;
+
+         // Out of descriptors or memory : the pending connection stays queued and
+         // accept would fail again at once, give the process time to release some.
+         int err = e.code().value();
+         if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM)
+            std::this_thread::sleep_for(std::chrono::milliseconds(AcceptBackoffMs));
+      }
+   }
+}
@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : shardedlistener.h
+// Contents  : SO_REUSEPORT sharded listener interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "socketstream.h"
+
+/**
+ * @brief N listening sockets bound on the same address with SO_REUSEPORT.
+ *
+ * The kernel spreads the incoming connections over the N accept queues,
+ * each queue is serviced by its own worker thread, optionally pinned to a CPU.
+ * With attachCpuSteering(), a connection is queued on the listener of the
+ * CPU that received it, so it stays on that CPU.
+ * When accept fails for lack of descriptors or memory (EMFILE, ENFILE...),
+ * the worker pauses before retrying instead of spinning on the queue.
+ */
+class LIBSOCKET_EXPORT ShardedListener
+{
+public:
+   using Callback = std::function<void(SocketSTREAM &client, uint32_t shard)>;
+
+   explicit ShardedListener(uint32_t shards = 0);
+   ShardedListener(const ShardedListener &) = delete;
+   ShardedListener &operator=(const ShardedListener &) = delete;
+   ~ShardedListener();
+
+   int setAnyAddr(int domain, uint16_t port) noexcept;
+   int setAddr(const socketaddr &sa) noexcept;
+
+   int listen(int n = 128);
+   int attachCpuSteering() noexcept;
+   void start(Callback callback, bool pinThreads = true);
+   void stop();
+   int close() noexcept;
+
+   uint32_t size() const noexcept;
+   SocketSTREAM &shard(uint32_t index);
+
+private:
+   static constexpr int AcceptBackoffMs = 50;   ///< Pause after an accept failing on a resource shortage.
+
+   void worker(uint32_t index, bool pin);
+
+   std::atomic<bool> mRunning;
+   Callback mCallback;
+   std::vector<std::unique_ptr<SocketSTREAM>> mShards;
+   std::vector<std::thread> mWorkers;
+};
@@ -20,6 +20,11 @@
 #include "socket.h"
 #include "socket_portability.h"
 
+#ifdef __linux__
+#   include <linux/errqueue.h>
+#   include <linux/net_tstamp.h>
+#endif
+
 Socket::Socket()
 {
 #ifdef OS_WINDOWS
@@ -47,6 +52,55 @@ Socket::Socket(int domain, int type, int proto) : Socket()
    mAddr.sa.sa_family = domain;
 }
 
+/**
+ * @brief Move constructor, the underlying socket is transferred.
+ *
+ * @param other : The moved socket, it is left closed.
+ */
+Socket::Socket(Socket &&other) noexcept : Socket()
+{
+   mSock = other.mSock;
+   mDomain = other.mDomain;
+   mType = other.mType;
+   mProto = other.mProto;
+   mAddr = other.mAddr;
+   mSendFlags = other.mSendFlags;
+   mRecvFlags = other.mRecvFlags;
+   mNONBLOCK = other.mNONBLOCK;
+   mConnected = other.mConnected;
+
+   other.mSock = INVALID_SOCKET;
+   other.mNONBLOCK = false;
+   other.mConnected = false;
+}
+
+/**
+ * @brief Move assignment, the current socket is closed and the underlying socket is transferred.
+ *
+ * @param other : The moved socket, it is left closed.
+ */
+Socket &Socket::operator=(Socket &&other) noexcept
+{
+   if (this != &other)
+   {
+      close();
+      mSock = other.mSock;
+      mDomain = other.mDomain;
+      mType = other.mType;
+      mProto = other.mProto;
+      mAddr = other.mAddr;
+      mSendFlags = other.mSendFlags;
+      mRecvFlags = other.mRecvFlags;
+      mNONBLOCK = other.mNONBLOCK;
+      mConnected = other.mConnected;
+
+      other.mSock = INVALID_SOCKET;
+      other.mNONBLOCK = false;
+      other.mConnected = false;
+   }
+   return *this;
+}
+
 Socket::~Socket()
 {
    close();
@@ -94,6 +148,8 @@ int Socket::close() noexcept
 #endif
    }
    mSock = INVALID_SOCKET;
+   mNONBLOCK = false;
+   mConnected = false;
    return rc;
 }
 
@@ -127,7 +183,7 @@ int Socket::setAnyAddr(uint16_t port) noexcept
       saddr.s4.sin_addr.s_addr = INADDR_ANY;
       saddr.size = sizeof(saddr.s4);
    }
-   else if (mAddr.sa.sa_family == AF_INET6)
+   else if (mDomain == AF_INET6)
    {
       saddr.s6.sin6_addr = in6addr_any;
       saddr.size = sizeof(saddr.s6);
@@ -276,6 +332,16 @@ socketaddr Socket::getSocketaddr() const noexcept
    return mAddr;
 }
 
+/**
+ * @brief Readback the underlying socket handle.
+ *
+ * @return SOCKET : The socket handle or INVALID_SOCKET.
+ */
+SOCKET Socket::getHandle() const noexcept
+{
+   return mSock;
+}
+
 /**
  * @brief This method encapsulates errno under unix and WSAGetLastError under Windows.
  * 
@@ -310,8 +376,88 @@ int Socket::getOption(int level, int option_name, void *option_value, int *optio
    return getsockopt(mSock, level, option_name, PCHAR_WSCAST(option_value), (socklen_t *)option_len);
 }
 
+/**
+ * @brief Set or clear the O_NONBLOCK flag of the underlying socket.
+ *
+ * The current mode is cached, so the fcntl/ioctlsocket calls are only
+ * issued when the mode actually changes.
+ *
+ * @param on : true to enable the non-blocking mode.
+ */
+void Socket::setNONBLOCK(bool on /*=true*/)
+{
+   if ((on && mNONBLOCK) || (!on && !mNONBLOCK))
+      return; // nothing to do
+
+   if (on && !mNONBLOCK)
+      mNONBLOCK = true;
+
+   if (!on && mNONBLOCK)
+      mNONBLOCK = false;
+
+#ifdef OS_UNIX
+
+   int flags = fcntl(mSock, F_GETFL, 0);
+
+   if (mNONBLOCK)
+      flags |= O_NONBLOCK;
+   else
+      flags &= ~O_NONBLOCK;
+
+   int rc = fcntl(mSock, F_SETFL, flags);
+   if (rc == -1)
+      throw std::system_error(errno, std::system_category(), "fcntl");
+
+#elif defined OS_WINDOWS
+
+   u_long iMode = 1; // iMode != 0, non-blocking mode is enabled
+   if (!mNONBLOCK)
+      iMode = 0;
+
+   auto iRes = ioctlsocket(mSock, FIONBIO, &iMode);
+   if (iRes != NO_ERROR)
+   {
+      auto msg = "ioctlsocket set O_NONBLOCK failed: " + std::to_string(iRes);
+      throw std::runtime_error(msg);
+   }
+
+#endif
+}
+
+/**
+ * @brief Test the non-blocking mode of the underlying socket.
+ *
+ * @return true : The O_NONBLOCK flag is set.
+ * @return false : The socket is in blocking mode.
+ */
+bool Socket::isNONBLOCK() const noexcept
+{
+   return mNONBLOCK;
+}
+
+/**
+ * @brief Enable the port reuse socket option.
+ *
+ * Under UNIX like, we set the SO_REUSEPORT socket option.
+ * Under winsoc,  we set the SO_REUSEADDR socket option.
+ * 
+ * @return int : zero on success.
+ */
+int Socket::setReusePort(bool value /*=true*/) noexcept
+{
+   int reuse = static_cast<int>(value);
+#ifndef OS_WINDOWS
+   return setsockopt(mSock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#else
+   return setsockopt(mSock, SOL_SOCKET, SO_REUSEADDR, CPCHAR_WSCAST(&reuse), sizeof(reuse));
+#endif
+}
+
 /**
  * @brief Set a receive time out.
+ *
+ * Only blocking sockets are concerned. For per request deadlines on
+ * non-blocking sockets, use the Reactor timers, they don't need a syscall.
  * 
  * @param s : number of second(s).
  * @param ms : number of milli second(s).
@@ -527,3 +673,169 @@ int Socket::recv(msghdr &msg) noexcept
    return nbBytesRecvd;
 #endif
 }
+
+/**
+ * @brief Enable the kernel software timestamps (SO_TIMESTAMPING).
+ *
+ * RX timestamps are taken when the packet enters the network stack, they
+ * come with the received data: see recvStamped, timestamp(msghdr) and the
+ * datagram.stamp field. TX timestamps are taken when the packet leaves the
+ * stack, they are read from the error queue with recvTxTimestamp.
+ * Linux only.
+ *
+ * The first SO_TIMESTAMPING user of the system turns the RX stamps on from a
+ * kernel work queue, after this call returns: the data received meanwhile has
+ * no timestamp (zero).
+ *
+ * @param rx : Enable the receive timestamps.
+ * @param tx : Enable the transmit timestamps.
+ * @return int : zero on success.
+ */
+int Socket::setTimestamping(bool rx /*=true*/, bool tx /*=true*/) noexcept
+{
+#ifdef __linux__
+   int flags = 0;
+   if (rx)
+      flags |= SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+   if (tx)
+      flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+   return setsockopt(mSock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+#else
+   (void)rx;
+   (void)tx;
+   errno = ENOPROTOOPT;
+   return -1;
+#endif
+}
+
+/**
+ * @brief Receive data with its kernel receive timestamp.
+ *
+ * One recvmsg, as recv(void*, uint32_t) does. For a datagram socket the
+ * internal sockaddr is set to the peer address, as recv does.
+ *
+ * @param buffer : The receive buffer.
+ * @param size : The buffer size.
+ * @param stamp : The timestamp (CLOCK_REALTIME), zero if not available.
+ * @return int : The number of received bytes, -1 on error.
+ */
+int Socket::recvStamped(void *buffer, uint32_t size, timespec &stamp) noexcept
+{
+   stamp.tv_sec = 0;
+   stamp.tv_nsec = 0;
+   if (buffer == nullptr || size == 0)
+      return -1;
+
+#ifdef __linux__
+   iovec iov;
+   iov.iov_base = buffer;
+   iov.iov_len = size;
+
+   char control[CMSG_SPACE(sizeof(scm_timestamping))] = {};
+   msghdr msg = {};
+   if (mType == SOCK_DGRAM)
+   {
+      mAddr.size = sizeof(mAddr.ss);
+      msg.msg_name = &mAddr.ss;
+      msg.msg_namelen = mAddr.size;
+   }
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+
+   ssize_t rc = recvmsg(mSock, &msg, mRecvFlags);
+   if (rc == -1)
+      return -1;
+   if (mType == SOCK_DGRAM)
+      mAddr.size = msg.msg_namelen;
+
+   timestamp(msg, stamp);
+   return static_cast<int>(rc);
+#else
+   return recv(buffer, size);
+#endif
+}
+
+/**
+ * @brief Read one transmit timestamp from the error queue.
+ *
+ * This call never blocks. The id counts the sent datagrams for a datagram
+ * socket, and the sent bytes for a stream socket, from the setTimestamping call.
+ *
+ * @param id : The id of the timestamped send.
+ * @param stamp : The timestamp (CLOCK_REALTIME).
+ * @return int : zero on success, -1 with errno EAGAIN when the error queue is empty.
+ */
+int Socket::recvTxTimestamp(uint32_t &id, timespec &stamp) noexcept
+{
+#ifdef __linux__
+   char control[CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))] = {};
+   msghdr msg = {};
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+
+   if (recvmsg(mSock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+      return -1;
+
+   for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+   {
+      if ((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) ||
+          (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+      {
+         sock_extended_err err;
+         memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+         if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+            id = err.ee_data;
+      }
+   }
+   if (!timestamp(msg, stamp))
+   {
+      errno = ENOMSG;
+      return -1;
+   }
+   return 0;
+#else
+   (void)id;
+   (void)stamp;
+   errno = ENOPROTOOPT;
+   return -1;
+#endif
+}
+
+/**
+ * @brief Extract the kernel timestamp from the control messages.
+ *
+ * Both SCM_TIMESTAMPING (software stamp) and SCM_TIMESTAMPNS are handled.
+ *
+ * @param message : A message received with recvmsg and a control buffer.
+ * @param stamp : The timestamp (CLOCK_REALTIME).
+ * @return true : A timestamp was found.
+ */
+bool Socket::timestamp(const msghdr &message, timespec &stamp) noexcept
+{
+#ifdef __linux__
+   for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR((msghdr *)&message, cmsg))
+   {
+      if (cmsg->cmsg_level != SOL_SOCKET)
+         continue;
+
+      if (cmsg->cmsg_type == SCM_TIMESTAMPING)
+      {
+         scm_timestamping ts;
+         memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+         stamp = ts.ts[0];
+         return true;
+      }
+      if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+      {
+         memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+         return true;
+      }
+   }
+#else
+   (void)message;
+   (void)stamp;
+#endif
+   return false;
+}
@@ -16,11 +16,18 @@
 #include "socket_portability.h"
 #include <libSocket/export.h>
 #include <string>
+#include <ctime>
 
 class LIBSOCKET_EXPORT Socket
 {
+   friend class IoUring;
+
 public:
    Socket(int domain, int type, int proto = 0);
+   Socket(const Socket &) = delete;
+   Socket(Socket &&other) noexcept;
+   Socket &operator=(const Socket &) = delete;
+   Socket &operator=(Socket &&other) noexcept;
    virtual ~Socket();
 
    SOCKET open() noexcept;
@@ -39,12 +46,22 @@ public:
    int bind() noexcept;
    uint16_t getPort() const;
    socketaddr getSocketaddr() const noexcept;
+   SOCKET getHandle() const noexcept;
    
    int error() const;
 
    int setOption(int level, int option_name, const void *option_value, int option_len) noexcept;
    int getOption(int level, int option_name, void *option_value, int *option_len) noexcept;
 
+   void setNONBLOCK(bool on = true);
+   bool isNONBLOCK() const noexcept;
+
+   int setReusePort(bool value = true) noexcept;
+   int setTimestamping(bool rx = true, bool tx = true) noexcept;
+   int recvStamped(void *buffer, uint32_t size, timespec &stamp) noexcept;
+   int recvTxTimestamp(uint32_t &id, timespec &stamp) noexcept;
+   static bool timestamp(const msghdr &message, timespec &stamp) noexcept;
+
    int setRecvTimeout(uint32_t s, uint32_t ms) noexcept;
    int setSendTimeout(uint32_t s, uint32_t ms) noexcept;
 
@@ -98,6 +115,8 @@ protected:
 
    unsigned int mSendFlags = 0;
    unsigned int mRecvFlags = 0;
+   bool mNONBLOCK = false;
+   bool mConnected = false;
 #ifdef OS_WINDOWS
    WSADATA wsaData;
 #endif
@@ -58,7 +58,7 @@ int IpAddrDomain(const std::string& ipAddr)
  *
  * @param node : An IPV4, IPV6 or a hostname.
  * @param domain : AF_UNSPEC, AF_INET, AF_INET6.
- * @return socketaddr : If the convertion failed, the socketaddr.size equals -1.
+ * @return socketaddr : If the convertion failed, the socketaddr.size equals 0.
  */
 socketaddr SockAddr(const std::string& node, int domain/*=AF_UNSPEC*/)
 {
@@ -80,7 +80,7 @@ socketaddr SockAddr(const std::string& node, int domain/*=AF_UNSPEC*/)
  * @param node : An IPV4, IPV6 or a hostname.
  * @param port : A valid port number.
  * @param domain : AF_UNSPEC, AF_INET, AF_INET6.
- * @return socketaddr : If the convertion failed, the socketaddr.size equals -1.
+ * @return socketaddr : If the convertion failed, the socketaddr.size equals 0.
  */
 socketaddr SockAddr(const std::string& node, uint16_t port, int domain/*=AF_UNSPEC*/)
 {
@@ -102,9 +102,52 @@ socketaddr SockAddr(const std::string& node, uint16_t port, int domain/*=AF_UNSP
  * @param node : An IPV4, IPV6 or a hostname.
  * @param port : A valid port number.
  * @param hints : A valid addrinfo passed to the underlying getaddrinfo.
- * @return socketaddr : If the convertion failed, the socketaddr.size equals -1.
+ * @return socketaddr : If the convertion failed, the socketaddr.size equals 0.
  */
 socketaddr SockAddr(const std::string& node, uint16_t port, addrinfo& hints)
+{
+   socketaddr saddr = {};
+   auto list = SockAddrList(node, port, hints);
+   if (!list.empty())
+      saddr = list.front();
+   return saddr;
+}
+
+/**
+ * @brief Resolve all the sockaddr of the tuple node, port.
+ *
+ * A hostname usually resolve to several IPV4 and IPV6 addresses,
+ * a client should try them all, see SocketSTREAM::connect(node, port).
+ *
+ * @param node : An IPV4, IPV6 or a hostname.
+ * @param port : A valid port number.
+ * @param domain : AF_UNSPEC, AF_INET, AF_INET6.
+ * @return std::vector<socketaddr> : The addresses in the getaddrinfo order, empty if the convertion failed.
+ */
+std::vector<socketaddr> SockAddrList(const std::string& node, uint16_t port, int domain/*=AF_UNSPEC*/)
+{
+   addrinfo hints = {};
+   hints.ai_family = (domain == AF_UNSPEC) ? IpAddrDomain(node) : domain;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_canonname = nullptr;
+   hints.ai_addr = nullptr;
+   hints.ai_next = nullptr;
+
+   return SockAddrList(node, port, hints);
+}
+
+/**
+ * @brief Resolve all the sockaddr of the tuple node, port.
+ *
+ * This methode encapsulate getaddrinfo, the duplicated addresses
+ * (one per socket type) are removed.
+ *
+ * @param node : An IPV4, IPV6 or a hostname.
+ * @param port : A valid port number.
+ * @param hints : A valid addrinfo passed to the underlying getaddrinfo.
+ * @return std::vector<socketaddr> : The addresses in the getaddrinfo order, empty if the convertion failed.
+ */
+std::vector<socketaddr> SockAddrList(const std::string& node, uint16_t port, addrinfo& hints)
 {
    char* pnode = nullptr;
    if (node != "")
@@ -115,31 +158,37 @@ socketaddr SockAddr(const std::string& node, uint16_t port, addrinfo& hints)
    if (port != 0)
       pport = (char*)sport.c_str();
 
-   socketaddr saddr = {};
+   std::vector<socketaddr> list;
    addrinfo* result = nullptr, * rp = nullptr;
    int rc = getaddrinfo(pnode, pport, &hints, &result);
    if (rc != 0)
-   {
-      freeaddrinfo(result);
-      return saddr;
-   }
+      return list;
 
    for (rp = result; rp != nullptr; rp = rp->ai_next)
    {
-      if (rp->ai_addr)
+      if (rp->ai_addr == nullptr || rp->ai_addrlen > sizeof(sockaddr_storage))
+         continue;
+      if (rp->ai_addr->sa_family != AF_INET && rp->ai_addr->sa_family != AF_INET6)
+         continue;
+
+      socketaddr saddr = {};
+      memcpy(&saddr.ss, rp->ai_addr, rp->ai_addrlen);
+      saddr.size = static_cast<socklen_t>(rp->ai_addrlen);
+
+      bool duplicate = false;
+      for (const auto& known : list)
       {
-         if (rp->ai_addr->sa_family == AF_INET || rp->ai_addr->sa_family == AF_INET6)
+         if (known.size == saddr.size && memcmp(&known.ss, &saddr.ss, saddr.size) == 0)
          {
-            saddr.sa = *rp->ai_addr;
-            saddr.size  = static_cast<socklen_t>(rp->ai_addrlen);
-            freeaddrinfo(result);
-            return saddr;
+            duplicate = true;
+            break;
          }
       }
+      if (!duplicate)
+         list.push_back(saddr);
    }
    freeaddrinfo(result);
-   saddr.size = 0;
-   return saddr;
+   return list;
 }
 
 /**
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <iomanip>
 #include <iostream>
 
@@ -40,6 +41,8 @@ int         LIBSOCKET_EXPORT IpAddrDomain(const std::string& ipAddr);
 socketaddr  LIBSOCKET_EXPORT SockAddr(const std::string& node, int domain = AF_UNSPEC);
 socketaddr  LIBSOCKET_EXPORT SockAddr(const std::string& node, uint16_t port, int domain=AF_UNSPEC);
 socketaddr  LIBSOCKET_EXPORT SockAddr(const std::string& node, uint16_t port, addrinfo&);
+std::vector<socketaddr> LIBSOCKET_EXPORT SockAddrList(const std::string& node, uint16_t port, int domain=AF_UNSPEC);
+std::vector<socketaddr> LIBSOCKET_EXPORT SockAddrList(const std::string& node, uint16_t port, addrinfo&);
 std::string LIBSOCKET_EXPORT IfName(const std::string& ipAddr);
 std::string LIBSOCKET_EXPORT IfName(int IfIndex);
 std::string LIBSOCKET_EXPORT IpAddr(const std::string& ifName, int domain=AF_INET);
@@ -15,9 +15,30 @@
 #include <stdexcept>
 #include <system_error>
 
+#include "poll.h"
 #include "config.h"
 #include "_endian.h"
 #include "socketdgram.h"
+#include "sequencetracker.h"
+
+#ifdef __linux__
+#   include <netinet/udp.h>
+#endif
+
+#ifndef UDP_SEGMENT
+#   define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#   define UDP_GRO 104
+#endif
+
+namespace
+{
+   // The kernel limits a GSO send to 64 segments and to one IP packet
+   constexpr uint32_t GSO_MAX_SEGMENTS = 64;
+   constexpr uint32_t GSO_MAX_PAYLOAD = 0xFFFF - 40 - 8;
+}
 
 /**
  * @brief Construct a new SocketDGRAM object.
@@ -27,16 +48,6 @@
  */
 SocketDGRAM::SocketDGRAM(int domain, int proto) : Socket(domain, SOCK_DGRAM, proto)
 {
-   try
-   {
-      mpreq = new group_req[IGMP_REQ_ARRAY_SIZE];
-      mpreq_src = new group_source_req[IGMP_REQ_ARRAY_SIZE];
-   }
-   catch(const std::exception& e)
-   {
-      delete [] mpreq;
-      delete [] mpreq_src;
-   }
 }
 
 /**
@@ -53,8 +64,53 @@ SocketDGRAM::SocketDGRAM(int domain, int type, int proto) : Socket(domain, type,
 SocketDGRAM::~SocketDGRAM()
 {
    igmpLeave();
-   delete [] mpreq;
-   delete [] mpreq_src;
+}
+
+/**
+ * @brief Connect the socket to the internal sockaddr.
+ *
+ * The kernel does the route lookup once: the send methods, sendBatch and
+ * sendSegments then send to the peer without destination address, and
+ * only the datagrams of the peer are received.
+ * A datagram with its own peer address is still sent to it.
+ *
+ * @return int : zero on success.
+ */
+int SocketDGRAM::connect() noexcept
+{
+   int rc = ::connect(mSock, &mAddr.sa, mAddr.size);
+   if (rc == 0)
+      mConnected = true;
+   return rc;
+}
+
+/**
+ * @brief Dissolve the association with the peer.
+ *
+ * The sends use the internal sockaddr again, the datagrams of all the
+ * peers are received.
+ *
+ * @return int : zero on success.
+ */
+int SocketDGRAM::disconnect() noexcept
+{
+   sockaddr sa = {};
+   sa.sa_family = AF_UNSPEC;
+   int rc = ::connect(mSock, &sa, sizeof(sa));
+   // The BSD report EAFNOSUPPORT, the socket is disconnected anyway
+   if (rc == -1 && errno == EAFNOSUPPORT)
+      rc = 0;
+   if (rc == 0)
+      mConnected = false;
+   return rc;
+}
+
+/**
+ * @brief Test if the socket is connected, see connect().
+ */
+bool SocketDGRAM::isConnected() const noexcept
+{
+   return mConnected;
 }
 
 /**
@@ -81,84 +137,82 @@ int SocketDGRAM::setMulticastTTL(uint8_t ttl) noexcept
 }
 
 /**
- * @brief Enable the port reuse socket option.
+ * @brief Send a igmp v2 join, or a MLD v1 join for an IPV6 group.
  *
- * Under UNIX like, we set the SO_REUSEPORT socket option.
- * Under winsoc,  we set the SO_REUSEADDR socket option.
+ * The memberships are kept in a per socket registry, there is no limit
+ * but the kernel ones, see the net.ipv4.igmp_max_memberships sysctl.
  * 
- * @return int : zero on success.
+ * @param GroupAddr : The group address to join.
+ * @param IfIndex : The interface index that should send the igmp join.
+ * @return int : zero on success, -1 with errno EADDRINUSE if already joined.
  */
-int SocketDGRAM::setReusePort(bool value /*=true*/) noexcept
+int SocketDGRAM::igmpJoin(const std::string &GroupAddr, int IfIndex)
 {
-   int reuse = static_cast<int>(value);
-#ifndef OS_WINDOWS
-   return setsockopt(mSock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
-#else
-   return setsockopt(mSock, SOL_SOCKET, SO_REUSEADDR, CPCHAR_WSCAST(&reuse), sizeof(reuse));
-#endif
+   auto group = SockAddr(GroupAddr);
+   if (group.size == 0)
+      return -1;
+
+   socketaddr source = {};
+   return groupJoin(source, group, IfIndex);
 }
 
 /**
- * @brief Send a igmp v2 join.
- *
- * You can send up to 10 igmp v2 request.
- * You can override IGMP_REQ_ARRAY_SIZE in the cmake cache to change this limitation. 
+ * @brief Send a igmp v3 join, or a MLD v2 join for an IPV6 group.
  * 
+ * @param sourceAddr : The source address of the specifed group address.
  * @param GroupAddr : The group address to join.
  * @param IfIndex : The interface index that should send the igmp join.
- * @return int : zero on success.
+ * @return int : zero on success, -1 with errno EADDRINUSE if already joined.
  */
-int SocketDGRAM::igmpJoin(const std::string &GroupAddr, int IfIndex)
+int SocketDGRAM::igmpJoin(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex)
 {
-   if (mreq_cnt < IGMP_REQ_ARRAY_SIZE)
-   {
-      auto saddr = SockAddr(GroupAddr);
-      if (saddr.size == 0)
-         return -1;
+   auto group = SockAddr(GroupAddr);
+   if (group.size == 0)
+      return -1;
 
-      mpreq[mreq_cnt].gr_group = saddr.ss;
-      mpreq[mreq_cnt].gr_interface = IfIndex;
-      int rc = setsockopt(mSock, IPPROTO_IP, MCAST_JOIN_GROUP, CPCHAR_WSCAST(&mpreq[mreq_cnt]), sizeof(mpreq[mreq_cnt]));
-      if (rc == 0)
-         mreq_cnt++;
-      return rc;
-   }
-   return -1;
+   auto source = SockAddr(sourceAddr);
+   if (source.size == 0)
+      return -1;
+
+   return groupJoin(source, group, IfIndex);
 }
 
 /**
- * @brief Send a igmp v3 join.
- * 
- * You can send up to 10 igmp v3 request.
- * You can override IGMP_REQ_ARRAY_SIZE in the cmake cache to change this limitation. 
+ * @brief Leave one group joined with igmpJoin(GroupAddr, IfIndex).
  *
- * @param sourceAddr : The source address of the specifed group address.
- * @param GroupAddr : The group address to join.
- * @param IfIndex : The interface index that should send the igmp join.
- * @return int : zero on success.
+ * @param GroupAddr : The group address to leave.
+ * @param IfIndex : The interface index of the join.
+ * @return int : zero on success, -1 with errno EADDRNOTAVAIL if not joined.
  */
-int SocketDGRAM::igmpJoin(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex)
+int SocketDGRAM::igmpLeave(const std::string &GroupAddr, int IfIndex)
 {
-   if (mreq_src_cnt < IGMP_REQ_ARRAY_SIZE)
-   {
-      auto GrpAddr = SockAddr(GroupAddr);
-      if (GrpAddr.size == 0)
-         return -1;
+   auto group = SockAddr(GroupAddr);
+   if (group.size == 0)
+      return -1;
 
-      auto srcAddr = SockAddr(sourceAddr);
-      if (srcAddr.size == 0)
-         return -1;
+   socketaddr source = {};
+   return groupLeave(source, group, IfIndex);
+}
 
-      mpreq_src[mreq_src_cnt].gsr_group = GrpAddr.ss;
-      mpreq_src[mreq_src_cnt].gsr_source = srcAddr.ss;
-      mpreq_src[mreq_src_cnt].gsr_interface = IfIndex;
+/**
+ * @brief Leave one group joined with igmpJoin(sourceAddr, GroupAddr, IfIndex).
+ *
+ * @param sourceAddr : The source address of the join.
+ * @param GroupAddr : The group address to leave.
+ * @param IfIndex : The interface index of the join.
+ * @return int : zero on success, -1 with errno EADDRNOTAVAIL if not joined.
+ */
+int SocketDGRAM::igmpLeave(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex)
+{
+   auto group = SockAddr(GroupAddr);
+   if (group.size == 0)
+      return -1;
 
-      int rc = setsockopt(mSock, IPPROTO_IP, MCAST_JOIN_SOURCE_GROUP, CPCHAR_WSCAST(&mpreq_src[mreq_src_cnt]), sizeof(mpreq_src[mreq_src_cnt]));
-      if (rc == 0)
-         mreq_src_cnt++;
-      return rc;
-   }
-   return -1;
+   auto source = SockAddr(sourceAddr);
+   if (source.size == 0)
+      return -1;
+
+   return groupLeave(source, group, IfIndex);
 }
 
 /**
@@ -169,12 +223,147 @@ int SocketDGRAM::igmpJoin(const std::string &sourceAddr, const std::string &Grou
 int SocketDGRAM::igmpLeave()
 {
    int rc = 0;
-   for (uint32_t i = 0; i < mreq_src_cnt; i++)
-      rc |= setsockopt(mSock, IPPROTO_IP, MCAST_LEAVE_SOURCE_GROUP, CPCHAR_WSCAST(&mpreq_src[i]), sizeof(mpreq_src[i]));
+   for (auto &item : mGroups)
+   {
+      auto &req = item.second;
+      int level = (req.gsr_group.ss_family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+      if (req.gsr_source.ss_family == AF_UNSPEC)
+      {
+         group_req greq = {};
+         greq.gr_interface = req.gsr_interface;
+         greq.gr_group = req.gsr_group;
+         rc |= setsockopt(mSock, level, MCAST_LEAVE_GROUP, CPCHAR_WSCAST(&greq), sizeof(greq));
+      }
+      else
+         rc |= setsockopt(mSock, level, MCAST_LEAVE_SOURCE_GROUP, CPCHAR_WSCAST(&req), sizeof(req));
+   }
+   mGroups.clear();
+   return rc;
+}
 
-   for (uint32_t i = 0; i < mreq_cnt; i++)
-      rc |= setsockopt(mSock, IPPROTO_IP, MCAST_LEAVE_GROUP, CPCHAR_WSCAST(&mpreq[i]), sizeof(mpreq[i]));
+/**
+ * @brief Set the kernel source filter of a joined group (MCAST_MSFILTER).
+ *
+ * The datagrams are filtered by the kernel, and the igmp v3 / MLD v2
+ * reports advertise the filter to the routers.
+ * The group must be joined with igmpJoin(GroupAddr, IfIndex).
+ *
+ * @param GroupAddr : The group address.
+ * @param IfIndex : The interface index of the join.
+ * @param include : true to only receive from the sources, false to block them.
+ * @param sourceAddrs : The source addresses, see the net.ipv4.igmp_max_msf sysctl.
+ * @return int : zero on success.
+ */
+int SocketDGRAM::setSourceFilter(const std::string &GroupAddr, int IfIndex, bool include, const std::vector<std::string> &sourceAddrs)
+{
+#ifdef MCAST_MSFILTER
+   auto group = SockAddr(GroupAddr);
+   if (group.size == 0)
+      return -1;
 
+   std::vector<uint8_t> buffer(GROUP_FILTER_SIZE(sourceAddrs.size() ? sourceAddrs.size() : 1));
+   auto filter = reinterpret_cast<group_filter *>(buffer.data());
+   filter->gf_interface = IfIndex;
+   filter->gf_group = group.ss;
+   filter->gf_fmode = include ? MCAST_INCLUDE : MCAST_EXCLUDE;
+   filter->gf_numsrc = static_cast<uint32_t>(sourceAddrs.size());
+   for (size_t i = 0; i < sourceAddrs.size(); i++)
+   {
+      auto source = SockAddr(sourceAddrs[i]);
+      if (source.size == 0)
+         return -1;
+      filter->gf_slist[i] = source.ss;
+   }
+
+   int level = (group.sa.sa_family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+   return setsockopt(mSock, level, MCAST_MSFILTER, CPCHAR_WSCAST(filter), static_cast<socklen_t>(GROUP_FILTER_SIZE(sourceAddrs.size())));
+#else
+   (void)GroupAddr;
+   (void)IfIndex;
+   (void)include;
+   (void)sourceAddrs;
+   errno = ENOPROTOOPT;
+   return -1;
+#endif
+}
+
+/**
+ * @brief Number of joined groups.
+ */
+size_t SocketDGRAM::groupCount() const noexcept
+{
+   return mGroups.size();
+}
+
+std::string SocketDGRAM::groupKey(const socketaddr &source, const socketaddr &group, int IfIndex)
+{
+   std::string key(reinterpret_cast<const char *>(&IfIndex), sizeof(IfIndex));
+   for (auto addr : {&group, &source})
+   {
+      if (addr->sa.sa_family == AF_INET)
+         key.append(reinterpret_cast<const char *>(&addr->s4.sin_addr), sizeof(addr->s4.sin_addr));
+      else if (addr->sa.sa_family == AF_INET6)
+         key.append(reinterpret_cast<const char *>(&addr->s6.sin6_addr), sizeof(addr->s6.sin6_addr));
+      key.push_back('|');
+   }
+   return key;
+}
+
+int SocketDGRAM::groupJoin(const socketaddr &source, const socketaddr &group, int IfIndex)
+{
+   auto key = groupKey(source, group, IfIndex);
+   if (mGroups.count(key))
+   {
+      errno = EADDRINUSE;
+      return -1;
+   }
+
+   group_source_req req = {};
+   req.gsr_interface = IfIndex;
+   req.gsr_group = group.ss;
+   req.gsr_source = source.ss;
+   req.gsr_source.ss_family = source.sa.sa_family;
+
+   int rc = 0;
+   int level = (group.sa.sa_family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+   if (source.sa.sa_family == AF_UNSPEC)
+   {
+      group_req greq = {};
+      greq.gr_interface = IfIndex;
+      greq.gr_group = group.ss;
+      rc = setsockopt(mSock, level, MCAST_JOIN_GROUP, CPCHAR_WSCAST(&greq), sizeof(greq));
+   }
+   else
+      rc = setsockopt(mSock, level, MCAST_JOIN_SOURCE_GROUP, CPCHAR_WSCAST(&req), sizeof(req));
+
+   if (rc == 0)
+      mGroups.emplace(std::move(key), req);
+   return rc;
+}
+
+int SocketDGRAM::groupLeave(const socketaddr &source, const socketaddr &group, int IfIndex)
+{
+   auto it = mGroups.find(groupKey(source, group, IfIndex));
+   if (it == mGroups.end())
+   {
+      errno = EADDRNOTAVAIL;
+      return -1;
+   }
+
+   int rc = 0;
+   auto &req = it->second;
+   int level = (group.sa.sa_family == AF_INET6) ? IPPROTO_IPV6 : IPPROTO_IP;
+   if (source.sa.sa_family == AF_UNSPEC)
+   {
+      group_req greq = {};
+      greq.gr_interface = req.gsr_interface;
+      greq.gr_group = req.gsr_group;
+      rc = setsockopt(mSock, level, MCAST_LEAVE_GROUP, CPCHAR_WSCAST(&greq), sizeof(greq));
+   }
+   else
+      rc = setsockopt(mSock, level, MCAST_LEAVE_SOURCE_GROUP, CPCHAR_WSCAST(&req), sizeof(req));
+
+   mGroups.erase(it);
    return rc;
 }
 
@@ -188,65 +377,95 @@ int SocketDGRAM::send(const void *buffer, uint32_t size) const noexcept
    if (buffer == nullptr || size == 0)
       return -1;
 
-   return sendto(mSock, CPCHAR_WSCAST(buffer), size, mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(buffer, size);
 }
 
 int SocketDGRAM::send(const std::string &binary) const noexcept
 {
-   return sendto(mSock, binary.data(), INT_WSCAST(binary.size()), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(binary.data(), static_cast<uint32_t>(binary.size()));
 }
 
 int SocketDGRAM::send(const char *txt) const noexcept
 {
    if (txt == nullptr)
       return -1;
-   return sendto(mSock, txt, INT_WSCAST(strlen(txt) + 1), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(txt, static_cast<uint32_t>(strlen(txt) + 1));
 }
 
 int SocketDGRAM::send(uint8_t data) const noexcept
 {
-   return sendto(mSock, CPCHAR_WSCAST(&data), sizeof(uint8_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&data, sizeof(uint8_t));
 }
 
 int SocketDGRAM::send(uint16_t data) const noexcept
 {
    uint16_t d = htons(data);
-   return sendto(mSock, CPCHAR_WSCAST(&d), sizeof(uint16_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&d, sizeof(uint16_t));
 }
 
 int SocketDGRAM::send(uint32_t data) const noexcept
 {
    uint32_t d = htonl(data);
-   return sendto(mSock, CPCHAR_WSCAST(&d), sizeof(uint32_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&d, sizeof(uint32_t));
 }
 
 int SocketDGRAM::send(uint64_t data) const noexcept
 {
    uint64_t d = htonll(data);
-   return sendto(mSock, CPCHAR_WSCAST(&d), sizeof(uint64_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&d, sizeof(uint64_t));
 }
 
 int SocketDGRAM::send(int8_t data) const noexcept
 {
-   return sendto(mSock, CPCHAR_WSCAST(&data), sizeof(int8_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&data, sizeof(int8_t));
 }
 
 int SocketDGRAM::send(int16_t data) const noexcept
 {
    int16_t d = htons(data);
-   return sendto(mSock, CPCHAR_WSCAST(&d), sizeof(int16_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&d, sizeof(int16_t));
 }
 
 int SocketDGRAM::send(int32_t data) const noexcept
 {
    int32_t d = htonl(data);
-   return sendto(mSock, CPCHAR_WSCAST(&d), sizeof(int32_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&d, sizeof(int32_t));
 }
 
 int SocketDGRAM::send(int64_t data) const noexcept
 {
    int64_t d = htonll(data);
-   return sendto(mSock, CPCHAR_WSCAST(&d), sizeof(int64_t), mSendFlags, &mAddr.sa, mAddr.size);
+   return sendData(&d, sizeof(int64_t));
+}
+
+/**
+ * @brief Send a datagram to an explicit destination.
+ *
+ * The internal sockaddr is neither used nor modified, so one socket can be
+ * shared by several sending threads and a receiving thread using
+ * recv(void*, uint32_t, socketaddr&).
+ *
+ * @param buffer : The payload.
+ * @param size : The payload size.
+ * @param dst : The destination, dst.size = 0 for the internal sockaddr or the connected peer.
+ * @return int : The number of bytes sent, -1 on error.
+ */
+int SocketDGRAM::send(const void *buffer, uint32_t size, const socketaddr &dst) const noexcept
+{
+   if (buffer == nullptr || size == 0)
+      return -1;
+
+   if (dst.size == 0)
+      return sendData(buffer, size);
+   return sendto(mSock, CPCHAR_WSCAST(buffer), size, mSendFlags, &dst.sa, dst.size);
+}
+
+int SocketDGRAM::sendData(const void *buffer, uint32_t size) const noexcept
+{
+   // A connected socket skips the per datagram route lookup of sendto
+   if (mConnected)
+      return ::send(mSock, CPCHAR_WSCAST(buffer), size, mSendFlags);
+   return sendto(mSock, CPCHAR_WSCAST(buffer), size, mSendFlags, &mAddr.sa, mAddr.size);
 }
 
 int SocketDGRAM::recv(msghdr &message) noexcept
@@ -259,7 +478,35 @@ int SocketDGRAM::recv(void *buffer, uint32_t size) noexcept
    if (buffer == nullptr || size == 0)
       return -1;
 
-   return recvfrom(mSock, PCHAR_WSCAST(buffer), size, mRecvFlags, &mAddr.sa, &mAddr.size);
+   int rc = recvfrom(mSock, PCHAR_WSCAST(buffer), size, mRecvFlags, &mAddr.sa, &mAddr.size);
+   if (mTracker != nullptr && rc > 0)
+      mTracker->update(buffer, static_cast<uint32_t>(rc));
+   return rc;
+}
+
+/**
+ * @brief Receive a datagram and its source address.
+ *
+ * Unlike the other recv methods, the internal sockaddr is not overwritten
+ * with the source address: concurrent sends from other threads are safe.
+ *
+ * @param buffer : The receive buffer.
+ * @param size : The buffer size.
+ * @param peer : The source address.
+ * @return int : The number of received bytes, -1 on error.
+ */
+int SocketDGRAM::recv(void *buffer, uint32_t size, socketaddr &peer) const noexcept
+{
+   if (buffer == nullptr || size == 0)
+      return -1;
+
+   peer.size = sizeof(peer.ss);
+   int rc = recvfrom(mSock, PCHAR_WSCAST(buffer), size, mRecvFlags, &peer.sa, &peer.size);
+   if (rc == -1)
+      peer.size = 0;
+   else if (mTracker != nullptr && rc > 0)
+      mTracker->update(buffer, static_cast<uint32_t>(rc));
+   return rc;
 }
 
 int SocketDGRAM::recv(uint8_t &data) noexcept
@@ -319,3 +566,625 @@ int SocketDGRAM::recv(int64_t &data) noexcept
    data = ntohll(d);
    return rc;
 }
+
+/**
+ * @brief Receive many datagrams with one syscall.
+ *
+ * Under Linux the datagrams are received with one recvmmsg call, at most
+ * MMSG_BATCH_SIZE per call. You can override MMSG_BATCH_SIZE in the cmake cache.
+ * On the other systems, recvfrom is called while datagrams are pending.
+ * The peer of each datagram is stored in its datagram struct, the
+ * internal sockaddr is left unchanged. The kernel receive timestamp is
+ * stored as well, when enabled with setTimestamping.
+ *
+ * @param msgs : An array of datagram, buffer and size must be set.
+ * @param count : The array size.
+ * @param timeoutMs : The time to wait for the first datagram in milli second(s), -1 to block.
+ * @return int : The number of received datagrams, 0 on timeout, -1 on error.
+ */
+int SocketDGRAM::recvBatch(datagram *msgs, uint32_t count, int timeoutMs /*=-1*/) noexcept
+{
+   if (msgs == nullptr || count == 0)
+      return -1;
+
+   int flags = mRecvFlags;
+   if (timeoutMs >= 0)
+   {
+      pollfd pfd;
+      pfd.fd = mSock;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int rc = poll(&pfd, 1, timeoutMs);
+      if (rc <= 0)
+         return rc;
+#ifdef MSG_DONTWAIT
+      flags |= MSG_DONTWAIT;
+#endif
+   }
+
+#ifdef __linux__
+   if (count > MMSG_BATCH_SIZE)
+      count = MMSG_BATCH_SIZE;
+
+   mmsghdr hdrs[MMSG_BATCH_SIZE];
+   iovec iovs[MMSG_BATCH_SIZE];
+   char controls[MMSG_BATCH_SIZE][CMSG_SPACE(sizeof(timespec) * 3) + CMSG_SPACE(sizeof(in6_pktinfo)) + CMSG_SPACE(sizeof(uint32_t))];
+   for (uint32_t i = 0; i < count; i++)
+   {
+      iovs[i].iov_base = msgs[i].buffer;
+      iovs[i].iov_len = msgs[i].size;
+      msgs[i].peer.size = sizeof(msgs[i].peer.ss);
+
+      memset(&hdrs[i], 0, sizeof(hdrs[i]));
+      hdrs[i].msg_hdr.msg_name = &msgs[i].peer.ss;
+      hdrs[i].msg_hdr.msg_namelen = msgs[i].peer.size;
+      hdrs[i].msg_hdr.msg_iov = &iovs[i];
+      hdrs[i].msg_hdr.msg_iovlen = 1;
+      hdrs[i].msg_hdr.msg_control = controls[i];
+      hdrs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+   }
+
+   // MSG_WAITFORONE : block for the first datagram only
+   int n = recvmmsg(mSock, hdrs, count, flags | MSG_WAITFORONE, nullptr);
+   for (int i = 0; i < n; i++)
+   {
+      msgs[i].length = hdrs[i].msg_len;
+      msgs[i].truncated = (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+      msgs[i].peer.size = hdrs[i].msg_hdr.msg_namelen;
+      msgs[i].stamp = {};
+      timestamp(hdrs[i].msg_hdr, msgs[i].stamp);
+      destination(hdrs[i].msg_hdr, msgs[i].dst, msgs[i].ifIndex);
+   }
+   if (mTracker != nullptr && n > 0)
+   {
+      for (int i = 0; i < n; i++)
+         mTracker->update(msgs[i].buffer, msgs[i].length);
+      uint32_t drops;
+      if (kernelDrops(hdrs[n - 1].msg_hdr, drops))
+         mTracker->setKernelDrops(drops);
+   }
+   return n;
+
+#else
+   uint32_t n = 0;
+   while (n < count)
+   {
+      auto &msg = msgs[n];
+      msg.peer.size = sizeof(msg.peer.ss);
+      int rc = recvfrom(mSock, PCHAR_WSCAST(msg.buffer), msg.size, flags, &msg.peer.sa, &msg.peer.size);
+      if (rc == -1)
+      {
+#ifdef OS_WINDOWS
+         if (WSAGetLastError() == WSAEMSGSIZE)
+         {
+            msg.length = msg.size;
+            msg.truncated = true;
+            n++;
+            continue;
+         }
+#endif
+         break;
+      }
+      msg.length = rc;
+      msg.truncated = false;
+      msg.stamp = {};
+      msg.dst.size = 0;
+      msg.ifIndex = 0;
+      if (mTracker != nullptr)
+         mTracker->update(msg.buffer, msg.length);
+      n++;
+
+      // The next datagrams are only read if already queued
+      pollfd pfd;
+      pfd.fd = mSock;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 0) <= 0)
+         break;
+   }
+   return n > 0 ? (int)n : -1;
+#endif
+}
+
+/**
+ * @brief Send many datagrams with one syscall.
+ *
+ * Under Linux the datagrams are sent with sendmmsg, MMSG_BATCH_SIZE per call.
+ * On the other systems, sendto is called for each datagram.
+ * Each datagram is sent to its peer address, or to the internal sockaddr
+ * when peer.size is zero.
+ *
+ * When the socket buffer is full (non-blocking socket) or a datagram fails,
+ * the number of datagrams already sent is returned, so the caller can resume
+ * from msgs + n.
+ *
+ * @param msgs : An array of datagram, buffer, length and peer must be set.
+ * @param count : The array size.
+ * @return int : The number of sent datagrams, -1 if the first one failed.
+ */
+int SocketDGRAM::sendBatch(const datagram *msgs, uint32_t count) const noexcept
+{
+   if (msgs == nullptr || count == 0)
+      return -1;
+
+#ifdef __linux__
+   mmsghdr hdrs[MMSG_BATCH_SIZE];
+   iovec iovs[MMSG_BATCH_SIZE];
+
+   uint32_t sent = 0;
+   while (sent < count)
+   {
+      uint32_t batch = count - sent;
+      if (batch > MMSG_BATCH_SIZE)
+         batch = MMSG_BATCH_SIZE;
+
+      for (uint32_t i = 0; i < batch; i++)
+      {
+         const auto &msg = msgs[sent + i];
+         const auto &dst = (msg.peer.size != 0) ? msg.peer : mAddr;
+         iovs[i].iov_base = msg.buffer;
+         iovs[i].iov_len = msg.length;
+
+         memset(&hdrs[i], 0, sizeof(hdrs[i]));
+         if (msg.peer.size != 0 || !mConnected)
+         {
+            hdrs[i].msg_hdr.msg_name = (void *)&dst.ss;
+            hdrs[i].msg_hdr.msg_namelen = dst.size;
+         }
+         hdrs[i].msg_hdr.msg_iov = &iovs[i];
+         hdrs[i].msg_hdr.msg_iovlen = 1;
+      }
+
+      int n = sendmmsg(mSock, hdrs, batch, mSendFlags);
+      if (n == -1)
+         return sent > 0 ? (int)sent : -1;
+
+      sent += n;
+      if ((uint32_t)n < batch)
+         break; // partial completion
+   }
+   return sent;
+
+#else
+   uint32_t sent = 0;
+   for (; sent < count; sent++)
+   {
+      const auto &msg = msgs[sent];
+      int rc = (msg.peer.size != 0) ? sendto(mSock, CPCHAR_WSCAST(msg.buffer), msg.length, mSendFlags, &msg.peer.sa, msg.peer.size)
+                                    : sendData(msg.buffer, msg.length);
+      if (rc == -1)
+         break;
+   }
+   return sent > 0 ? (int)sent : -1;
+#endif
+}
+
+/**
+ * @brief Set the UDP Generic Segmentation Offload size (UDP_SEGMENT).
+ *
+ * Once set, each send larger than segmentSize is split by the kernel,
+ * or by the NIC, in datagrams of segmentSize bytes, the last one may be shorter.
+ * Linux only, available since linux 4.18.
+ *
+ * @param segmentSize : The datagram payload size, zero to disable.
+ * @return int : zero on success.
+ */
+int SocketDGRAM::setSegmentSize(uint16_t segmentSize) noexcept
+{
+#ifdef __linux__
+   int value = segmentSize;
+   return setsockopt(mSock, IPPROTO_UDP, UDP_SEGMENT, &value, sizeof(value));
+#else
+   (void)segmentSize;
+   errno = ENOPROTOOPT;
+   return -1;
+#endif
+}
+
+/**
+ * @brief Send a large buffer as many datagrams of segmentSize bytes.
+ *
+ * Under Linux the segment size is passed with a UDP_SEGMENT cmsg, so the
+ * kernel splits the buffer, each sendmsg carrying up to 64 segments.
+ * When GSO is not available (old kernel, other systems) or is refused,
+ * the buffer is split in user space and sent with sendBatch.
+ *
+ * @param buffer : The payload.
+ * @param size : The payload size.
+ * @param segmentSize : The datagram payload size.
+ * @param dst : The destination, nullptr for the internal sockaddr.
+ * @return int : The number of bytes sent, -1 if nothing was sent.
+ */
+int SocketDGRAM::sendSegments(const void *buffer, uint32_t size, uint16_t segmentSize, const socketaddr *dst /*=nullptr*/) noexcept
+{
+   if (buffer == nullptr || size == 0 || segmentSize == 0)
+      return -1;
+
+   // A zero size addr : the connected peer, see connect()
+   const socketaddr none = {};
+   const auto &addr = (dst != nullptr) ? *dst : (mConnected ? none : mAddr);
+   auto pbuff = static_cast<const uint8_t *>(buffer);
+
+#ifdef __linux__
+   uint32_t perCall = GSO_MAX_PAYLOAD / segmentSize;
+   if (perCall > GSO_MAX_SEGMENTS)
+      perCall = GSO_MAX_SEGMENTS;
+   perCall *= segmentSize;
+
+   uint32_t sent = 0;
+   while (mGSO && sent < size && perCall > 0)
+   {
+      uint32_t len = size - sent;
+      if (len > perCall)
+         len = perCall;
+
+      iovec iov;
+      iov.iov_base = (void *)(pbuff + sent);
+      iov.iov_len = len;
+
+      char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+      msghdr msg = {};
+      msg.msg_name = (addr.size != 0) ? (void *)&addr.ss : nullptr;
+      msg.msg_namelen = addr.size;
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = IPPROTO_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+
+      ssize_t rc = sendmsg(mSock, &msg, mSendFlags);
+      if (rc == -1)
+      {
+         // No GSO support : switch to the user space fallback
+         if (errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP || errno == EIO)
+         {
+            mGSO = false;
+            break;
+         }
+         return sent > 0 ? (int)sent : -1;
+      }
+      sent += static_cast<uint32_t>(rc);
+   }
+   if (sent == size)
+      return sent;
+
+   int rc = sendSegmentsFallback(pbuff + sent, size - sent, segmentSize, addr);
+   if (rc == -1)
+      return sent > 0 ? (int)sent : -1;
+   return sent + rc;
+
+#else
+   return sendSegmentsFallback(pbuff, size, segmentSize, addr);
+#endif
+}
+
+/**
+ * @brief Test if the UDP_SEGMENT sends are enabled.
+ *
+ * @return false : A previous sendSegments got an error from the kernel and
+ *                 switched to the user space fallback.
+ */
+bool SocketDGRAM::hasGSO() const noexcept
+{
+#ifdef __linux__
+   return mGSO;
+#else
+   return false;
+#endif
+}
+
+int SocketDGRAM::sendSegmentsFallback(const uint8_t *buffer, uint32_t size, uint16_t segmentSize, const socketaddr &dst) noexcept
+{
+   datagram msgs[MMSG_BATCH_SIZE];
+
+   uint32_t sent = 0;
+   while (sent < size)
+   {
+      uint32_t n = 0;
+      uint32_t offset = sent;
+      while (n < MMSG_BATCH_SIZE && offset < size)
+      {
+         uint32_t len = size - offset;
+         if (len > segmentSize)
+            len = segmentSize;
+
+         msgs[n].buffer = (void *)(buffer + offset);
+         msgs[n].length = len;
+         msgs[n].peer = dst;
+         offset += len;
+         n++;
+      }
+
+      int rc = sendBatch(msgs, n);
+      if (rc == -1)
+         return sent > 0 ? (int)sent : -1;
+
+      for (int i = 0; i < rc; i++)
+         sent += msgs[i].length;
+      if ((uint32_t)rc < n)
+         break;
+   }
+   return sent;
+}
+
+/**
+ * @brief Enable the UDP Generic Receive Offload (UDP_GRO).
+ *
+ * The kernel coalesces the datagrams of one flow in a single buffer,
+ * use recvSegments to get them back. Linux only, available since linux 5.0.
+ * The socket receive buffer should be large, see SO_RCVBUF.
+ *
+ * @param on : true to enable.
+ * @return int : zero on success.
+ */
+int SocketDGRAM::enableGRO(bool on /*=true*/) noexcept
+{
+#ifdef __linux__
+   int value = on ? 1 : 0;
+   return setsockopt(mSock, IPPROTO_UDP, UDP_GRO, &value, sizeof(value));
+#else
+   (void)on;
+   errno = ENOPROTOOPT;
+   return -1;
+#endif
+}
+
+/**
+ * @brief Receive a GRO buffer and split it in datagram views.
+ *
+ * The views point into buffer, no data is copied. All the segments of a GRO
+ * buffer come from the same peer, they have the same size except the last one.
+ * Without GRO, one datagram is received. The kernel coalesces up to 64
+ * segments, buffer should be 64 times the segment size, 64KB is enough.
+ * When count is too small, the last view covers the remaining segments
+ * and is flagged truncated.
+ *
+ * @param buffer : The receive buffer.
+ * @param size : The buffer size.
+ * @param segments : An array of datagram filled with the views.
+ * @param count : The array size.
+ * @param timeoutMs : The time to wait in milli second(s), -1 to block.
+ * @return int : The number of views, 0 on timeout, -1 on error.
+ */
+int SocketDGRAM::recvSegments(void *buffer, uint32_t size, datagram *segments, uint32_t count, int timeoutMs /*=-1*/) noexcept
+{
+   if (buffer == nullptr || size == 0 || segments == nullptr || count == 0)
+      return -1;
+
+   if (timeoutMs >= 0)
+   {
+      pollfd pfd;
+      pfd.fd = mSock;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int rc = poll(&pfd, 1, timeoutMs);
+      if (rc <= 0)
+         return rc;
+   }
+
+   socketaddr peer = {};
+   peer.size = sizeof(peer.ss);
+
+   iovec iov;
+   iov.iov_base = buffer;
+   iov.iov_len = size;
+
+   char control[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(timespec) * 3) + CMSG_SPACE(sizeof(in6_pktinfo)) + CMSG_SPACE(sizeof(uint32_t))] = {};
+   msghdr msg = {};
+   msg.msg_name = &peer.ss;
+   msg.msg_namelen = peer.size;
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+
+   int flags = mRecvFlags;
+#ifdef MSG_DONTWAIT
+   if (timeoutMs >= 0)
+      flags |= MSG_DONTWAIT;
+#endif
+   ssize_t len = recvmsg(mSock, &msg, flags);
+   if (len == -1)
+      return -1;
+   peer.size = msg.msg_namelen;
+
+   timespec stamp = {};
+   timestamp(msg, stamp);
+
+   socketaddr dst = {};
+   int ifIndex = 0;
+   destination(msg, dst, ifIndex);
+
+   uint32_t total = static_cast<uint32_t>(len);
+   uint32_t gso = static_cast<uint32_t>(segmentSize(msg));
+   if (gso == 0 || gso > total)
+      gso = total;
+
+   auto pbuff = static_cast<uint8_t *>(buffer);
+   uint32_t offset = 0;
+   uint32_t n = 0;
+   while (offset < total || n == 0)
+   {
+      auto &segment = segments[n];
+      uint32_t remain = total - offset;
+      segment.buffer = pbuff + offset;
+      segment.length = (remain < gso) ? remain : gso;
+      segment.size = segment.length;
+      segment.truncated = false;
+      segment.peer = peer;
+      segment.stamp = stamp;
+      segment.dst = dst;
+      segment.ifIndex = ifIndex;
+      if (n == count - 1 && remain > gso)
+      {
+         segment.length = segment.size = remain;
+         segment.truncated = true;
+      }
+      offset += segment.length;
+      n++;
+   }
+   if (msg.msg_flags & MSG_TRUNC)
+      segments[n - 1].truncated = true;
+
+   if (mTracker != nullptr)
+   {
+      for (uint32_t i = 0; i < n; i++)
+         mTracker->update(segments[i].buffer, segments[i].length);
+      uint32_t drops;
+      if (kernelDrops(msg, drops))
+         mTracker->setKernelDrops(drops);
+   }
+   return n;
+}
+
+/**
+ * @brief Extract the UDP_GRO segment size from the control messages.
+ *
+ * @param message : A message received with recv(msghdr&), with a control buffer.
+ * @return int : The segment size, 0 if the message is not a GRO buffer.
+ */
+int SocketDGRAM::segmentSize(const msghdr &message) noexcept
+{
+#ifdef __linux__
+   for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR((msghdr *)&message, cmsg))
+   {
+      if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+      {
+         int value = 0;
+         memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+         return value;
+      }
+   }
+#else
+   (void)message;
+#endif
+   return 0;
+}
+
+/**
+ * @brief Enable the destination address and interface of the received datagrams.
+ *
+ * Sets IP_PKTINFO, and IPV6_RECVPKTINFO for an IPV6 socket. recvBatch and
+ * recvSegments then fill datagram.dst and datagram.ifIndex, so one socket
+ * bound to the any address can receive many multicast groups and tell
+ * them apart, see MulticastDemux.
+ * Linux only.
+ *
+ * @param on : Enable or disable.
+ * @return int : zero on success.
+ */
+int SocketDGRAM::enablePktInfo(bool on /*=true*/) noexcept
+{
+#ifdef __linux__
+   int value = on ? 1 : 0;
+   if (mDomain == AF_INET6)
+   {
+      if (setsockopt(mSock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &value, sizeof(value)) == -1)
+         return -1;
+      // The IPV4 datagrams of a dual stack socket come with an IP_PKTINFO,
+      // this fails on an IPV6 only socket.
+      setsockopt(mSock, IPPROTO_IP, IP_PKTINFO, &value, sizeof(value));
+      return 0;
+   }
+   return setsockopt(mSock, IPPROTO_IP, IP_PKTINFO, &value, sizeof(value));
+#else
+   (void)on;
+   errno = ENOPROTOOPT;
+   return -1;
+#endif
+}
+
+/**
+ * @brief Extract the destination address and the interface index from the control messages.
+ *
+ * @param message : A message received with recv(msghdr&), with a control buffer.
+ * @param dst : The destination address, the port is zero, dst.size = 0 if not found.
+ * @param ifIndex : The receiving interface index, zero if not found.
+ * @return true : The message has an IP_PKTINFO or IPV6_PKTINFO.
+ */
+bool SocketDGRAM::destination(const msghdr &message, socketaddr &dst, int &ifIndex) noexcept
+{
+   dst.size = 0;
+   ifIndex = 0;
+#ifdef __linux__
+   for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR((msghdr *)&message, cmsg))
+   {
+      if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+      {
+         in_pktinfo info;
+         memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+         memset(&dst.s4, 0, sizeof(dst.s4));
+         dst.s4.sin_family = AF_INET;
+         dst.s4.sin_addr = info.ipi_addr;
+         dst.size = sizeof(dst.s4);
+         ifIndex = info.ipi_ifindex;
+         return true;
+      }
+      if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO)
+      {
+         in6_pktinfo info;
+         memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+         memset(&dst.s6, 0, sizeof(dst.s6));
+         dst.s6.sin6_family = AF_INET6;
+         dst.s6.sin6_addr = info.ipi6_addr;
+         dst.size = sizeof(dst.s6);
+         ifIndex = static_cast<int>(info.ipi6_ifindex);
+         return true;
+      }
+   }
+#else
+   (void)message;
+#endif
+   return false;
+}
+
+/**
+ * @brief Account the received datagrams in a SequenceTracker.
+ *
+ * recv(void*, uint32_t), recvBatch and recvSegments update the tracker.
+ * The SO_RXQ_OVFL option is set, so recvBatch and recvSegments also read
+ * the kernel drop counter (Linux only).
+ *
+ * @param tracker : The tracker, it must outlive the socket, nullptr to disable.
+ * @return int : zero on success.
+ */
+int SocketDGRAM::setSequenceTracker(SequenceTracker *tracker) noexcept
+{
+   mTracker = tracker;
+#ifdef SO_RXQ_OVFL
+   int value = (tracker != nullptr) ? 1 : 0;
+   return setsockopt(mSock, SOL_SOCKET, SO_RXQ_OVFL, &value, sizeof(value));
+#else
+   return 0;
+#endif
+}
+
+/**
+ * @brief Extract the SO_RXQ_OVFL drop counter from the control messages.
+ *
+ * @param message : A message received with recv(msghdr&), with a control buffer.
+ * @param drops : The number of datagrams dropped by the kernel since the socket creation.
+ * @return true : The message has a SO_RXQ_OVFL.
+ */
+bool SocketDGRAM::kernelDrops(const msghdr &message, uint32_t &drops) noexcept
+{
+#ifdef SO_RXQ_OVFL
+   for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR((msghdr *)&message, cmsg))
+   {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+      {
+         memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+         return true;
+      }
+   }
+#else
+   (void)message;
+#endif
+   drops = 0;
+   return false;
+}
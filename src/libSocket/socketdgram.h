@@ -12,22 +12,50 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+#include <unordered_map>
 #include "socket.h"
 
+class SequenceTracker;
+
+/// One datagram of a batch, the buffer is owned by the caller.
+struct datagram {
+   void       *buffer;     ///< The payload.
+   uint32_t    size;       ///< The buffer size.
+   uint32_t    length;     ///< The received length, or the length to send.
+   bool        truncated;  ///< The datagram was larger than the buffer.
+   socketaddr  peer;       ///< The source address, or the destination, peer.size = 0 for the socket address.
+   timespec    stamp;      ///< The kernel receive timestamp, zero if not enabled, see setTimestamping.
+   socketaddr  dst;        ///< The destination address, dst.size = 0 if not enabled, see enablePktInfo.
+   int         ifIndex;    ///< The receiving interface index, zero if not enabled, see enablePktInfo.
+};
+
 class LIBSOCKET_EXPORT SocketDGRAM : public Socket
 {
 public:
    SocketDGRAM(int domain = AF_UNSPEC, int proto = IPPROTO_UDP);
    SocketDGRAM(int domain, int type, int proto);
+   SocketDGRAM(const SocketDGRAM &) = delete;
+   SocketDGRAM(SocketDGRAM &&) noexcept = default;
+   SocketDGRAM &operator=(const SocketDGRAM &) = delete;
+   SocketDGRAM &operator=(SocketDGRAM &&) noexcept = default;
    ~SocketDGRAM();
 
+   int connect() noexcept;
+   int disconnect() noexcept;
+   bool isConnected() const noexcept;
+
    int enableBroadcast() noexcept;
    int setMulticastTTL(uint8_t value) noexcept;
-   int setReusePort(bool value = true) noexcept;
 
    int igmpJoin(const std::string &GroupAddr, int IfIndex);
    int igmpJoin(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex);
+   int igmpLeave(const std::string &GroupAddr, int IfIndex);
+   int igmpLeave(const std::string &sourceAddr, const std::string &GroupAddr, int IfIndex);
    int igmpLeave();
+   int setSourceFilter(const std::string &GroupAddr, int IfIndex, bool include, const std::vector<std::string> &sourceAddrs);
+   size_t groupCount() const noexcept;
 
    int send(const msghdr &message) const noexcept override;
    int send(const void *buffer, uint32_t size) const noexcept override;
@@ -41,6 +69,7 @@ public:
    int send(int16_t data) const noexcept override;
    int send(int32_t data) const noexcept override;
    int send(int64_t data) const noexcept override;
+   int send(const void *buffer, uint32_t size, const socketaddr &dst) const noexcept;
 
    int recv(msghdr &message) noexcept override;
    int recv(void *buffer, uint32_t size) noexcept override;
@@ -52,10 +81,36 @@ public:
    int recv(int16_t &data) noexcept override;
    int recv(int32_t &data) noexcept override;
    int recv(int64_t &data) noexcept override;
+   int recv(void *buffer, uint32_t size, socketaddr &peer) const noexcept;
+
+   int recvBatch(datagram *msgs, uint32_t count, int timeoutMs = -1) noexcept;
+   int sendBatch(const datagram *msgs, uint32_t count) const noexcept;
+
+   int setSegmentSize(uint16_t segmentSize) noexcept;
+   int sendSegments(const void *buffer, uint32_t size, uint16_t segmentSize, const socketaddr *dst = nullptr) noexcept;
+   bool hasGSO() const noexcept;
+
+   int enableGRO(bool on = true) noexcept;
+   int recvSegments(void *buffer, uint32_t size, datagram *segments, uint32_t count, int timeoutMs = -1) noexcept;
+   static int segmentSize(const msghdr &message) noexcept;
+
+   int enablePktInfo(bool on = true) noexcept;
+   static bool destination(const msghdr &message, socketaddr &dst, int &ifIndex) noexcept;
+
+   int setSequenceTracker(SequenceTracker *tracker) noexcept;
+   static bool kernelDrops(const msghdr &message, uint32_t &drops) noexcept;
 
 private:
-   uint32_t mreq_cnt = 0;
-   uint32_t mreq_src_cnt = 0;
-   group_req* mpreq = nullptr;
-   group_source_req* mpreq_src = nullptr;
+   int sendData(const void *buffer, uint32_t size) const noexcept;
+   int sendSegmentsFallback(const uint8_t *buffer, uint32_t size, uint16_t segmentSize, const socketaddr &dst) noexcept;
+
+   static std::string groupKey(const socketaddr &source, const socketaddr &group, int IfIndex);
+   int groupJoin(const socketaddr &source, const socketaddr &group, int IfIndex);
+   int groupLeave(const socketaddr &source, const socketaddr &group, int IfIndex);
+
+   bool mGSO = true;
+   SequenceTracker *mTracker = nullptr;
+
+   /// The joined (source, group, interface), the source family is AF_UNSPEC for an any source join.
+   std::unordered_map<std::string, group_source_req> mGroups;
 };
@@ -0,0 +1,453 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : socketfilter.cpp
+// Contents  : classic BPF socket filter builder implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+
+#include "socketfilter.h"
+
+namespace
+{
+   // The symbolic jump targets, resolved by link()
+   const int NEXT = -1;
+   const int ACCEPT = -2;
+   const int REJECT = -3;
+   const int IPV6 = -4;
+
+   /// A tiny classic BPF assembler, the jump targets are absolute indexes or symbols.
+   class Assembler
+   {
+   public:
+      void stmt(uint16_t code, uint32_t k)
+      {
+         mCode.push_back({{code, 0, 0, k}, NEXT, NEXT});
+      }
+
+      void jump(uint16_t code, uint32_t k, int jt, int jf = NEXT)
+      {
+         mCode.push_back({{code, 0, 0, k}, jt, jf});
+      }
+
+      // A = the packet data at offset from the network header
+      void ldNet(uint16_t size, uint32_t offset)
+      {
+         stmt(BPF_LD | size | BPF_ABS, static_cast<uint32_t>(SKF_NET_OFF) + offset);
+      }
+
+      // A = the skb metadata
+      void ldAux(int32_t ad)
+      {
+         stmt(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + ad));
+      }
+
+      void jeq(uint32_t k, int jt = NEXT, int jf = REJECT)
+      {
+         jump(BPF_JMP | BPF_JEQ | BPF_K, k, jt, jf);
+      }
+
+      int here() const noexcept
+      {
+         return static_cast<int>(mCode.size());
+      }
+
+      void markIpv6() noexcept
+      {
+         mIpv6 = here();
+      }
+
+      bool link(uint32_t snapLength, std::vector<sock_filter> &out) const
+      {
+         const int accept = here();
+         const int reject = accept + 1;
+         out.clear();
+         for (int i = 0; i < here(); i++)
+         {
+            sock_filter op = mCode[i].op;
+            if (BPF_CLASS(op.code) == BPF_JMP)
+            {
+               int jt = offset(i, mCode[i].jt, accept, reject);
+               int jf = offset(i, mCode[i].jf, accept, reject);
+               if (BPF_OP(op.code) == BPF_JA)
+                  op.k = static_cast<uint32_t>(jt);
+               else if (jt > 255 || jf > 255)
+                  return false;
+               else
+               {
+                  op.jt = static_cast<uint8_t>(jt);
+                  op.jf = static_cast<uint8_t>(jf);
+               }
+            }
+            out.push_back(op);
+         }
+         out.push_back({BPF_RET | BPF_K, 0, 0, snapLength});
+         out.push_back({BPF_RET | BPF_K, 0, 0, 0});
+         return true;
+      }
+
+   private:
+      struct Insn
+      {
+         sock_filter op;
+         int jt;
+         int jf;
+      };
+
+      int offset(int index, int target, int accept, int reject) const noexcept
+      {
+         switch (target)
+         {
+            case NEXT:   target = index + 1; break;
+            case ACCEPT: target = accept; break;
+            case REJECT: target = reject; break;
+            case IPV6:   target = mIpv6; break;
+            default: break;
+         }
+         return target - (index + 1);
+      }
+
+      std::vector<Insn> mCode;
+      int mIpv6 = -1;
+   };
+}
+
+/**
+ * @brief Match the ethernet protocol.
+ *
+ * @param type : ETH_P_IP, ETH_P_IPV6, ETH_P_ARP..., host order.
+ */
+SocketFilter &SocketFilter::etherType(uint16_t type) noexcept
+{
+   mFields |= ETHER_TYPE;
+   mEtherType = type;
+   return *this;
+}
+
+/**
+ * @brief Match the VLAN id, the tag is read from the skb metadata.
+ *
+ * @param id : The VLAN id, 12 bits.
+ */
+SocketFilter &SocketFilter::vlan(uint16_t id) noexcept
+{
+   mFields |= VLAN;
+   mVlan = id & 0x0FFF;
+   return *this;
+}
+
+/**
+ * @brief Match the IP protocol, the IPv6 next header.
+ *
+ * @param protocol : IPPROTO_UDP, IPPROTO_TCP...
+ */
+SocketFilter &SocketFilter::ipProtocol(uint8_t protocol) noexcept
+{
+   mFields |= PROTOCOL;
+   mProtocol = protocol;
+   return *this;
+}
+
+/**
+ * @brief Match the IPv4 or IPv6 source address.
+ */
+SocketFilter &SocketFilter::srcHost(const std::string &addr) noexcept
+{
+   if (parseHost(addr, mSrcHost))
+      mFields |= SRC_HOST;
+   return *this;
+}
+
+/**
+ * @brief Match the IPv4 or IPv6 destination address, a multicast group for example.
+ */
+SocketFilter &SocketFilter::dstHost(const std::string &addr) noexcept
+{
+   if (parseHost(addr, mDstHost))
+      mFields |= DST_HOST;
+   return *this;
+}
+
+/**
+ * @brief Match the source or the destination address.
+ */
+SocketFilter &SocketFilter::host(const std::string &addr) noexcept
+{
+   if (parseHost(addr, mHost))
+      mFields |= HOST;
+   return *this;
+}
+
+/**
+ * @brief Match the TCP, UDP or SCTP source port.
+ */
+SocketFilter &SocketFilter::srcPort(uint16_t port) noexcept
+{
+   mFields |= SRC_PORT;
+   mSrcPort = port;
+   return *this;
+}
+
+/**
+ * @brief Match the TCP, UDP or SCTP destination port.
+ */
+SocketFilter &SocketFilter::dstPort(uint16_t port) noexcept
+{
+   mFields |= DST_PORT;
+   mDstPort = port;
+   return *this;
+}
+
+/**
+ * @brief Match the source or the destination port.
+ */
+SocketFilter &SocketFilter::port(uint16_t port) noexcept
+{
+   mFields |= PORT;
+   mPort = port;
+   return *this;
+}
+
+/**
+ * @brief The number of bytes of a matching packet kept, the whole packet by default.
+ */
+SocketFilter &SocketFilter::snapLength(uint32_t length) noexcept
+{
+   mSnapLength = length;
+   return *this;
+}
+
+/**
+ * @brief Compile the criteria into a classic BPF program.
+ *
+ * Without criteria the program accepts everything.
+ *
+ * @return std::vector<sock_filter> : The program, empty with errno EINVAL if a criterion is invalid.
+ */
+std::vector<sock_filter> SocketFilter::compile() const
+{
+   std::vector<sock_filter> code;
+   if (mError != 0)
+   {
+      errno = mError;
+      return code;
+   }
+
+   const uint32_t hosts = SRC_HOST | DST_HOST | HOST;
+   const uint32_t ports = SRC_PORT | DST_PORT | PORT;
+   bool needIp = (mFields & (PROTOCOL | hosts | ports)) != 0;
+   bool v4 = true;
+   bool v6 = true;
+   for (const Host *h : {&mSrcHost, &mDstHost, &mHost})
+   {
+      if (h->family == AF_INET)
+         v6 = false;
+      else if (h->family == AF_INET6)
+         v4 = false;
+   }
+   if (mFields & ETHER_TYPE)
+   {
+      v4 &= (mEtherType == ETH_P_IP);
+      v6 &= (mEtherType == ETH_P_IPV6);
+   }
+   if (needIp && !v4 && !v6)
+   {
+      // Contradictory criteria, nothing matches
+      code.push_back({BPF_RET | BPF_K, 0, 0, 0});
+      return code;
+   }
+
+   Assembler a;
+   if (mFields & VLAN)
+   {
+      a.ldAux(SKF_AD_VLAN_TAG_PRESENT);
+      a.jeq(0, REJECT, NEXT);
+      a.ldAux(SKF_AD_VLAN_TAG);
+      a.stmt(BPF_ALU | BPF_AND | BPF_K, 0x0FFF);
+      a.jeq(mVlan);
+   }
+
+   if (mFields & ETHER_TYPE)
+   {
+      a.ldAux(SKF_AD_PROTOCOL);
+      a.jeq(mEtherType);
+   }
+   else if (needIp)
+   {
+      a.ldAux(SKF_AD_PROTOCOL);
+      if (v4 && v6)
+      {
+         a.jeq(ETH_P_IPV6, IPV6, NEXT);
+         a.jeq(ETH_P_IP);
+      }
+      else
+         a.jeq(v4 ? ETH_P_IP : ETH_P_IPV6);
+   }
+
+   // The IPv4 and IPv6 field offsets, from the network header
+   auto ipBlock = [&](bool ipv6) {
+      const uint32_t protoOff = ipv6 ? 6 : 9;
+      const uint32_t srcOff = ipv6 ? 8 : 12;
+      const uint32_t dstOff = ipv6 ? 24 : 16;
+
+      if (mFields & PROTOCOL)
+      {
+         a.ldNet(BPF_B, protoOff);
+         a.jeq(mProtocol);
+      }
+      else if (mFields & ports)
+      {
+         // Only the protocols with ports
+         a.ldNet(BPF_B, protoOff);
+         int p = a.here();
+         a.jeq(IPPROTO_TCP, p + 3, NEXT);
+         a.jeq(IPPROTO_UDP, p + 3, NEXT);
+         a.jeq(IPPROTO_SCTP);
+      }
+
+      // Each address word is a load and a compare
+      auto address = [&](uint32_t offset, const Host &h, int jt, int jf) {
+         uint32_t n = ipv6 ? 4 : 1;
+         for (uint32_t i = 0; i < n; i++)
+         {
+            a.ldNet(BPF_W, offset + 4 * i);
+            a.jeq(h.words[i], (i + 1 == n) ? jt : NEXT, jf);
+         }
+      };
+      if (mFields & SRC_HOST)
+         address(srcOff, mSrcHost, NEXT, REJECT);
+      if (mFields & DST_HOST)
+         address(dstOff, mDstHost, NEXT, REJECT);
+      if (mFields & HOST)
+      {
+         int n = ipv6 ? 4 : 1;
+         int p = a.here();
+         address(srcOff, mHost, p + 4 * n, p + 2 * n);
+         address(dstOff, mHost, NEXT, REJECT);
+      }
+
+      if (mFields & ports)
+      {
+         // The transport header offset, X for IPv4, fixed for IPv6
+         uint16_t mode = BPF_ABS;
+         uint32_t base = static_cast<uint32_t>(SKF_NET_OFF) + 40;
+         if (!ipv6)
+         {
+            a.ldNet(BPF_H, 6);
+            a.jump(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, REJECT, NEXT);
+            a.stmt(BPF_LDX | BPF_B | BPF_MSH, static_cast<uint32_t>(SKF_NET_OFF));
+            mode = BPF_IND;
+            base = static_cast<uint32_t>(SKF_NET_OFF);
+         }
+         if (mFields & SRC_PORT)
+         {
+            a.stmt(BPF_LD | BPF_H | mode, base);
+            a.jeq(mSrcPort);
+         }
+         if (mFields & DST_PORT)
+         {
+            a.stmt(BPF_LD | BPF_H | mode, base + 2);
+            a.jeq(mDstPort);
+         }
+         if (mFields & PORT)
+         {
+            int p = a.here();
+            a.stmt(BPF_LD | BPF_H | mode, base);
+            a.jeq(mPort, p + 4, NEXT);
+            a.stmt(BPF_LD | BPF_H | mode, base + 2);
+            a.jeq(mPort);
+         }
+      }
+   };
+
+   if (needIp && v4)
+   {
+      ipBlock(false);
+      if (v6)
+         a.jump(BPF_JMP | BPF_JA, 0, ACCEPT, ACCEPT);
+   }
+   if (needIp && v6)
+   {
+      a.markIpv6();
+      ipBlock(true);
+   }
+
+   if (!a.link(mSnapLength, code))
+   {
+      code.clear();
+      errno = E2BIG;
+   }
+   return code;
+}
+
+/**
+ * @brief Compile and attach the program to a socket (SO_ATTACH_FILTER).
+ *
+ * The program replaces the previous one. The packets queued before the
+ * attach are not filtered, drain the socket after attach.
+ *
+ * @param sock : An open socket.
+ * @param lock : Lock the filter (SO_LOCK_FILTER), it can't be detached or replaced anymore.
+ * @return int : zero on success.
+ */
+int SocketFilter::attach(Socket &sock, bool lock /*=false*/) const
+{
+   auto code = compile();
+   if (code.empty())
+      return -1;
+
+   sock_fprog prog = {};
+   prog.len = static_cast<unsigned short>(code.size());
+   prog.filter = code.data();
+   if (sock.setOption(SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1)
+      return -1;
+
+   if (lock)
+   {
+      int value = 1;
+      return sock.setOption(SOL_SOCKET, SO_LOCK_FILTER, &value, sizeof(value));
+   }
+   return 0;
+}
+
+/**
+ * @brief Detach the filter of a socket (SO_DETACH_FILTER).
+ *
+ * @param sock : An open socket.
+ * @return int : zero on success, -1 with errno EPERM if the filter is locked.
+ */
+int SocketFilter::detach(Socket &sock) noexcept
+{
+   int value = 0;
+   return sock.setOption(SOL_SOCKET, SO_DETACH_FILTER, &value, sizeof(value));
+}
+
+bool SocketFilter::parseHost(const std::string &addr, Host &host) noexcept
+{
+   host = Host();
+   uint8_t bytes[16];
+   if (inet_pton(AF_INET, addr.c_str(), bytes) == 1)
+      host.family = AF_INET;
+   else if (inet_pton(AF_INET6, addr.c_str(), bytes) == 1)
+      host.family = AF_INET6;
+   else
+   {
+      if (mError == 0)
+         mError = EINVAL;
+      return false;
+   }
+
+   uint32_t n = (host.family == AF_INET6) ? 4 : 1;
+   for (uint32_t i = 0; i < n; i++)
+      host.words[i] = (uint32_t(bytes[4 * i]) << 24) | (uint32_t(bytes[4 * i + 1]) << 16) |
+                      (uint32_t(bytes[4 * i + 2]) << 8) | bytes[4 * i + 3];
+   return true;
+}
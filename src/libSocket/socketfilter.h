@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : socketfilter.h
+// Contents  : classic BPF socket filter builder interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <linux/filter.h>
+
+#include "socket.h"
+
+/**
+ * @brief Build a classic BPF program from match criteria and attach it to a Socket.
+ *
+ * The criteria are and-ed, a packet that does not match them all is dropped
+ * by the kernel before it is queued to the socket, it costs neither a
+ * wakeup nor a copy.
+ *
+ * The program reads the ethernet protocol and the VLAN tag from the skb
+ * metadata and the IP fields relative to the network header (SKF_NET_OFF),
+ * the same program works on an AF_PACKET socket, a raw IP socket or a UDP
+ * socket. IPv4 and IPv6 are matched, without IPv6 extension headers; the
+ * IPv4 fragments other than the first one do not match a port.
+ *
+ * @code
+ * SocketFilter filter;
+ * filter.ipProtocol(IPPROTO_UDP).dstHost("239.1.1.1").dstPort(5000);
+ * filter.attach(sock);
+ * @endcode
+ */
+class LIBSOCKET_EXPORT SocketFilter
+{
+public:
+   SocketFilter() = default;
+
+   SocketFilter &etherType(uint16_t type) noexcept;
+   SocketFilter &vlan(uint16_t id) noexcept;
+   SocketFilter &ipProtocol(uint8_t protocol) noexcept;
+   SocketFilter &srcHost(const std::string &addr) noexcept;
+   SocketFilter &dstHost(const std::string &addr) noexcept;
+   SocketFilter &host(const std::string &addr) noexcept;
+   SocketFilter &srcPort(uint16_t port) noexcept;
+   SocketFilter &dstPort(uint16_t port) noexcept;
+   SocketFilter &port(uint16_t port) noexcept;
+   SocketFilter &snapLength(uint32_t length) noexcept;
+
+   std::vector<sock_filter> compile() const;
+   int attach(Socket &sock, bool lock = false) const;
+   static int detach(Socket &sock) noexcept;
+
+private:
+   struct Host
+   {
+      int family = AF_UNSPEC;
+      uint32_t words[4] = {};   ///< The address, 32 bits words in host order.
+   };
+
+   enum Field : uint32_t
+   {
+      ETHER_TYPE = 1 << 0,
+      VLAN       = 1 << 1,
+      PROTOCOL   = 1 << 2,
+      SRC_HOST   = 1 << 3,
+      DST_HOST   = 1 << 4,
+      HOST       = 1 << 5,
+      SRC_PORT   = 1 << 6,
+      DST_PORT   = 1 << 7,
+      PORT       = 1 << 8,
+   };
+
+   bool parseHost(const std::string &addr, Host &host) noexcept;
+
+   uint32_t mFields = 0;
+   uint16_t mEtherType = 0;
+   uint16_t mVlan = 0;
+   uint8_t mProtocol = 0;
+   Host mSrcHost;
+   Host mDstHost;
+   Host mHost;
+   uint16_t mSrcPort = 0;
+   uint16_t mDstPort = 0;
+   uint16_t mPort = 0;
+   uint32_t mSnapLength = 0xFFFFFFFF;
+   int mError = 0;   ///< The first criterion error, reported by compile and attach.
+};
@@ -11,15 +11,93 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <chrono>
-#include <thread>
 #include <cerrno>
 #include <cstring>
 #include <stdexcept>
 #include <system_error>
 
+#include "poll.h"
 #include "_endian.h"
 #include "socketstream.h"
 
+namespace
+{
+   // Wait until a non blocking socket is ready, instead of spinning on EAGAIN
+   void waitReady(SOCKET sock, short events)
+   {
+      pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = events;
+      pfd.revents = 0;
+      while (poll(&pfd, 1, -1) == -1 && errno == EINTR)
+         ;
+   }
+
+   void closeSocket(SOCKET sock)
+   {
+#ifdef OS_WINDOWS
+      closesocket(sock);
+#else
+      ::close(sock);
+#endif
+   }
+
+   int setSocketNONBLOCK(SOCKET sock, bool on)
+   {
+#ifdef OS_UNIX
+      int flags = fcntl(sock, F_GETFL, 0);
+      if (flags == -1)
+         return -1;
+      flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+      return fcntl(sock, F_SETFL, flags);
+#elif defined OS_WINDOWS
+      u_long iMode = on ? 1 : 0;
+      return ioctlsocket(sock, FIONBIO, &iMode) == NO_ERROR ? 0 : -1;
+#endif
+   }
+
+   int lastError()
+   {
+#ifdef OS_WINDOWS
+      return WSAGetLastError();
+#else
+      return errno;
+#endif
+   }
+
+   bool connectInProgress(int err)
+   {
+#ifdef OS_WINDOWS
+      return err == WSAEWOULDBLOCK;
+#else
+      return err == EINPROGRESS;
+#endif
+   }
+
+   // RFC 8305 section 4 : alternate the address families,
+   // starting with the family of the first resolved address
+   std::vector<socketaddr> interleave(const std::vector<socketaddr> &list)
+   {
+      std::vector<socketaddr> first, second, sorted;
+      for (const auto &addr : list)
+      {
+         if (addr.sa.sa_family == list.front().sa.sa_family)
+            first.push_back(addr);
+         else
+            second.push_back(addr);
+      }
+
+      for (size_t i = 0; i < first.size() || i < second.size(); i++)
+      {
+         if (i < first.size())
+            sorted.push_back(first[i]);
+         if (i < second.size())
+            sorted.push_back(second[i]);
+      }
+      return sorted;
+   }
+}
+
 /**
  * @brief Construct a new SocketSTREAM object
  * 
@@ -68,46 +146,6 @@ int SocketSTREAM::listen(int n /*=1*/)
    return ::listen(mSock, n);
 }
 
-void SocketSTREAM::setNONBLOCK(bool on /*=true*/)
-{
-   if ((on && mNONBLOCK) || (!on && !mNONBLOCK))
-      return; // nothing to do
-
-   if (on && !mNONBLOCK)
-      mNONBLOCK = true;
-
-   if (!on && mNONBLOCK)
-      mNONBLOCK = false;
-
-#ifdef OS_UNIX
-
-   int flags = fcntl(mSock, F_GETFL, 0);
-
-   if (mNONBLOCK)
-      flags |= O_NONBLOCK;
-   else
-      flags &= ~O_NONBLOCK;
-
-   int rc = fcntl(mSock, F_SETFL, flags);
-   if (rc == -1)
-      throw std::system_error(errno, std::system_category(), "fcntl");
-
-#elif defined OS_WINDOWS
-
-   u_long iMode = 1; // iMode != 0, non-blocking mode is enabled
-   if (!mNONBLOCK)
-      iMode = 0;
-
-   auto iRes = ioctlsocket(mSock, FIONBIO, &iMode);
-   if (iRes != NO_ERROR)
-   {
-      auto msg = "ioctlsocket set O_NONBLOCK failed: " + std::to_string(iRes);
-      throw std::runtime_error(msg);
-   }
-
-#endif
-}
-
 /**
  * @brief Wait a client connection
  * 
@@ -134,6 +172,65 @@ SocketSTREAM SocketSTREAM::accept(bool block /*=true*/)
    return SocketSTREAM(wSock, saddr);
 }
 
+/**
+ * @brief Accept up to max pending clients in one call.
+ *
+ * The listening socket is switched once to non-blocking mode, then the
+ * backlog is drained until it is empty or max clients are accepted.
+ * Under linux, the clients are created with accept4 already non-blocking
+ * and close-on-exec, without extra fcntl.
+ *
+ * Errors are reported as values, no exception is thrown for them:
+ *  - 0 : The backlog is drained or max clients are accepted.
+ *  - ECONNABORTED, EPROTO : A client aborted before being accepted, call again.
+ *  - EMFILE, ENFILE, ENOBUFS, ENOMEM : Out of resources.
+ *
+ * @param clients : The accepted clients are appended to this container.
+ * @param max : Maximum number of clients to accept.
+ * @param error : If not null, receive the errno value that stopped the batch.
+ * @return uint32_t : The number of accepted clients.
+ */
+uint32_t SocketSTREAM::acceptBatch(std::vector<SocketSTREAM> &clients, uint32_t max, int *error /*=nullptr*/)
+{
+   setNONBLOCK(true);
+
+   int err = 0;
+   uint32_t n = 0;
+   while (n < max)
+   {
+      socketaddr saddr = {};
+      saddr.size = sizeof(saddr.ss);
+#ifdef __linux__
+      SOCKET wSock = ::accept4(mSock, &saddr.sa, &saddr.size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+      SOCKET wSock = ::accept(mSock, &saddr.sa, &saddr.size);
+#endif
+      if (wSock == INVALID_SOCKET)
+      {
+         err = Socket::error();
+#ifndef OS_WINDOWS
+         if (err == EAGAIN || err == EWOULDBLOCK)
+#else
+         if (err == WSAEWOULDBLOCK)
+#endif
+            err = 0;
+         break;
+      }
+
+      clients.push_back(SocketSTREAM(wSock, saddr));
+#ifdef __linux__
+      clients.back().mNONBLOCK = true;
+#else
+      clients.back().setNONBLOCK(true);
+#endif
+      n++;
+   }
+
+   if (error != nullptr)
+      *error = err;
+   return n;
+}
+
 /**
  * @brief Connect a client to a server
  * 
@@ -151,6 +248,177 @@ int SocketSTREAM::connect() noexcept
    return ::connect(mSock, (sockaddr *)&mAddr.sa, mAddr.size);
 }
 
+/**
+ * @brief Connect to the first reachable address of a host, the Happy Eyeballs way (RFC 8305).
+ *
+ * All the addresses of the node are resolved and interleaved by family.
+ * A non-blocking connect is started on the next address every attemptDelayMs,
+ * or as soon as an attempt fails, while the previous attempts keep running.
+ * The first established connection wins, the other attempts are closed,
+ * thus a blackholed address family only costs attemptDelayMs.
+ *
+ * On success, the underlying socket is replaced by the winner one and
+ * getSocketaddr() returns the connected address.
+ *
+ * @param node : An IPV4, IPV6 or a hostname.
+ * @param port : The server port.
+ * @param timeoutMs : The overall timeout in milli second(s), -1 to wait for the kernel timeouts.
+ * @param attemptDelayMs : The delay before starting the next attempt.
+ * @return int : zero on success, -1 with errno set to the last attempt error otherwise.
+ */
+int SocketSTREAM::connect(const std::string &node, uint16_t port, int timeoutMs /*=-1*/, uint32_t attemptDelayMs /*=250*/)
+{
+   using Clock = std::chrono::steady_clock;
+   auto ms = [](Clock::duration d) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+   };
+
+   auto list = SockAddrList(node, port, mDomain);
+   if (list.empty())
+   {
+      errno = EHOSTUNREACH;
+      return -1;
+   }
+   auto candidates = interleave(list);
+
+   std::vector<pollfd> attempts;
+   std::vector<size_t> indexes;
+   SOCKET winner = INVALID_SOCKET;
+   size_t winnerIndex = 0;
+   size_t next = 0;
+   int err = ETIMEDOUT;
+
+   auto start = Clock::now();
+   auto nextAttempt = start;
+
+   while (winner == INVALID_SOCKET)
+   {
+      auto now = Clock::now();
+      int remaining = -1;
+      if (timeoutMs >= 0)
+      {
+         remaining = timeoutMs - static_cast<int>(ms(now - start));
+         if (remaining <= 0)
+         {
+            err = ETIMEDOUT;
+            break;
+         }
+      }
+
+      if (next < candidates.size() && (now >= nextAttempt || attempts.empty()))
+      {
+         const auto &addr = candidates[next];
+         SOCKET sock = ::socket(addr.sa.sa_family, mType, mProto);
+         if (sock == INVALID_SOCKET || setSocketNONBLOCK(sock, true) == -1)
+         {
+            err = lastError();
+            if (sock != INVALID_SOCKET)
+               closeSocket(sock);
+         }
+         else if (::connect(sock, &addr.sa, addr.size) == 0)
+         {
+            winner = sock;
+            winnerIndex = next;
+         }
+         else if (connectInProgress(lastError()))
+         {
+            pollfd pfd;
+            pfd.fd = sock;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            attempts.push_back(pfd);
+            indexes.push_back(next);
+         }
+         else
+         {
+            err = lastError();
+            closeSocket(sock);
+         }
+
+         next++;
+         nextAttempt = Clock::now() + std::chrono::milliseconds(attemptDelayMs);
+         continue;
+      }
+
+      if (attempts.empty())
+         break; // all the attempts failed
+
+      int wait = remaining;
+      if (next < candidates.size())
+      {
+         int delay = static_cast<int>(ms(nextAttempt - now));
+         if (delay < 0)
+            delay = 0;
+         if (wait < 0 || delay < wait)
+            wait = delay;
+      }
+
+      int n = poll(attempts.data(), static_cast<nfds_t>(attempts.size()), wait);
+      if (n == -1)
+      {
+         if (lastError() == EINTR)
+            continue;
+         err = lastError();
+         break;
+      }
+
+      for (size_t i = 0; i < attempts.size();)
+      {
+         if (attempts[i].revents == 0)
+         {
+            i++;
+            continue;
+         }
+
+         int soError = 0;
+         socklen_t len = sizeof(soError);
+         if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, (char *)&soError, &len) == -1)
+            soError = lastError();
+
+         if (soError == 0 && winner == INVALID_SOCKET)
+         {
+            winner = attempts[i].fd;
+            winnerIndex = indexes[i];
+         }
+         else
+         {
+            err = soError ? soError : ECONNREFUSED;
+            closeSocket(attempts[i].fd);
+            // A failed attempt starts the next one without delay
+            nextAttempt = Clock::now();
+         }
+         attempts.erase(attempts.begin() + i);
+         indexes.erase(indexes.begin() + i);
+      }
+   }
+
+   // Cancel the losers
+   for (const auto &attempt : attempts)
+      closeSocket(attempt.fd);
+
+   if (winner == INVALID_SOCKET)
+   {
+      errno = err;
+      return -1;
+   }
+
+   bool nonBlock = mNONBLOCK;
+   close();
+   mSock = winner;
+   mAddr = candidates[winnerIndex];
+   mDomain = mAddr.sa.sa_family;
+   mNONBLOCK = true;
+   if (!nonBlock)
+      setNONBLOCK(false);
+
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+   int set = 1;
+   if (setsockopt(mSock, SOL_SOCKET, SO_NOSIGPIPE, &set, sizeof(set)) == -1)
+      return -1;
+#endif
+   return 0;
+}
+
 /**
  * @brief Enable sending of keep-alive
  *
@@ -369,7 +637,7 @@ void SocketSTREAM::sendFile(const std::string &fileName, void (*callback)(uint64
             if (WSAGetLastError() == WSAEWOULDBLOCK)
 #endif
             {
-               std::this_thread::sleep_for(std::chrono::microseconds(1000));
+               waitReady(mSock, POLLOUT);
                continue;
             }
 
@@ -436,7 +704,7 @@ void SocketSTREAM::recvFile(const std::string &fileName, void (*callback)(uint64
          if (WSAGetLastError() == WSAEWOULDBLOCK)
 #endif
          {
-            std::this_thread::sleep_for(std::chrono::microseconds(1000));
+            waitReady(mSock, POLLIN);
             continue;
          }
 
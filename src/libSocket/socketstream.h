@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <vector>
 #include "socket.h"
 
 class LIBSOCKET_EXPORT SocketSTREAM : public Socket
@@ -19,12 +20,17 @@ class LIBSOCKET_EXPORT SocketSTREAM : public Socket
 public:
    SocketSTREAM(int domain = AF_UNSPEC, int proto = IPPROTO_TCP);
    SocketSTREAM(int domain, int type, int proto);
-   SocketSTREAM(const SocketSTREAM &) = default;
+   SocketSTREAM(const SocketSTREAM &) = delete;
+   SocketSTREAM(SocketSTREAM &&) noexcept = default;
+   SocketSTREAM &operator=(const SocketSTREAM &) = delete;
+   SocketSTREAM &operator=(SocketSTREAM &&) noexcept = default;
    ~SocketSTREAM() = default;
 
    int listen(int n = 1);
    SocketSTREAM accept(bool block = true);
+   uint32_t acceptBatch(std::vector<SocketSTREAM> &clients, uint32_t max, int *error = nullptr);
    int connect() noexcept;
+   int connect(const std::string &node, uint16_t port, int timeoutMs = -1, uint32_t attemptDelayMs = 250);
    int KeepAlive(bool enable = true) noexcept;
 
    int send(const msghdr &message) const noexcept override;
@@ -56,6 +62,4 @@ public:
 
 private:
    SocketSTREAM(SOCKET wSock, const socketaddr &addr);
-   void setNONBLOCK(bool on = true);
-   bool mNONBLOCK = false;
 };
@@ -0,0 +1,413 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : socketxdp.cpp
+// Contents  : AF_XDP socket implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+
+#include "poll.h"
+#include "socketxdp.h"
+
+namespace
+{
+   long bpf(int cmd, bpf_attr &attr) noexcept
+   {
+      return syscall(__NR_bpf, cmd, &attr, sizeof(attr));
+   }
+}
+
+/**
+ * @brief Construct a new SocketXDP object: set up the UMEM and the rings, bind the socket, attach the program.
+ *
+ * The UMEM holds 2 * ringSize chunks, ringSize to receive and ringSize to send.
+ *
+ * @param ifIndex : The interface index.
+ * @param queueId : The interface receive queue.
+ * @param mode : GENERIC or NATIVE.
+ * @param frameSize : The chunk size, a power of 2 from 2048 to the page size.
+ * @param ringSize : The number of descriptors of each ring, a power of 2.
+ */
+SocketXDP::SocketXDP(int ifIndex, uint32_t queueId /*=0*/, Mode mode /*=GENERIC*/, uint32_t frameSize /*=2048*/,
+                     uint32_t ringSize /*=2048*/)
+   : mSock(AF_XDP, SOCK_RAW, 0), mMode(mode), mFrameSize(frameSize), mRingSize(ringSize)
+{
+   if (ringSize == 0 || (ringSize & (ringSize - 1)) != 0)
+      throw std::system_error(EINVAL, std::system_category(), "SocketXDP ringSize");
+
+   if (mSock.open() == INVALID_SOCKET)
+      throw std::system_error(errno, std::system_category(), "socket AF_XDP");
+
+   try
+   {
+      mUmemSize = static_cast<size_t>(frameSize) * ringSize * 2;
+      void *umem = mmap(nullptr, mUmemSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (umem == MAP_FAILED)
+         throw std::system_error(errno, std::system_category(), "mmap UMEM");
+      mUmem = static_cast<uint8_t *>(umem);
+
+      xdp_umem_reg reg = {};
+      reg.addr = reinterpret_cast<uintptr_t>(mUmem);
+      reg.len = mUmemSize;
+      reg.chunk_size = frameSize;
+      reg.headroom = 0;
+      if (mSock.setOption(SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) == -1)
+         throw std::system_error(errno, std::system_category(), "XDP_UMEM_REG");
+
+      int count = static_cast<int>(ringSize);
+      if (mSock.setOption(SOL_XDP, XDP_UMEM_FILL_RING, &count, sizeof(count)) == -1 ||
+          mSock.setOption(SOL_XDP, XDP_UMEM_COMPLETION_RING, &count, sizeof(count)) == -1 ||
+          mSock.setOption(SOL_XDP, XDP_RX_RING, &count, sizeof(count)) == -1 ||
+          mSock.setOption(SOL_XDP, XDP_TX_RING, &count, sizeof(count)) == -1)
+         throw std::system_error(errno, std::system_category(), "XDP rings");
+
+      xdp_mmap_offsets off = {};
+      int len = sizeof(off);
+      if (mSock.getOption(SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) == -1)
+         throw std::system_error(errno, std::system_category(), "XDP_MMAP_OFFSETS");
+
+      mapRing(mFill, off.fr, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t), ringSize);
+      mapRing(mCompletion, off.cr, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t), ringSize);
+      mapRing(mRx, off.rx, XDP_PGOFF_RX_RING, sizeof(xdp_desc), ringSize);
+      mapRing(mTx, off.tx, XDP_PGOFF_TX_RING, sizeof(xdp_desc), ringSize);
+
+      // The receive half goes to the kernel, the send half stays with the process.
+      // A ring holds all the chunks of its half, it can never overflow.
+      auto fill = static_cast<uint64_t *>(mFill.desc);
+      for (uint32_t i = 0; i < ringSize; i++)
+         fill[i] = static_cast<uint64_t>(i) * frameSize;
+      mFill.head = ringSize;
+      __atomic_store_n(mFill.producer, mFill.head, __ATOMIC_RELEASE);
+
+      mFreeTx.reserve(ringSize);
+      for (uint32_t i = 2 * ringSize; i > ringSize; i--)
+         mFreeTx.push_back(static_cast<uint64_t>(i - 1) * frameSize);
+
+      sockaddr_xdp sxdp = {};
+      sxdp.sxdp_family = AF_XDP;
+      sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | (mode == GENERIC ? XDP_COPY : 0);
+      sxdp.sxdp_ifindex = static_cast<uint32_t>(ifIndex);
+      sxdp.sxdp_queue_id = queueId;
+      if (::bind(mSock.getHandle(), reinterpret_cast<sockaddr *>(&sxdp), sizeof(sxdp)) == -1)
+         throw std::system_error(errno, std::system_category(), "bind AF_XDP");
+
+      loadProgram(ifIndex, queueId, mode);
+   }
+   catch (...)
+   {
+      release();
+      throw;
+   }
+}
+
+SocketXDP::~SocketXDP()
+{
+   release();
+}
+
+/**
+ * @brief Wait for received frames and pass them to the handler.
+ *
+ * The chunks go back to the fill ring when the handler returns,
+ * the frame views must not be kept.
+ *
+ * @param handler : Called for each frame.
+ * @param timeoutMs : The time to wait in milli second(s), -1 to block.
+ * @param batchSize : The maximum number of frames.
+ * @return int : The number of frames, 0 on timeout, -1 on error.
+ */
+int SocketXDP::poll(const Handler &handler, int timeoutMs /*=-1*/, uint32_t batchSize /*=64*/)
+{
+   uint32_t ready;
+   while ((ready = __atomic_load_n(mRx.producer, __ATOMIC_ACQUIRE) - mRx.head) == 0)
+   {
+      // poll also wakes the driver up when the fill ring needs it
+      pollfd pfd;
+      pfd.fd = mSock.getHandle();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int rc = ::poll(&pfd, 1, timeoutMs);
+      if (rc <= 0)
+         return rc;
+      if (timeoutMs >= 0 && __atomic_load_n(mRx.producer, __ATOMIC_ACQUIRE) == mRx.head)
+         return 0;
+   }
+   if (ready > batchSize)
+      ready = batchSize;
+
+   auto rx = static_cast<const xdp_desc *>(mRx.desc);
+   auto fill = static_cast<uint64_t *>(mFill.desc);
+   Frame f;
+   for (uint32_t i = 0; i < ready; i++)
+   {
+      const xdp_desc &desc = rx[(mRx.head + i) & mRx.mask];
+      f.data = mUmem + desc.addr;
+      f.length = desc.len;
+      handler(f);
+      fill[(mFill.head + i) & mFill.mask] = desc.addr & ~static_cast<uint64_t>(mFrameSize - 1);
+   }
+
+   mRx.head += ready;
+   __atomic_store_n(mRx.consumer, mRx.head, __ATOMIC_RELEASE);
+   mFill.head += ready;
+   __atomic_store_n(mFill.producer, mFill.head, __ATOMIC_RELEASE);
+   return static_cast<int>(ready);
+}
+
+/**
+ * @brief Get a free send chunk.
+ *
+ * The frame, from its link layer header, is written at the returned address,
+ * then commit() queues it. Calling acquire again before commit returns
+ * the same chunk.
+ *
+ * @return uint8_t* : The chunk, capacity() bytes, nullptr if all the chunks are in flight.
+ */
+uint8_t *SocketXDP::acquire() noexcept
+{
+   if (mFreeTx.empty())
+      reclaim();
+   if (mFreeTx.empty())
+      return nullptr;
+   return mUmem + mFreeTx.back();
+}
+
+/**
+ * @brief Queue the acquired chunk on the TX ring.
+ *
+ * @param length : The frame length.
+ * @return int : zero on success, -1 with errno ENOBUFS if no chunk is free, EMSGSIZE if the frame is too long.
+ */
+int SocketXDP::commit(uint32_t length) noexcept
+{
+   if (length > capacity())
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+   if (acquire() == nullptr)
+   {
+      errno = ENOBUFS;
+      return -1;
+   }
+
+   auto &desc = static_cast<xdp_desc *>(mTx.desc)[mTx.head & mTx.mask];
+   desc.addr = mFreeTx.back();
+   desc.len = length;
+   desc.options = 0;
+   mFreeTx.pop_back();
+   mTx.head++;
+   mPending++;
+   return 0;
+}
+
+/**
+ * @brief Publish the committed frames to the kernel and wake it up if needed.
+ *
+ * In GENERIC mode the kernel sends a limited batch per syscall,
+ * flush loops until the TX ring is drained.
+ *
+ * @return int : The number of frames flushed, -1 on error.
+ */
+int SocketXDP::flush() noexcept
+{
+   __atomic_store_n(mTx.producer, mTx.head, __ATOMIC_RELEASE);
+   int n = static_cast<int>(mPending);
+   mPending = 0;
+
+   while (__atomic_load_n(mTx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)
+   {
+      if (sendto(mSock.getHandle(), nullptr, 0, MSG_DONTWAIT, nullptr, 0) == -1 &&
+          errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+         return -1;
+      if (mMode != GENERIC || __atomic_load_n(mTx.consumer, __ATOMIC_ACQUIRE) == mTx.head)
+         break;
+   }
+   return n;
+}
+
+/**
+ * @brief Wait for a send chunk to be free.
+ *
+ * @param timeoutMs : The time to wait in milli second(s), -1 to block.
+ * @return int : 1 if a chunk is free, 0 on timeout, -1 on error.
+ */
+int SocketXDP::wait(int timeoutMs /*=-1*/) noexcept
+{
+   if (acquire() != nullptr)
+      return 1;
+   pollfd pfd;
+   pfd.fd = mSock.getHandle();
+   pfd.events = POLLOUT;
+   pfd.revents = 0;
+   int rc = ::poll(&pfd, 1, timeoutMs);
+   if (rc <= 0)
+      return rc;
+   return acquire() != nullptr ? 1 : 0;
+}
+
+/**
+ * @brief Number of free send chunks.
+ */
+uint32_t SocketXDP::available() noexcept
+{
+   reclaim();
+   return static_cast<uint32_t>(mFreeTx.size());
+}
+
+/**
+ * @brief Number of committed frames not flushed yet.
+ */
+uint32_t SocketXDP::pending() const noexcept
+{
+   return mPending;
+}
+
+/**
+ * @brief The maximum frame length.
+ */
+uint32_t SocketXDP::capacity() const noexcept
+{
+   return mFrameSize;
+}
+
+/**
+ * @brief Read the XDP_STATISTICS counters.
+ */
+SocketXDP::Stats SocketXDP::stats() noexcept
+{
+   Stats stats;
+   xdp_statistics st = {};
+   int len = sizeof(st);
+   if (mSock.getOption(SOL_XDP, XDP_STATISTICS, &st, &len) == 0)
+   {
+      stats.rxDropped = st.rx_dropped;
+      stats.rxInvalid = st.rx_invalid_descs;
+      stats.txInvalid = st.tx_invalid_descs;
+      stats.rxRingFull = st.rx_ring_full;
+      stats.fillRingEmpty = st.rx_fill_ring_empty_descs;
+      stats.txRingEmpty = st.tx_ring_empty_descs;
+   }
+   return stats;
+}
+
+/**
+ * @brief The underlying AF_XDP socket.
+ */
+SocketDGRAM &SocketXDP::socket() noexcept
+{
+   return mSock;
+}
+
+void SocketXDP::mapRing(Ring &ring, const xdp_ring_offset &off, uint64_t pgoff, size_t descSize, uint32_t count)
+{
+   ring.mapSize = off.desc + descSize * count;
+   void *map = mmap(nullptr, ring.mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mSock.getHandle(),
+                    static_cast<off_t>(pgoff));
+   if (map == MAP_FAILED)
+      throw std::system_error(errno, std::system_category(), "mmap XDP ring");
+
+   auto base = static_cast<uint8_t *>(map);
+   ring.map = map;
+   ring.producer = reinterpret_cast<uint32_t *>(base + off.producer);
+   ring.consumer = reinterpret_cast<uint32_t *>(base + off.consumer);
+   ring.flags = reinterpret_cast<uint32_t *>(base + off.flags);
+   ring.desc = base + off.desc;
+   ring.mask = count - 1;
+}
+
+void SocketXDP::loadProgram(int ifIndex, uint32_t queueId, Mode mode)
+{
+   bpf_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.map_type = BPF_MAP_TYPE_XSKMAP;
+   attr.key_size = sizeof(uint32_t);
+   attr.value_size = sizeof(int);
+   attr.max_entries = queueId + 1;
+   mMapFd = static_cast<int>(bpf(BPF_MAP_CREATE, attr));
+   if (mMapFd < 0)
+      throw std::system_error(errno, std::system_category(), "BPF_MAP_CREATE XSKMAP");
+
+   uint32_t key = queueId;
+   int fd = mSock.getHandle();
+   memset(&attr, 0, sizeof(attr));
+   attr.map_fd = static_cast<uint32_t>(mMapFd);
+   attr.key = reinterpret_cast<uintptr_t>(&key);
+   attr.value = reinterpret_cast<uintptr_t>(&fd);
+   attr.flags = BPF_ANY;
+   if (bpf(BPF_MAP_UPDATE_ELEM, attr) < 0)
+      throw std::system_error(errno, std::system_category(), "BPF_MAP_UPDATE_ELEM XSKMAP");
+
+   // return bpf_redirect_map(&xskmap, ctx->rx_queue_index, XDP_PASS);
+   bpf_insn prog[] = {
+      {BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, rx_queue_index), 0},
+      {BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, mMapFd},
+      {0, 0, 0, 0, 0},
+      {BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+   };
+   static const char license[] = "GPL";
+
+   memset(&attr, 0, sizeof(attr));
+   attr.prog_type = BPF_PROG_TYPE_XDP;
+   attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+   attr.insns = reinterpret_cast<uintptr_t>(prog);
+   attr.license = reinterpret_cast<uintptr_t>(license);
+   mProgFd = static_cast<int>(bpf(BPF_PROG_LOAD, attr));
+   if (mProgFd < 0)
+      throw std::system_error(errno, std::system_category(), "BPF_PROG_LOAD");
+
+   memset(&attr, 0, sizeof(attr));
+   attr.link_create.prog_fd = static_cast<uint32_t>(mProgFd);
+   attr.link_create.target_ifindex = static_cast<uint32_t>(ifIndex);
+   attr.link_create.attach_type = BPF_XDP;
+   attr.link_create.flags = (mode == GENERIC) ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+   mLinkFd = static_cast<int>(bpf(BPF_LINK_CREATE, attr));
+   if (mLinkFd < 0)
+      throw std::system_error(errno, std::system_category(), "BPF_LINK_CREATE XDP");
+}
+
+void SocketXDP::reclaim() noexcept
+{
+   uint32_t done = __atomic_load_n(mCompletion.producer, __ATOMIC_ACQUIRE) - mCompletion.head;
+   auto comp = static_cast<const uint64_t *>(mCompletion.desc);
+   for (uint32_t i = 0; i < done; i++)
+      mFreeTx.push_back(comp[(mCompletion.head + i) & mCompletion.mask]);
+   mCompletion.head += done;
+   __atomic_store_n(mCompletion.consumer, mCompletion.head, __ATOMIC_RELEASE);
+}
+
+void SocketXDP::release() noexcept
+{
+   // Closing the link detaches the program
+   for (int *fd : {&mLinkFd, &mProgFd, &mMapFd})
+   {
+      if (*fd >= 0)
+         ::close(*fd);
+      *fd = -1;
+   }
+   for (Ring *ring : {&mFill, &mCompletion, &mRx, &mTx})
+   {
+      if (ring->map != nullptr)
+         munmap(ring->map, ring->mapSize);
+      *ring = Ring();
+   }
+   mSock.close();
+   if (mUmem != nullptr)
+      munmap(mUmem, mUmemSize);
+   mUmem = nullptr;
+}
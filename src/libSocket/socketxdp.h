@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : socketxdp.h
+// Contents  : AF_XDP socket interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <linux/if_xdp.h>
+
+#include "socketdgram.h"
+
+/**
+ * @brief Receive and send raw frames through an AF_XDP socket.
+ *
+ * The frames live in a UMEM, a memory area shared with the kernel and split
+ * in frameSize chunks: the first half receives, the second half sends.
+ * Four single producer single consumer rings exchange the chunk addresses:
+ * the fill ring gives free chunks to the kernel, the RX ring returns the
+ * received frames, the TX ring queues the frames to send and the completion
+ * ring returns the sent chunks.
+ *
+ * A minimal XDP program, attached with a BPF link for the life of the
+ * object, redirects the frames of the queue to the socket through an
+ * XSKMAP, the other queues and the frames that find no socket go on to
+ * the network stack. Only one XDP program can be attached per interface
+ * and mode.
+ *
+ * The GENERIC mode runs the program after the skb allocation and copies the
+ * frames, it works on any interface, veth and lo included. The NATIVE mode
+ * runs it in the driver, with zero copy when the driver supports it.
+ *
+ * The socket needs the CAP_NET_ADMIN and CAP_NET_RAW capabilities.
+ */
+class LIBSOCKET_EXPORT SocketXDP
+{
+public:
+   enum Mode
+   {
+      GENERIC,   ///< XDP_FLAGS_SKB_MODE, copy mode.
+      NATIVE,    ///< XDP_FLAGS_DRV_MODE, zero copy if the driver supports it.
+   };
+
+   /// A received frame view, valid until the handler returns.
+   struct Frame
+   {
+      const uint8_t *data;   ///< The frame, from the link layer header.
+      uint32_t length;       ///< The frame length.
+   };
+
+   /// The XDP_STATISTICS counters.
+   struct Stats
+   {
+      uint64_t rxDropped = 0;          ///< Frames dropped for other reasons than invalid descriptors.
+      uint64_t rxInvalid = 0;          ///< Invalid RX descriptors.
+      uint64_t txInvalid = 0;          ///< Invalid TX descriptors.
+      uint64_t rxRingFull = 0;         ///< Frames dropped because the RX ring was full.
+      uint64_t fillRingEmpty = 0;      ///< Times the fill ring was empty.
+      uint64_t txRingEmpty = 0;        ///< Times the TX ring was empty.
+   };
+
+   using Handler = std::function<void(const Frame &frame)>;
+
+   explicit SocketXDP(int ifIndex, uint32_t queueId = 0, Mode mode = GENERIC, uint32_t frameSize = 2048,
+                      uint32_t ringSize = 2048);
+   SocketXDP(const SocketXDP &) = delete;
+   SocketXDP &operator=(const SocketXDP &) = delete;
+   ~SocketXDP();
+
+   int poll(const Handler &handler, int timeoutMs = -1, uint32_t batchSize = 64);
+
+   uint8_t *acquire() noexcept;
+   int commit(uint32_t length) noexcept;
+   int flush() noexcept;
+   int wait(int timeoutMs = -1) noexcept;
+
+   uint32_t available() noexcept;
+   uint32_t pending() const noexcept;
+   uint32_t capacity() const noexcept;
+   Stats stats() noexcept;
+   SocketDGRAM &socket() noexcept;
+
+private:
+   struct Ring
+   {
+      uint32_t *producer = nullptr;
+      uint32_t *consumer = nullptr;
+      uint32_t *flags = nullptr;
+      void *desc = nullptr;
+      void *map = nullptr;
+      size_t mapSize = 0;
+      uint32_t mask = 0;
+      uint32_t head = 0;   ///< The local producer or consumer index.
+   };
+
+   void mapRing(Ring &ring, const xdp_ring_offset &off, uint64_t pgoff, size_t descSize, uint32_t count);
+   void loadProgram(int ifIndex, uint32_t queueId, Mode mode);
+   void reclaim() noexcept;
+   void release() noexcept;
+
+   SocketDGRAM mSock;
+   Mode mMode;
+   int mMapFd = -1;
+   int mProgFd = -1;
+   int mLinkFd = -1;
+
+   uint8_t *mUmem = nullptr;
+   size_t mUmemSize = 0;
+   uint32_t mFrameSize;
+   uint32_t mRingSize;
+
+   Ring mFill;
+   Ring mCompletion;
+   Ring mRx;
+   Ring mTx;
+
+   std::vector<uint64_t> mFreeTx;   ///< The TX chunks owned by the process.
+   uint32_t mPending = 0;           ///< The committed frames not flushed yet.
+};
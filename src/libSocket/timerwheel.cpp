@@ -0,0 +1,310 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : timerwheel.cpp
+// Contents  : hierarchical timer wheel implementation
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include "timerwheel.h"
+
+namespace
+{
+   void listInit(TimerLink &head) noexcept
+   {
+      head.prev = &head;
+      head.next = &head;
+   }
+
+   bool listEmpty(const TimerLink &head) noexcept
+   {
+      return head.next == &head;
+   }
+
+   void listPushBack(TimerLink &head, TimerLink &node) noexcept
+   {
+      node.prev = head.prev;
+      node.next = &head;
+      head.prev->next = &node;
+      head.prev = &node;
+   }
+
+   void listUnlink(TimerLink &node) noexcept
+   {
+      node.prev->next = node.next;
+      node.next->prev = node.prev;
+      node.prev = nullptr;
+      node.next = nullptr;
+   }
+
+   // Move all the nodes of src into the empty list dst
+   void listSplice(TimerLink &src, TimerLink &dst) noexcept
+   {
+      listInit(dst);
+      if (listEmpty(src))
+         return;
+      dst.next = src.next;
+      dst.prev = src.prev;
+      dst.next->prev = &dst;
+      dst.prev->next = &dst;
+      listInit(src);
+   }
+}
+
+/**
+ * @brief Construct a new Timer object.
+ *
+ * @param callback : Called from TimerWheel::advance when the timer expires.
+ */
+Timer::Timer(Callback callback) : mCallback(std::move(callback))
+{
+}
+
+Timer::~Timer()
+{
+   cancel();
+}
+
+/**
+ * @brief Set the expiration callback.
+ */
+void Timer::setCallback(Callback callback)
+{
+   mCallback = std::move(callback);
+}
+
+/**
+ * @brief Test if the timer is armed.
+ */
+bool Timer::isArmed() const noexcept
+{
+   return mWheel != nullptr;
+}
+
+/**
+ * @brief Cancel the timer if it is armed.
+ */
+void Timer::cancel() noexcept
+{
+   if (mWheel != nullptr)
+      mWheel->cancel(*this);
+}
+
+/**
+ * @brief Construct a new TimerWheel object.
+ *
+ * @param tickMs : The wheel resolution in milli second(s).
+ */
+TimerWheel::TimerWheel(uint32_t tickMs /*=1*/) : mTickMs(tickMs ? tickMs : 1), mOrigin(Clock::now())
+{
+   for (auto &level : mSlots)
+      for (auto &slot : level)
+         listInit(slot);
+}
+
+TimerWheel::~TimerWheel()
+{
+   for (auto &level : mSlots)
+   {
+      for (auto &slot : level)
+      {
+         while (!listEmpty(slot))
+         {
+            auto &timer = static_cast<Timer &>(*slot.next);
+            listUnlink(timer);
+            timer.mWheel = nullptr;
+         }
+      }
+   }
+}
+
+/**
+ * @brief Arm or re-arm a timer.
+ *
+ * The delay is counted from the current time, or from the last advance()
+ * when it is ahead of the clock, so a timer armed after an idle period
+ * does not expire early.
+ *
+ * @param timer : The timer to arm, it is cancelled first if already armed.
+ * @param delayMs : The delay in milli second(s), rounded up to the tick.
+ */
+void TimerWheel::arm(Timer &timer, uint32_t delayMs) noexcept
+{
+   timer.cancel();
+
+   uint64_t now = ticks(Clock::now());
+   if (now < mNow)
+      now = mNow;
+
+   uint64_t delay = (static_cast<uint64_t>(delayMs) + mTickMs - 1) / mTickMs;
+   timer.mExpires = now + (delay ? delay : 1);
+   timer.mWheel = this;
+   insert(timer);
+   mCount++;
+}
+
+/**
+ * @brief Cancel an armed timer.
+ */
+void TimerWheel::cancel(Timer &timer) noexcept
+{
+   if (timer.mWheel != this)
+      return;
+
+   listUnlink(timer);
+   timer.mWheel = nullptr;
+   mCount--;
+}
+
+/**
+ * @brief Read the monotonic clock and fire the expired timers.
+ *
+ * @return uint32_t : The number of fired timers.
+ */
+uint32_t TimerWheel::advance()
+{
+   return advance(Clock::now());
+}
+
+/**
+ * @brief Move the wheel up to the given time and fire the expired timers.
+ *
+ * A callback can arm or cancel any timer, including its own.
+ *
+ * @param now : The current time.
+ * @return uint32_t : The number of fired timers.
+ */
+uint32_t TimerWheel::advance(Clock::time_point now)
+{
+   uint64_t target = ticks(now);
+   uint32_t fired = 0;
+
+   while (mNow < target)
+   {
+      if (mCount == 0)
+      {
+         mNow = target;
+         break;
+      }
+
+      mNow++;
+      uint32_t index = mNow & SLOT_MASK;
+      if (index == 0)
+      {
+         for (uint32_t level = 1; level < LEVELS; level++)
+         {
+            cascade(level);
+            if (((mNow >> (level * SLOT_BITS)) & SLOT_MASK) != 0)
+               break;
+         }
+      }
+      fired += expire(mSlots[0][index]);
+   }
+   return fired;
+}
+
+/**
+ * @brief Delay until the next timer may expire.
+ *
+ * @return int : A timeout in milli second(s) for poll/epoll_wait, -1 if no timer is armed.
+ */
+int TimerWheel::nextTimeout() const noexcept
+{
+   if (mCount == 0)
+      return -1;
+
+   // Level 0 timers expire in less than SLOTS ticks, the other levels
+   // are not due before the next cascade.
+   uint64_t delta = SLOTS - (mNow & SLOT_MASK);
+   for (uint64_t d = 1; d < delta; d++)
+   {
+      if (!listEmpty(mSlots[0][(mNow + d) & SLOT_MASK]))
+      {
+         delta = d;
+         break;
+      }
+   }
+
+   auto deadline = mOrigin + std::chrono::milliseconds((mNow + delta) * mTickMs);
+   auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+   if (remaining < 0)
+      return 0;
+   return static_cast<int>(remaining + 1);
+}
+
+/**
+ * @brief Number of armed timers.
+ */
+size_t TimerWheel::size() const noexcept
+{
+   return mCount;
+}
+
+/**
+ * @brief The wheel resolution in milli second(s).
+ */
+uint32_t TimerWheel::tickMs() const noexcept
+{
+   return mTickMs;
+}
+
+uint64_t TimerWheel::ticks(Clock::time_point now) const noexcept
+{
+   if (now <= mOrigin)
+      return 0;
+   return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - mOrigin).count()) / mTickMs;
+}
+
+void TimerWheel::insert(Timer &timer) noexcept
+{
+   constexpr uint64_t maxDelta = (1ULL << (LEVELS * SLOT_BITS)) - 1;
+   if (timer.mExpires - mNow > maxDelta)
+      timer.mExpires = mNow + maxDelta;
+
+   uint64_t delta = timer.mExpires - mNow;
+   uint32_t level = 0;
+   while (level < LEVELS - 1 && delta >= (1ULL << ((level + 1) * SLOT_BITS)))
+      level++;
+
+   uint32_t index = (timer.mExpires >> (level * SLOT_BITS)) & SLOT_MASK;
+   listPushBack(mSlots[level][index], timer);
+}
+
+void TimerWheel::cascade(uint32_t level) noexcept
+{
+   uint32_t index = (mNow >> (level * SLOT_BITS)) & SLOT_MASK;
+
+   TimerLink list;
+   listSplice(mSlots[level][index], list);
+   while (!listEmpty(list))
+   {
+      auto &timer = static_cast<Timer &>(*list.next);
+      listUnlink(timer);
+      insert(timer);
+   }
+}
+
+uint32_t TimerWheel::expire(TimerLink &slot)
+{
+   // The expired timers are moved to a local list, so the callbacks
+   // can arm or cancel timers while we iterate
+   TimerLink list;
+   listSplice(slot, list);
+
+   uint32_t fired = 0;
+   while (!listEmpty(list))
+   {
+      auto &timer = static_cast<Timer &>(*list.next);
+      listUnlink(timer);
+      timer.mWheel = nullptr;
+      mCount--;
+      fired++;
+      if (timer.mCallback)
+         timer.mCallback();
+   }
+   return fired;
+}
@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : timerwheel.h
+// Contents  : hierarchical timer wheel interface
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <libSocket/export.h>
+
+class TimerWheel;
+
+/// Intrusive doubly linked list node, the wheel slots are circular lists.
+struct TimerLink
+{
+   TimerLink *prev = nullptr;
+   TimerLink *next = nullptr;
+};
+
+/**
+ * @brief A timer node, armed in a TimerWheel.
+ *
+ * The node is intrusive: arming or cancelling a timer never allocates.
+ * A typical connection owns one Timer per deadline (idle, read, write).
+ */
+class LIBSOCKET_EXPORT Timer : private TimerLink
+{
+public:
+   using Callback = std::function<void()>;
+
+   Timer() = default;
+   explicit Timer(Callback callback);
+   Timer(const Timer &) = delete;
+   Timer &operator=(const Timer &) = delete;
+   ~Timer();
+
+   void setCallback(Callback callback);
+   bool isArmed() const noexcept;
+   void cancel() noexcept;
+
+private:
+   friend class TimerWheel;
+
+   TimerWheel *mWheel = nullptr;
+   uint64_t mExpires = 0;
+   Callback mCallback;
+};
+
+/**
+ * @brief A hierarchical timer wheel.
+ *
+ * 4 levels of 256 slots cover 2^32 ticks. arm() and cancel() are O(1),
+ * advance() reads the monotonic clock, which does not need a syscall,
+ * and fires the expired timers.
+ *
+ * This class is not thread safe, it is meant to be driven by one event loop.
+ */
+class LIBSOCKET_EXPORT TimerWheel
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   explicit TimerWheel(uint32_t tickMs = 1);
+   TimerWheel(const TimerWheel &) = delete;
+   TimerWheel &operator=(const TimerWheel &) = delete;
+   ~TimerWheel();
+
+   void arm(Timer &timer, uint32_t delayMs) noexcept;
+   void cancel(Timer &timer) noexcept;
+
+   uint32_t advance();
+   uint32_t advance(Clock::time_point now);
+   int nextTimeout() const noexcept;
+
+   size_t size() const noexcept;
+   uint32_t tickMs() const noexcept;
+
+private:
+   friend class Timer;
+
+   static constexpr uint32_t LEVELS = 4;
+   static constexpr uint32_t SLOT_BITS = 8;
+   static constexpr uint32_t SLOTS = 1 << SLOT_BITS;
+   static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+
+   uint64_t ticks(Clock::time_point now) const noexcept;
+   void insert(Timer &timer) noexcept;
+   void cascade(uint32_t level) noexcept;
+   uint32_t expire(TimerLink &slot);
+
+   uint32_t mTickMs;
+   Clock::time_point mOrigin;
+   uint64_t mNow = 0;
+   size_t mCount = 0;
+   TimerLink mSlots[LEVELS][SLOTS];
+};
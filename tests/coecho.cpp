@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : coecho.cpp
+// Contents  : coroutine echo test application
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+// LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include "coroutine.h"
+#include "socketdgram.h"
+
+////////////////////////////////////////////////////////////////////////////////
+Task<void> session(IoContext &io, std::unique_ptr<SocketSTREAM> sock)
+{
+   char buff[1500];
+   while (true)
+   {
+      int nbytes = co_await io.recv(*sock, buff, sizeof(buff), 30000);
+      if (nbytes <= 0)
+         break;
+      if (co_await io.send(*sock, buff, nbytes, 1000) != nbytes)
+         break;
+   }
+   io.remove(*sock);
+}
+
+Task<void> server(IoContext &io, SocketSTREAM &listener)
+{
+   while (true)
+   {
+      SocketSTREAM accepted = co_await io.accept(listener);
+      auto client = std::unique_ptr<SocketSTREAM>(new SocketSTREAM(std::move(accepted)));
+      if (!client->isOpen())
+      {
+         std::cout << "accept failed " << listener.error() << std::endl;
+         io.reactor().stop();
+         co_return;
+      }
+      io.spawn(session(io, std::move(client)));
+   }
+}
+
+Task<void> datagram(IoContext &io, SocketDGRAM &sock)
+{
+   char buff[1500];
+   int nbytes = 0;
+   while ((nbytes = co_await io.recv(sock, buff, sizeof(buff))) >= 0)
+      co_await io.send(sock, buff, nbytes);
+   io.remove(sock);
+}
+
+int echoServer(uint16_t port)
+{
+   try
+   {
+      Reactor reactor;
+      IoContext io(reactor);
+
+      SocketSTREAM listener(AF_INET);
+      SocketDGRAM sockDgram(AF_INET);
+      if (listener.setAnyAddr(port) == -1 || sockDgram.setAnyAddr(port) == -1)
+      {
+         std::cout << "setAnyAddr failed" << std::endl;
+         return 1;
+      }
+      if (listener.open() == INVALID_SOCKET || listener.bind() == -1 || listener.listen(128) == -1)
+      {
+         std::cout << "listen failed " << listener.error() << std::endl;
+         return 1;
+      }
+      if (sockDgram.open() == INVALID_SOCKET || sockDgram.bind() == -1)
+      {
+         std::cout << "bind failed " << sockDgram.error() << std::endl;
+         return 1;
+      }
+
+      io.spawn(server(io, listener));
+      io.spawn(datagram(io, sockDgram));
+      reactor.run();
+   }
+   catch (const std::exception &exp)
+   {
+      std::cout << exp.what() << std::endl;
+      return 1;
+   }
+   return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct ClientStats
+{
+   int running = 0;
+   int failures = 0;
+};
+
+Task<void> client(IoContext &io, const std::string &ipAddr, uint16_t port, int id, int count, ClientStats &stats)
+{
+   SocketSTREAM sock(AF_INET);
+   if (sock.setAddr(ipAddr, port) == 0 && sock.open() != INVALID_SOCKET)
+   {
+      if (co_await io.connect(sock, 1000) == 0)
+      {
+         for (int i = 0; i < count; i++)
+         {
+            auto msg = std::to_string(id) + ":" + std::to_string(i);
+            char buff[64] = {};
+            if (co_await io.send(sock, msg.data(), msg.size(), 1000) != (int)msg.size() ||
+                co_await io.recv(sock, buff, sizeof(buff) - 1, 1000) != (int)msg.size() ||
+                msg != buff)
+            {
+               std::cout << "client " << id << " echo failed " << sock.error() << std::endl;
+               stats.failures++;
+               break;
+            }
+         }
+      }
+      else
+      {
+         std::cout << "client " << id << " connect failed " << sock.error() << std::endl;
+         stats.failures++;
+      }
+      io.remove(sock);
+   }
+   else
+      stats.failures++;
+
+   if (--stats.running == 0)
+      io.reactor().stop();
+}
+
+int echoClient(const std::string &ipAddr, uint16_t port, int nbClients, int count)
+{
+   try
+   {
+      Reactor reactor;
+      IoContext io(reactor);
+      ClientStats stats;
+      stats.running = nbClients;
+      for (int id = 0; id < nbClients; id++)
+         io.spawn(client(io, ipAddr, port, id, count, stats));
+      if (stats.running > 0)
+         reactor.run();
+
+      std::cout << nbClients - stats.failures << "/" << nbClients << " clients succeeded" << std::endl;
+      if (stats.failures)
+         return 1;
+   }
+   catch (const std::exception &exp)
+   {
+      std::cout << exp.what() << std::endl;
+      return 1;
+   }
+   return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void usage()
+{
+   std::cout << "Usage\n";
+   std::cout << "  coecho --server port\n";
+   std::cout << "      TCP and UDP echo server, one coroutine per client on one thread\n\n";
+   std::cout << "  coecho --client IP_Address port clients count\n";
+   std::cout << "      run clients coroutines, each one sends count messages\n\n";
+}
+
+int main(int argc, char **argv)
+{
+   if (argc < 3)
+   {
+      usage();
+      return 1;
+   }
+
+   if ((strcmp(argv[1], "--server") == 0) && argc == 3)
+   {
+      return echoServer(std::atoi(argv[2]));
+   }
+
+   if ((strcmp(argv[1], "--client") == 0) && argc == 6)
+   {
+      return echoClient(std::string(argv[2]), std::atoi(argv[3]), std::atoi(argv[4]), std::atoi(argv[5]));
+   }
+
+   usage();
+   return 1;
+}
@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : connectionpool.cpp
+// Contents  : gtests ConnectionPool
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "connectionpool.h"
+
+#include "extern.h"
+
+TEST(ConnectionPool, acquire_release)
+{
+   uint16_t Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(8), 0);
+
+   auto addr = SockAddr("127.0.0.1", Port);
+   ConnectionPool pool(4, 0, 60000, 1000);
+
+   auto sock = pool.acquire(addr);
+   ASSERT_TRUE(sock.isOpen());
+   ASSERT_FALSE(sock.isNONBLOCK());
+   auto wsock = sockSrv.accept();
+   ASSERT_TRUE(wsock.isOpen());
+
+   uint32_t value = 0;
+   ASSERT_EQ(sock.send(uint32_t(1)), sizeof(value));
+   ASSERT_EQ(wsock.recv(value), sizeof(value));
+   ASSERT_EQ(wsock.send(value + 1), sizeof(value));
+   ASSERT_EQ(sock.recv(value), sizeof(value));
+   ASSERT_EQ(value, 2u);
+
+   // The same connection is handed out again
+   auto fd = sock.getHandle();
+   pool.release(std::move(sock));
+   ASSERT_FALSE(sock.isOpen());
+   ASSERT_EQ(pool.idle(addr), 1u);
+
+   sock = pool.acquire(addr);
+   ASSERT_EQ(sock.getHandle(), fd);
+   ASSERT_EQ(pool.idle(), 0u);
+   pool.release(std::move(sock));
+
+   // The server closes the connection, the pool connects a new one
+   wsock.close();
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   sock = pool.acquire(addr);
+   ASSERT_TRUE(sock.isOpen());
+   ASSERT_EQ(pool.idle(), 0u);
+   wsock = sockSrv.accept();
+   ASSERT_TRUE(wsock.isOpen());
+   pool.release(std::move(sock), false);
+   ASSERT_EQ(pool.idle(), 0u);
+
+   // Nobody listen on the next port
+   sock = pool.acquire(SockAddr("127.0.0.1", uint16_t(Port + 1)));
+   ASSERT_FALSE(sock.isOpen());
+   ASSERT_EQ(errno, ECONNREFUSED);
+}
+
+TEST(ConnectionPool, warm_spares_and_eviction)
+{
+   uint16_t Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(8), 0);
+
+   auto addr = SockAddr("127.0.0.1", Port);
+   ConnectionPool pool(4, 2, 50, 1000);
+
+   pool.warmUp(addr);
+   ASSERT_EQ(pool.idle(addr), 2u);
+
+   std::vector<SocketSTREAM> wsocks;
+   ASSERT_EQ(sockSrv.acceptBatch(wsocks, 8), 2u);
+
+   // The spares are still fresh
+   ASSERT_EQ(pool.maintain(), 0u);
+   ASSERT_EQ(pool.idle(addr), 2u);
+
+   // The idle timeout evicts them, then new spares are opened
+   std::this_thread::sleep_for(std::chrono::milliseconds(60));
+   ASSERT_EQ(pool.maintain(), 2u);
+   ASSERT_EQ(pool.idle(addr), 2u);
+
+   pool.clear();
+   ASSERT_EQ(pool.idle(), 0u);
+}
+
+TEST(ConnectionPool, no_idle)
+{
+   uint16_t Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(8), 0);
+
+   // maxIdle zero : every released connection is closed
+   auto addr = SockAddr("127.0.0.1", Port);
+   ConnectionPool pool(0, 0, 60000, 1000);
+
+   auto sock = pool.acquire(addr);
+   ASSERT_TRUE(sock.isOpen());
+   pool.release(std::move(sock));
+   ASSERT_FALSE(sock.isOpen());
+   ASSERT_EQ(pool.idle(), 0u);
+
+   pool.warmUp(addr);
+   ASSERT_EQ(pool.idle(), 0u);
+}
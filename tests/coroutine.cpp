@@ -0,0 +1,196 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : coroutine.cpp
+// Contents  : gtests IoContext
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "coroutine.h"
+#include "socketdgram.h"
+
+#include "extern.h"
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+
+using ms = std::chrono::milliseconds;
+
+namespace
+{
+   struct Result
+   {
+      bool suspended = false;
+      bool done = false;
+      int rc = 0;
+      int error = 0;
+      uint32_t value = 0;
+   };
+
+   Task<void> receive(IoContext &io, Socket &sock, int timeoutMs, Result &result)
+   {
+      result.suspended = true;
+      result.rc = co_await io.recv(sock, &result.value, sizeof(result.value), timeoutMs);
+      result.error = errno;
+      result.done = true;
+   }
+
+   Task<uint32_t> twice(IoContext &io, Socket &sock)
+   {
+      uint32_t value = 0;
+      if (co_await io.recv(sock, &value, sizeof(value), 1000) != sizeof(value))
+         co_return 0;
+      co_return value * 2;
+   }
+
+   Task<void> nested(IoContext &io, Socket &sock, Result &result)
+   {
+      result.value = co_await twice(io, sock);
+      result.done = true;
+   }
+
+   void openPair(SocketDGRAM &sockRcv, SocketDGRAM &sockSnd)
+   {
+      auto Port = port + portOffset++;
+
+      ASSERT_EQ(sockRcv.setAnyAddr(AF_INET, Port), 0);
+      ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+      ASSERT_EQ(sockRcv.bind(), 0);
+
+      ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+      ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+   }
+}
+
+TEST(IoContext, resume_on_ready)
+{
+   SocketDGRAM sockRcv, sockSnd;
+   openPair(sockRcv, sockSnd);
+
+   Reactor reactor;
+   IoContext io(reactor);
+   Result result;
+   io.spawn(receive(io, sockRcv, 1000, result));
+   ASSERT_TRUE(result.suspended);
+   ASSERT_FALSE(result.done);
+   ASSERT_TRUE(sockRcv.isNONBLOCK());
+
+   // The socket is only writable, the reader stays suspended
+   ASSERT_GE(reactor.poll(0), 0);
+   ASSERT_FALSE(result.done);
+
+   uint32_t value = 42;
+   ASSERT_EQ(sockSnd.send(&value, sizeof(value)), (int)sizeof(value));
+   for (int i = 0; i < 100 && !result.done; i++)
+      ASSERT_GE(reactor.poll(100), 0);
+
+   ASSERT_TRUE(result.done);
+   ASSERT_EQ(result.rc, (int)sizeof(value));
+   ASSERT_EQ(result.value, 42u);
+
+   io.remove(sockRcv);
+   ASSERT_FALSE(reactor.contains(sockRcv));
+}
+
+TEST(IoContext, nested_task)
+{
+   SocketDGRAM sockRcv, sockSnd;
+   openPair(sockRcv, sockSnd);
+
+   Reactor reactor;
+   IoContext io(reactor);
+   Result result;
+   io.spawn(nested(io, sockRcv, result));
+   ASSERT_FALSE(result.done);
+
+   uint32_t value = 21;
+   ASSERT_EQ(sockSnd.send(&value, sizeof(value)), (int)sizeof(value));
+   for (int i = 0; i < 100 && !result.done; i++)
+      ASSERT_GE(reactor.poll(100), 0);
+
+   ASSERT_TRUE(result.done);
+   ASSERT_EQ(result.value, 42u);
+}
+
+TEST(IoContext, timeout)
+{
+   SocketDGRAM sockRcv, sockSnd;
+   openPair(sockRcv, sockSnd);
+
+   Reactor reactor;
+   IoContext io(reactor);
+
+   // The reactor is idle before the operation starts, the timeout counts from the start
+   ASSERT_GE(reactor.poll(0), 0);
+   std::this_thread::sleep_for(ms(200));
+
+   Result result;
+   auto t0 = std::chrono::steady_clock::now();
+   io.spawn(receive(io, sockRcv, 100, result));
+   while (!result.done)
+      ASSERT_GE(reactor.poll(-1), 0);
+   auto dt = std::chrono::duration_cast<ms>(std::chrono::steady_clock::now() - t0).count();
+
+   ASSERT_EQ(result.rc, -1);
+   ASSERT_EQ(result.error, ETIMEDOUT);
+   ASSERT_GE(dt, 99);
+   ASSERT_LT(dt, 300);
+   ASSERT_EQ(reactor.timers().size(), 0u);
+}
+
+TEST(IoContext, cancel)
+{
+   SocketDGRAM sockRcv, sockSnd;
+   openPair(sockRcv, sockSnd);
+
+   Reactor reactor;
+   IoContext io(reactor);
+   Result result;
+   io.spawn(receive(io, sockRcv, 1000, result));
+   ASSERT_FALSE(result.done);
+   ASSERT_EQ(reactor.timers().size(), 1u);
+
+   io.cancel(sockRcv);
+   ASSERT_TRUE(result.done);
+   ASSERT_EQ(result.rc, -1);
+   ASSERT_EQ(result.error, ECANCELED);
+   ASSERT_EQ(reactor.timers().size(), 0u);
+
+   // A second reader can wait once the first one is gone
+   Result again;
+   io.spawn(receive(io, sockRcv, 1000, again));
+   ASSERT_FALSE(again.done);
+   io.remove(sockRcv);
+   ASSERT_TRUE(again.done);
+   ASSERT_EQ(again.error, ECANCELED);
+   ASSERT_FALSE(reactor.contains(sockRcv));
+}
+
+TEST(IoContext, busy)
+{
+   SocketDGRAM sockRcv, sockSnd;
+   openPair(sockRcv, sockSnd);
+
+   Reactor reactor;
+   IoContext io(reactor);
+   Result first, second;
+   io.spawn(receive(io, sockRcv, 1000, first));
+   io.spawn(receive(io, sockRcv, 1000, second));
+
+   // Only one reader can wait on a socket
+   ASSERT_FALSE(first.done);
+   ASSERT_TRUE(second.done);
+   ASSERT_EQ(second.rc, -1);
+   ASSERT_EQ(second.error, EBUSY);
+
+   io.remove(sockRcv);
+   ASSERT_TRUE(first.done);
+}
+
+#endif
@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : fanoutgroup.cpp
+// Contents  : gtests FanoutGroup
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <system_error>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include "fanoutgroup.h"
+
+#include "extern.h"
+
+namespace
+{
+   // The UDP source port of an incoming lo frame to Port, zero otherwise
+   uint16_t udpSource(const PacketRing::Frame &frame, uint16_t Port)
+   {
+      const uint32_t ipOffset = sizeof(ethhdr);
+      if (frame.pktType == PACKET_OUTGOING || frame.protocol != ETH_P_IP ||
+          frame.length < ipOffset + sizeof(iphdr) + sizeof(udphdr))
+         return 0;
+      auto ip = reinterpret_cast<const iphdr *>(frame.data + ipOffset);
+      if (ip->protocol != IPPROTO_UDP)
+         return 0;
+      auto udp = reinterpret_cast<const udphdr *>(frame.data + ipOffset + ip->ihl * 4);
+      if (ntohs(udp->dest) != Port)
+         return 0;
+      return ntohs(udp->source);
+   }
+
+   std::unique_ptr<FanoutGroup> makeGroup(uint32_t members, FanoutGroup::Mode mode)
+   {
+      try
+      {
+         return std::unique_ptr<FanoutGroup>(new FanoutGroup(IfIndex("lo"), members, mode, ETH_P_IP,
+                                                             PACKET_FANOUT_FLAG_DEFRAG, 1 << 16, 8));
+      }
+      catch (const std::system_error &exp)
+      {
+         std::cout << "FanoutGroup not available, not tested : " << exp.what() << std::endl;
+      }
+      return nullptr;
+   }
+
+   // Send count datagrams on each of flows sockets, one source port per flow
+   void sendFlows(uint16_t Port, uint32_t flows, uint32_t count)
+   {
+      std::vector<SocketDGRAM> senders(flows);
+      for (auto &sock : senders)
+      {
+         ASSERT_EQ(sock.setAddr("127.0.0.1", Port), 0);
+         ASSERT_NE(sock.open(), INVALID_SOCKET);
+      }
+      for (uint32_t i = 0; i < count; i++)
+         for (auto &sock : senders)
+            ASSERT_EQ(sock.send(i), sizeof(i));
+   }
+}
+
+TEST(FanoutGroup, hash)
+{
+   uint16_t Port = port + portOffset++;
+   auto group = makeGroup(2, FanoutGroup::HASH);
+   if (!group)
+      return;
+   ASSERT_EQ(group->size(), 2u);
+
+   std::mutex mutex;
+   std::map<uint16_t, std::set<uint32_t>> flowMembers;
+   std::map<uint16_t, uint32_t> flowNext;
+   std::atomic<uint32_t> received(0);
+   bool ordered = true;
+
+   group->start([&](const PacketRing::Frame &frame, uint32_t member) {
+      uint16_t source = udpSource(frame, Port);
+      if (source == 0)
+         return;
+      uint32_t value;
+      memcpy(&value, frame.data + frame.length - sizeof(value), sizeof(value));
+      std::lock_guard<std::mutex> lock(mutex);
+      flowMembers[source].insert(member);
+      ordered &= (ntohl(value) == flowNext[source]++);
+      received++;
+   });
+
+   const uint32_t flows = 16;
+   const uint32_t count = 50;
+   sendFlows(Port, flows, count);
+
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+   while (received < flows * count && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   group->stop();
+
+   ASSERT_EQ(received, flows * count);
+   ASSERT_TRUE(ordered);
+   ASSERT_EQ(flowMembers.size(), flows);
+   // A flow always lands on the same member
+   for (const auto &flow : flowMembers)
+      ASSERT_EQ(flow.second.size(), 1u);
+   ASSERT_EQ(group->stats().drops, 0u);
+}
+
+TEST(FanoutGroup, cbpf)
+{
+   uint16_t Port = port + portOffset++;
+   auto group = makeGroup(2, FanoutGroup::CBPF);
+   if (!group)
+      return;
+
+   // Every frame goes to the member 1
+   sock_filter code[] = {BPF_STMT(BPF_RET | BPF_K, 1)};
+   ASSERT_EQ(group->setProgram(code, 1), 0);
+
+   std::atomic<uint32_t> received(0);
+   std::atomic<uint32_t> misplaced(0);
+   group->start([&](const PacketRing::Frame &frame, uint32_t member) {
+      if (udpSource(frame, Port) == 0)
+         return;
+      if (member != 1)
+         misplaced++;
+      received++;
+   }, false);
+
+   const uint32_t flows = 4;
+   const uint32_t count = 25;
+   sendFlows(Port, flows, count);
+
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+   while (received < flows * count && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   group->stop();
+
+   ASSERT_EQ(received, flows * count);
+   ASSERT_EQ(misplaced, 0u);
+}
+
+TEST(FanoutGroup, unique_ids)
+{
+   uint16_t Port = port + portOffset++;
+
+   // Default constructed groups do not share an id, whatever their mode
+   auto groupA = makeGroup(1, FanoutGroup::HASH);
+   if (!groupA)
+      return;
+   auto groupB = makeGroup(1, FanoutGroup::LB);
+   auto groupC = makeGroup(1, FanoutGroup::HASH);
+   ASSERT_TRUE(groupB && groupC);
+   ASSERT_NE(groupA->groupId(), groupB->groupId());
+   ASSERT_NE(groupA->groupId(), groupC->groupId());
+   ASSERT_NE(groupB->groupId(), groupC->groupId());
+
+   // Each group gets its own copy of every frame
+   std::atomic<uint32_t> receivedA(0), receivedC(0);
+   groupA->start([&](const PacketRing::Frame &frame, uint32_t) {
+      if (udpSource(frame, Port) != 0)
+         receivedA++;
+   }, false);
+   groupC->start([&](const PacketRing::Frame &frame, uint32_t) {
+      if (udpSource(frame, Port) != 0)
+         receivedC++;
+   }, false);
+
+   const uint32_t count = 20;
+   sendFlows(Port, 1, count);
+
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+   while ((receivedA < count || receivedC < count) && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   groupA->stop();
+   groupC->stop();
+
+   ASSERT_EQ(receivedA, count);
+   ASSERT_EQ(receivedC, count);
+   ASSERT_EQ(groupA->error(), 0);
+   ASSERT_EQ(groupC->error(), 0);
+}
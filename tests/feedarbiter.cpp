@@ -0,0 +1,186 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : feedarbiter.cpp
+// Contents  : gtests FeedArbiter
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <thread>
+#include "_endian.h"
+#include "feedarbiter.h"
+
+#include "extern.h"
+
+namespace
+{
+   // 4 bytes header, 8 bytes big endian sequence number
+   int sendSeq(SocketDGRAM &sock, uint64_t seq)
+   {
+      uint8_t buffer[12] = {'F', 'E', 'E', 'D'};
+      uint64_t value = htobe64(seq);
+      memcpy(buffer + 4, &value, sizeof(value));
+      return sock.send(buffer, sizeof(buffer));
+   }
+
+   void openLine(SocketDGRAM &sockRcv, SocketDGRAM &sockSnd, uint16_t Port)
+   {
+      ASSERT_EQ(sockRcv.setAddr("127.0.0.1", Port), 0);
+      ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+      int size = 1 << 20;
+      ASSERT_EQ(sockRcv.setOption(SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)), 0);
+      ASSERT_EQ(sockRcv.bind(), 0);
+      ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+      ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+   }
+}
+
+TEST(FeedArbiter, dedupe_and_gaps)
+{
+   uint16_t PortA = port + portOffset++;
+   uint16_t PortB = port + portOffset++;
+
+   SocketDGRAM rcvA(AF_INET), sndA(AF_INET), rcvB(AF_INET), sndB(AF_INET);
+   openLine(rcvA, sndA, PortA);
+   openLine(rcvB, sndB, PortB);
+
+   FeedArbiter arbiter(SequenceField(4, 8), 256, 64, 256);
+   ASSERT_EQ(arbiter.addLine(rcvA), 0u);
+   ASSERT_EQ(arbiter.addLine(rcvB), 1u);
+
+   // Line A misses 10 and 20, line B misses 20 and 50
+   for (uint64_t seq = 0; seq < 100; seq++)
+   {
+      if (seq != 10 && seq != 20)
+      {
+         ASSERT_EQ(sendSeq(sndA, seq), 12);
+      }
+      if (seq != 20 && seq != 50)
+      {
+         ASSERT_EQ(sendSeq(sndB, seq), 12);
+      }
+   }
+
+   for (uint32_t line = 0, queued = 0; line < 2; line++, queued = 0)
+   {
+      while (queued < 98)
+      {
+         int n = arbiter.receive(line, 1000);
+         ASSERT_GT(n, 0);
+         queued += n;
+      }
+   }
+
+   std::vector<uint64_t> delivered;
+   std::vector<std::pair<uint64_t, uint64_t>> gaps;
+   ASSERT_EQ(arbiter.poll([&delivered](uint64_t seq, const void *, uint32_t length, uint32_t) {
+                            ASSERT_EQ(length, 12u);
+                            delivered.push_back(seq);
+                         },
+                         [&gaps](uint64_t first, uint64_t count) { gaps.emplace_back(first, count); }),
+             196u);
+
+   ASSERT_EQ(delivered.size(), 99u);
+   for (size_t i = 1; i < delivered.size(); i++)
+      ASSERT_LT(delivered[i - 1], delivered[i]);
+   ASSERT_EQ(gaps.size(), 1u);
+   ASSERT_EQ(gaps[0].first, 20u);
+   ASSERT_EQ(gaps[0].second, 1u);
+
+   auto &stats = arbiter.stats();
+   ASSERT_EQ(stats.delivered, 99u);
+   ASSERT_EQ(stats.duplicates, 97u);
+   ASSERT_EQ(stats.missing, 1u);
+   ASSERT_EQ(arbiter.next(), 100u);
+}
+
+TEST(FeedArbiter, far_jump)
+{
+   uint16_t Port = port + portOffset++;
+
+   SocketDGRAM rcv(AF_INET), snd(AF_INET);
+   openLine(rcv, snd, Port);
+
+   FeedArbiter arbiter(SequenceField(4, 8));
+   arbiter.addLine(rcv);
+   arbiter.setNext(1);
+
+   // A far ahead sequence number is one gap, skipped without visiting it
+   const uint64_t far = uint64_t(1) << 34;
+   const uint64_t seqs[] = {1, 2, 4, far, far + 1};
+   for (auto seq : seqs)
+      ASSERT_EQ(sendSeq(snd, seq), 12);
+
+   uint32_t queued = 0;
+   while (queued < 5)
+   {
+      int n = arbiter.receive(0, 1000);
+      ASSERT_GT(n, 0);
+      queued += n;
+   }
+
+   std::vector<uint64_t> delivered;
+   std::vector<std::pair<uint64_t, uint64_t>> gaps;
+   auto t0 = std::chrono::steady_clock::now();
+   ASSERT_EQ(arbiter.poll([&delivered](uint64_t seq, const void *, uint32_t, uint32_t) { delivered.push_back(seq); },
+                          [&gaps](uint64_t first, uint64_t count) { gaps.emplace_back(first, count); }),
+             5u);
+   ASSERT_LT(std::chrono::steady_clock::now() - t0, std::chrono::milliseconds(100));
+
+   ASSERT_EQ(delivered, std::vector<uint64_t>(std::begin(seqs), std::end(seqs)));
+   ASSERT_EQ(gaps.size(), 2u);
+   ASSERT_EQ(gaps[0], std::make_pair(uint64_t(3), uint64_t(1)));
+   ASSERT_EQ(gaps[1], std::make_pair(uint64_t(5), far - 5));
+   ASSERT_EQ(arbiter.stats().gaps, 2u);
+   ASSERT_EQ(arbiter.stats().missing, far - 4);
+   ASSERT_EQ(arbiter.next(), far + 2);
+   ASSERT_EQ(arbiter.error(0), 0);
+}
+
+TEST(FeedArbiter, threads)
+{
+   uint16_t PortA = port + portOffset++;
+   uint16_t PortB = port + portOffset++;
+
+   SocketDGRAM rcvA(AF_INET), sndA(AF_INET), rcvB(AF_INET), sndB(AF_INET);
+   openLine(rcvA, sndA, PortA);
+   openLine(rcvB, sndB, PortB);
+
+   FeedArbiter arbiter(SequenceField(4, 8));
+   arbiter.addLine(rcvA);
+   arbiter.addLine(rcvB);
+   arbiter.setNext(1);
+   arbiter.start();
+
+   const uint64_t count = 10000;
+   auto sender = std::thread([&]() {
+      for (uint64_t seq = 1; seq <= count; seq++)
+      {
+         sendSeq(sndA, seq);
+         sendSeq(sndB, seq);
+      }
+   });
+
+   uint64_t expected = 1;
+   bool ordered = true;
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+   while (arbiter.next() <= count && std::chrono::steady_clock::now() < deadline)
+   {
+      arbiter.poll([&](uint64_t seq, const void *, uint32_t, uint32_t) {
+         ordered &= (seq >= expected);
+         expected = seq + 1;
+      });
+   }
+   sender.join();
+   arbiter.stop();
+
+   ASSERT_TRUE(ordered);
+   ASSERT_EQ(arbiter.next(), count + 1);
+   ASSERT_EQ(arbiter.stats().delivered + arbiter.stats().missing, count);
+}
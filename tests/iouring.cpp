@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : iouring.cpp
+// Contents  : gtests IoUring
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include "iouring.h"
+#include "socketstream.h"
+
+#include "extern.h"
+
+static std::unique_ptr<IoUring> makeRing()
+{
+   try
+   {
+      return std::unique_ptr<IoUring>(new IoUring(32));
+   }
+   catch (const std::system_error &e)
+   {
+      std::cout << "io_uring not available: " << e.what() << std::endl;
+      return nullptr;
+   }
+}
+
+TEST(IoUring, accept_connect_send_recv)
+{
+   auto ring = makeRing();
+   if (!ring)
+      return;
+
+   auto Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(), 0);
+
+   SocketSTREAM sockCli(AF_INET);
+   ASSERT_EQ(sockCli.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockCli.open(), INVALID_SOCKET);
+
+   SocketSTREAM wsock;
+   int acceptRc = 1, connectRc = 1;
+   ASSERT_EQ(ring->accept(sockSrv, wsock, [&](int rc) { acceptRc = rc; }), 0);
+   ASSERT_EQ(ring->connect(sockCli, [&](int rc) { connectRc = rc; }), 0);
+   ASSERT_EQ(ring->pending(), 2u);
+   ASSERT_EQ(ring->submit(), 2);
+
+   while (ring->inflight())
+      ASSERT_GE(ring->complete(1), 0);
+   ASSERT_GE(acceptRc, 0);
+   ASSERT_EQ(connectRc, 0);
+   ASSERT_TRUE(wsock.isOpen());
+
+   // one submission for the whole batch
+   const char *msg[3] = {"one", "two", "three"};
+   int sent = 0;
+   for (auto m : msg)
+      ASSERT_EQ(ring->send(sockCli, m, (uint32_t)strlen(m), [&](int rc) { ASSERT_GT(rc, 0); sent += rc; }), 0);
+   ASSERT_EQ(ring->submit(), 3);
+
+   char buffer[32] = {};
+   int received = 0;
+   while (received < 11)
+   {
+      ASSERT_EQ(ring->recv(wsock, buffer + received, sizeof(buffer) - received, [&](int rc) { ASSERT_GT(rc, 0); received += rc; }), 0);
+      while (ring->inflight())
+         ASSERT_GE(ring->complete(1), 0);
+   }
+   ASSERT_EQ(sent, 11);
+   ASSERT_EQ(std::string(buffer), "onetwothree");
+}
+
+TEST(IoUring, fixed_buffers_and_sockets)
+{
+   auto ring = makeRing();
+   if (!ring)
+      return;
+
+   auto Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(), 0);
+
+   SocketSTREAM sockCli(AF_INET);
+   ASSERT_EQ(sockCli.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockCli.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockCli.connect(), 0);
+   SocketSTREAM wsock = sockSrv.accept();
+   ASSERT_TRUE(wsock.isOpen());
+
+   static char sndBuffer[4096];
+   static char rcvBuffer[4096];
+   iovec iov[2] = {{sndBuffer, sizeof(sndBuffer)}, {rcvBuffer, sizeof(rcvBuffer)}};
+   ASSERT_EQ(ring->registerBuffers(iov, 2), 0);
+
+   Socket *socks[2] = {&sockCli, &wsock};
+   ASSERT_EQ(ring->registerSockets(socks, 2), 0);
+
+   memset(sndBuffer, 0x5a, sizeof(sndBuffer));
+   int sent = 0, received = 0;
+   ASSERT_EQ(ring->sendFixed(sockCli, 0, sndBuffer, 1024, [&](int rc) { sent = rc; }), 0);
+   ASSERT_EQ(ring->submit(), 1);
+   while (ring->inflight())
+      ASSERT_GE(ring->complete(1), 0);
+   ASSERT_EQ(sent, 1024);
+
+   while (received < 1024)
+   {
+      ASSERT_EQ(ring->recvFixed(wsock, 1, rcvBuffer + received, 1024 - received, [&](int rc) { ASSERT_GT(rc, 0); received += rc; }), 0);
+      while (ring->inflight())
+         ASSERT_GE(ring->complete(1), 0);
+   }
+   ASSERT_EQ(memcmp(sndBuffer, rcvBuffer, 1024), 0);
+
+   ASSERT_EQ(ring->unregisterSockets(), 0);
+   ASSERT_EQ(ring->unregisterBuffers(), 0);
+}
@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : multicastdemux.cpp
+// Contents  : gtests MulticastDemux
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include "multicastdemux.h"
+
+#include "extern.h"
+
+TEST(MulticastDemux, dispatch)
+{
+   uint16_t Port = port + portOffset++;
+   int index = IfIndex(IfName(IfIpAddr));
+
+   SocketDGRAM sockRcv(AF_INET);
+   ASSERT_EQ(sockRcv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+
+   MulticastDemux demux(sockRcv);
+   std::map<std::string, int> received;
+   const char *groups[] = {"239.1.3.1", "239.1.3.2", "239.1.3.3"};
+   for (auto group : groups)
+   {
+      std::string name(group);
+      ASSERT_EQ(demux.subscribe(group, index, [&received, name](const datagram &msg) {
+         ASSERT_EQ(std::string(static_cast<const char *>(msg.buffer), msg.length), name);
+         ASSERT_EQ(msg.dst.size, sizeof(sockaddr_in));
+         received[name]++;
+      }), 0);
+   }
+   ASSERT_EQ(demux.size(), 3u);
+   ASSERT_EQ(demux.subscribe("239.1.3.1", index, nullptr), -1);
+   ASSERT_EQ(sockRcv.groupCount(), 3u);
+
+   int others = 0;
+   demux.setDefaultHandler([&others](const datagram &) { others++; });
+
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+   ip_mreqn mreq = {};
+   mreq.imr_ifindex = index;
+   ASSERT_EQ(sockSnd.setOption(IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)), 0);
+
+   for (int i = 0; i < 2; i++)
+   {
+      for (auto group : groups)
+      {
+         ASSERT_EQ(sockSnd.setAddr(group, Port), 0);
+         ASSERT_EQ(sockSnd.send(std::string(group)), (int)strlen(group));
+      }
+   }
+   // Unicast datagrams go to the default handler
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_EQ(sockSnd.send(std::string("unicast")), 7);
+
+   int total = 0;
+   while (total < 7)
+   {
+      int n = demux.poll(1000);
+      ASSERT_GT(n, 0);
+      total += n;
+   }
+   for (auto group : groups)
+      ASSERT_EQ(received[group], 2);
+   ASSERT_EQ(others, 1);
+
+   ASSERT_EQ(demux.unsubscribe("239.1.3.2", index), 0);
+   ASSERT_EQ(demux.unsubscribe("239.1.3.2", index), -1);
+   ASSERT_EQ(demux.size(), 2u);
+   ASSERT_EQ(sockRcv.groupCount(), 2u);
+}
+
+TEST(MulticastDemux, unsubscribe_from_handler)
+{
+   uint16_t Port = port + portOffset++;
+   int index = IfIndex(IfName(IfIpAddr));
+
+   SocketDGRAM sockRcv(AF_INET);
+   ASSERT_EQ(sockRcv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+
+   // The handler leaves its own group on the first datagram
+   MulticastDemux demux(sockRcv);
+   std::string group("239.1.3.4");
+   int received = 0;
+   int others = 0;
+   ASSERT_EQ(demux.subscribe(group, index, [&demux, &received, group, index](const datagram &) {
+      received++;
+      ASSERT_EQ(demux.unsubscribe(group, index), 0);
+      ASSERT_EQ(group, "239.1.3.4");
+   }), 0);
+   demux.setDefaultHandler([&others](const datagram &) { others++; });
+
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+   ip_mreqn mreq = {};
+   mreq.imr_ifindex = index;
+   ASSERT_EQ(sockSnd.setOption(IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)), 0);
+   ASSERT_EQ(sockSnd.setAddr(group, Port), 0);
+   ASSERT_EQ(sockSnd.send(group), (int)group.size());
+   ASSERT_EQ(sockSnd.send(group), (int)group.size());
+
+   int total = 0;
+   while (total < 2)
+   {
+      int n = demux.poll(1000);
+      ASSERT_GT(n, 0);
+      total += n;
+   }
+   ASSERT_EQ(received, 1);
+   ASSERT_EQ(others, 1);
+   ASSERT_EQ(demux.size(), 0u);
+}
+
+TEST(MulticastDemux, closed_socket)
+{
+   // No IP_PKTINFO on a socket that is not open
+   SocketDGRAM sock(AF_INET);
+   ASSERT_THROW(MulticastDemux demux(sock), std::system_error);
+}
@@ -0,0 +1,222 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : packetring.cpp
+// Contents  : gtests PacketRing
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include "packetring.h"
+
+#include "extern.h"
+
+namespace
+{
+   // The UDP payload of a frame, the lo frames have a zeroed ethernet header
+   const uint8_t *udpPayload(const PacketRing::Frame &frame, uint16_t Port)
+   {
+      const uint32_t ipOffset = sizeof(ethhdr);
+      if (frame.protocol != ETH_P_IP || frame.length < ipOffset + sizeof(iphdr) + sizeof(udphdr))
+         return nullptr;
+      auto ip = reinterpret_cast<const iphdr *>(frame.data + ipOffset);
+      if (ip->protocol != IPPROTO_UDP)
+         return nullptr;
+      auto udp = reinterpret_cast<const udphdr *>(frame.data + ipOffset + ip->ihl * 4);
+      if (ntohs(udp->dest) != Port)
+         return nullptr;
+      return reinterpret_cast<const uint8_t *>(udp + 1);
+   }
+}
+
+TEST(PacketRing, capture)
+{
+   uint16_t Port = port + portOffset++;
+
+   std::unique_ptr<PacketRing> ring;
+   try
+   {
+      ring.reset(new PacketRing(IfIndex("lo"), ETH_P_IP, 1 << 16, 8, 5));
+   }
+   catch (const std::system_error &exp)
+   {
+      std::cout << "PacketRing not available, not tested : " << exp.what() << std::endl;
+      return;
+   }
+
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   const uint32_t count = 100;
+   for (uint32_t i = 0; i < count; i++)
+      ASSERT_EQ(sockSnd.send(i), sizeof(i));
+
+   // Each loopback datagram is seen twice, outgoing and incoming
+   uint32_t received = 0;
+   uint32_t expected = 0;
+   bool ordered = true;
+   while (received < count)
+   {
+      int n = ring->poll([&](const PacketRing::Frame &frame) {
+         auto payload = udpPayload(frame, Port);
+         if (payload == nullptr || frame.pktType == PACKET_OUTGOING)
+            return;
+         uint32_t value;
+         memcpy(&value, payload, sizeof(value));
+         ordered &= (ntohl(value) == expected++);
+         received++;
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_TRUE(ordered);
+
+   // Frame by frame
+   ASSERT_EQ(sockSnd.send(uint32_t(count)), sizeof(uint32_t));
+   PacketRing::Frame frame;
+   const uint8_t *payload = nullptr;
+   while (payload == nullptr || frame.pktType == PACKET_OUTGOING)
+   {
+      ASSERT_EQ(ring->next(frame, 1000), 1);
+      payload = udpPayload(frame, Port);
+   }
+   uint32_t value;
+   memcpy(&value, payload, sizeof(value));
+   ASSERT_EQ(ntohl(value), count);
+   ASSERT_NE(frame.stamp.tv_sec, 0);
+   ASSERT_EQ(frame.ifIndex, IfIndex("lo"));
+
+   auto stats = ring->stats();
+   ASSERT_GE(stats.packets, 2 * count);
+   ASSERT_EQ(stats.drops, 0u);
+}
+
+TEST(PacketRing, next_then_poll)
+{
+   uint16_t Port = port + portOffset++;
+
+   std::unique_ptr<PacketRing> ring;
+   try
+   {
+      ring.reset(new PacketRing(IfIndex("lo"), ETH_P_IP, 1 << 16, 8, 5));
+   }
+   catch (const std::system_error &exp)
+   {
+      std::cout << "PacketRing not available, not tested : " << exp.what() << std::endl;
+      return;
+   }
+
+   // A bound receiver : no ICMP port unreachable follows the datagram in its block
+   SocketDGRAM sockRcv(AF_INET);
+   ASSERT_EQ(sockRcv.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   // next() reads the datagram, the last frame of its block
+   ASSERT_EQ(sockSnd.send(uint32_t(1)), sizeof(uint32_t));
+   PacketRing::Frame frame;
+   do
+   {
+      ASSERT_EQ(ring->next(frame, 1000), 1);
+   } while (udpPayload(frame, Port) == nullptr);
+
+   // poll() must not deliver that block again
+   ASSERT_EQ(sockSnd.send(uint32_t(2)), sizeof(uint32_t));
+   uint32_t received = 0;
+   uint32_t replayed = 0;
+   while (received < 1)
+   {
+      int n = ring->poll([&](const PacketRing::Frame &f) {
+         auto payload = udpPayload(f, Port);
+         if (payload == nullptr)
+            return;
+         uint32_t value;
+         memcpy(&value, payload, sizeof(value));
+         if (ntohl(value) == 1)
+            replayed++;
+         else
+            received++;
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_EQ(replayed, 0u);
+}
+
+TEST(PacketTxRing, send)
+{
+   const uint16_t protocol = 0x88B5;   // IEEE local experimental
+   int lo = IfIndex("lo");
+
+   std::unique_ptr<PacketRing> rxRing;
+   std::unique_ptr<PacketTxRing> txRing;
+   try
+   {
+      rxRing.reset(new PacketRing(lo, protocol, 1 << 16, 8, 5));
+      txRing.reset(new PacketTxRing(lo, 256, 64, protocol));
+   }
+   catch (const std::system_error &exp)
+   {
+      std::cout << "PacketTxRing not available, not tested : " << exp.what() << std::endl;
+      return;
+   }
+   ASSERT_EQ(txRing->capacity(), 256u - TPACKET_ALIGN(sizeof(tpacket2_hdr)));
+   ASSERT_EQ(txRing->available(), 64u);
+
+   const uint32_t count = 100;
+   uint32_t committed = 0;
+   while (committed < count)
+   {
+      uint8_t *frame = txRing->acquire();
+      if (frame == nullptr)
+      {
+         // The ring is full : send and wait for the free slots
+         ASSERT_GE(txRing->flush(), 0);
+         ASSERT_EQ(txRing->wait(1000), 1);
+         continue;
+      }
+      auto eth = reinterpret_cast<ethhdr *>(frame);
+      memset(eth->h_dest, 0xFF, ETH_ALEN);
+      memset(eth->h_source, 0, ETH_ALEN);
+      eth->h_proto = htons(protocol);
+      uint32_t value = htonl(committed);
+      memcpy(frame + sizeof(ethhdr), &value, sizeof(value));
+      ASSERT_EQ(txRing->commit(sizeof(ethhdr) + 60), 0);
+      committed++;
+   }
+   ASSERT_GT(txRing->pending(), 0u);
+   ASSERT_GE(txRing->flush(true), 0);
+   ASSERT_EQ(txRing->pending(), 0u);
+   ASSERT_EQ(txRing->commit(txRing->capacity() + 1), -1);
+
+   uint32_t received = 0;
+   uint32_t expected = 0;
+   bool ordered = true;
+   while (received < count)
+   {
+      int n = rxRing->poll([&](const PacketRing::Frame &frame) {
+         if (frame.pktType == PACKET_OUTGOING || frame.protocol != protocol)
+            return;
+         uint32_t value;
+         memcpy(&value, frame.data + sizeof(ethhdr), sizeof(value));
+         ordered &= (ntohl(value) == expected++);
+         received++;
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_TRUE(ordered);
+   ASSERT_EQ(txRing->available(), 64u);
+}
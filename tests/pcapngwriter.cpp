@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : pcapngwriter.cpp
+// Contents  : gtests PcapngWriter
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <netinet/ip.h>
+#include "pcapngwriter.h"
+
+#include "extern.h"
+
+namespace
+{
+   std::string tempPrefix(const std::string &name)
+   {
+      return "/tmp/libSocket-" + name + "-" + std::to_string(getpid());
+   }
+
+   bool exists(const std::string &path)
+   {
+      return access(path.c_str(), F_OK) == 0;
+   }
+
+   /// Read a pcapng file, check its blocks and collect the UDP payload of its packets.
+   bool readCapture(const std::string &path, std::vector<uint32_t> &values)
+   {
+      std::ifstream file(path, std::ios::binary);
+      std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+      if (data.size() < 28)
+         return false;
+
+      auto u32 = [&data](size_t offset) {
+         uint32_t v;
+         memcpy(&v, &data[offset], sizeof(v));
+         return v;
+      };
+      if (u32(0) != 0x0A0D0D0A || u32(8) != 0x1A2B3C4D)
+         return false;
+
+      size_t offset = 0;
+      while (offset < data.size())
+      {
+         uint32_t type = u32(offset);
+         uint32_t length = u32(offset + 4);
+         if (length < 12 || length % 4 != 0 || offset + length > data.size() || u32(offset + length - 4) != length)
+            return false;
+         if (type == 6)
+         {
+            uint32_t captured = u32(offset + 20);
+            auto ip = &data[offset + 28];
+            if (captured != 20 + 8 + sizeof(uint32_t) || (ip[0] >> 4) != 4)
+               return false;
+            uint32_t value;
+            memcpy(&value, ip + 28, sizeof(value));
+            values.push_back(ntohl(value));
+         }
+         offset += length;
+      }
+      return true;
+   }
+}
+
+TEST(PcapngWriter, datagrams)
+{
+   uint16_t Port = port + portOffset++;
+   auto prefix = tempPrefix("datagrams");
+
+   SocketDGRAM sockRcv(AF_INET);
+   ASSERT_EQ(sockRcv.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+   ASSERT_EQ(sockRcv.enablePktInfo(), 0);
+
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   const uint32_t count = 500;
+   uint32_t files = 0;
+   {
+      // A 4KB file holds about 60 datagrams
+      PcapngWriter writer(prefix, 4096);
+      ASSERT_EQ(writer.addInterface(PcapngWriter::RAW, "udp"), 0);
+      ASSERT_EQ(writer.write(1, "x", 1, 1, timespec()), -1);
+      ASSERT_EQ(errno, EINVAL);
+
+      const uint32_t batch = 16;
+      uint32_t values[batch];
+      datagram msgs[batch];
+      for (uint32_t i = 0; i < batch; i++)
+      {
+         msgs[i] = {};
+         msgs[i].buffer = &values[i];
+         msgs[i].size = sizeof(values[i]);
+      }
+
+      auto local = sockRcv.getSocketaddr();
+      uint32_t sent = 0;
+      uint32_t received = 0;
+      while (received < count)
+      {
+         // A batch at a time, the receive buffer would overflow
+         for (; sent < received + batch && sent < count; sent++)
+            ASSERT_EQ(sockSnd.send(sent), sizeof(sent));
+         int n = sockRcv.recvBatch(msgs, batch, 1000);
+         ASSERT_GT(n, 0);
+         for (int i = 0; i < n; i++)
+            ASSERT_EQ(writer.write(msgs[i], local), 0);
+         received += n;
+      }
+
+      // Switched off, nothing is written
+      writer.enable(false);
+      ASSERT_FALSE(writer.isEnabled());
+      ASSERT_EQ(writer.write(msgs[0], local), 0);
+      ASSERT_EQ(writer.packets(), count);
+      files = writer.fileIndex() + 1;
+      ASSERT_GT(files, 1u);
+   }
+
+   // The files are truncated to their content and hold all the datagrams in order
+   std::vector<uint32_t> values;
+   for (uint32_t i = 0; i < files; i++)
+   {
+      auto path = prefix + "-" + std::string(5 - std::to_string(i).size(), '0') + std::to_string(i) + ".pcapng";
+      ASSERT_TRUE(readCapture(path, values)) << path;
+      unlink(path.c_str());
+   }
+   ASSERT_EQ(values.size(), count);
+   for (uint32_t i = 0; i < count; i++)
+      ASSERT_EQ(values[i], i);
+}
+
+TEST(PcapngWriter, maxFiles)
+{
+   auto prefix = tempPrefix("maxfiles");
+   uint32_t last = 0;
+   {
+      PcapngWriter writer(prefix, 4096, 2, 1);
+      ASSERT_EQ(writer.addInterface(PcapngWriter::ETHERNET, "eth", 64), 0);
+
+      // 64 bytes snap length : 96 bytes blocks
+      uint8_t frame[1500] = {};
+      timespec stamp = {1, 2};
+      for (uint32_t i = 0; i < 1000; i++)
+         ASSERT_EQ(writer.write(0, frame, sizeof(frame), sizeof(frame), stamp), 0);
+      last = writer.fileIndex();
+      ASSERT_GT(last, 3u);
+      ASSERT_EQ(writer.write(0, frame, 4096, 4096, stamp), 0);
+
+      // Let the flusher delete the old files
+      for (int i = 0; i < 100 && exists(writer.fileName(last - 2)); i++)
+         usleep(10000);
+      ASSERT_FALSE(exists(writer.fileName(0)));
+      ASSERT_FALSE(exists(writer.fileName(last - 2)));
+   }
+
+   for (uint32_t i = 0; i <= last + 1; i++)
+   {
+      auto path = prefix + "-" + std::string(5 - std::to_string(i).size(), '0') + std::to_string(i) + ".pcapng";
+      ASSERT_EQ(exists(path), i + 2 > last && i <= last) << path;
+      unlink(path.c_str());
+   }
+}
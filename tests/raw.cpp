@@ -18,6 +18,7 @@
 #include <iostream>
 
 #include "socketdgram.h"
+#include "packetring.h"
 
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
@@ -92,6 +93,64 @@ int rawSender(socketaddr macAddrSrc, socketaddr macAddrDst, uint32_t packetSize,
    return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+int ringSender(const std::string &ifName, socketaddr macAddrDst, uint32_t packetSize)
+{
+   try
+   {
+      auto macAddrSrc = MacAddr_fromIfName(ifName);
+      PacketTxRing ring(IfIndex(ifName), 2048, 4096);
+
+      uint32_t frameLength = (packetSize > sizeof(ethhdr) + 4) ? packetSize : sizeof(ethhdr) + 4;
+      if (frameLength > ring.capacity())
+         frameLength = ring.capacity();
+
+      uint32_t numPackets = 0;
+      uint64_t size = 0;
+      std::chrono::time_point<std::chrono::steady_clock> T1 = std::chrono::steady_clock::now();
+      do
+      {
+         // Fill all the free slots, then one syscall sends them
+         uint8_t *frame = nullptr;
+         while ((frame = ring.acquire()) != nullptr)
+         {
+            ethhdr* eth = (ethhdr*)frame;
+            memcpy(eth->h_source, macAddrSrc.sa.sa_data, 6);
+            memcpy(eth->h_dest,   macAddrDst.sa.sa_data, 6);
+            eth->h_proto = (frameLength < 1500) ? htons(0x7999) : htons(0x8870);
+            memcpy(frame + sizeof(ethhdr), &numPackets, sizeof(numPackets));
+            ring.commit(frameLength);
+            numPackets++;
+            size += frameLength;
+         }
+         if (ring.flush() == -1 && errno != EAGAIN)
+         {
+            std::cout << "send failed " << strerror(errno) << std::endl;
+            return 1;
+         }
+         ring.wait(1000);
+
+         std::chrono::time_point<std::chrono::steady_clock> T2 = std::chrono::steady_clock::now();
+         int64_t dTns = std::chrono::duration_cast<std::chrono::nanoseconds>(T2-T1).count();
+         if (dTns >= 1000*1000*1000)
+         {
+            double dTsec = (double)dTns/(1000*1000*1000);
+            auto MbitSec = ((size * 8)/dTsec) / (1024*1024);
+            std::cout << std::setw(8) << std::setfill(' ');
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << MbitSec << " Mbio/s    NbPackets: "<< numPackets << std::endl;
+            T1 = T2;
+            size = 0;
+         }
+      } while (1);
+   }
+   catch (const std::exception &exp)
+   {
+      std::cout << exp.what() << std::endl;
+   }
+   return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 int rawReceiver()
 {
@@ -127,12 +186,53 @@ int rawReceiver()
    return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+int ringReceiver(const std::string &ifName)
+{
+   try
+   {
+      int ifIndex = ifName.empty() ? 0 : IfIndex(ifName);
+      PacketRing ring(ifIndex);
+
+      uint64_t numPackets = 0;
+      uint64_t size = 0;
+      std::chrono::time_point<std::chrono::steady_clock> T1 = std::chrono::steady_clock::now();
+      while (ring.poll([&](const PacketRing::Frame &frame) {
+                numPackets++;
+                size += frame.wireLength;
+             }, 1000) >= 0)
+      {
+         std::chrono::time_point<std::chrono::steady_clock> T2 = std::chrono::steady_clock::now();
+         int64_t dTns = std::chrono::duration_cast<std::chrono::nanoseconds>(T2-T1).count();
+         if (dTns >= 1000*1000*1000)
+         {
+            double dTsec = (double)dTns/(1000*1000*1000);
+            auto MbitSec = ((size * 8)/dTsec) / (1024*1024);
+            auto stats = ring.stats();
+            std::cout << std::setw(8) << std::setfill(' ');
+            std::cout << std::fixed << std::setprecision(3);
+            std::cout << MbitSec << " Mbio/s    NbPackets: " << numPackets << "    Drops: " << stats.drops << std::endl;
+            T1 = T2;
+            size = 0;
+            numPackets = 0;
+         }
+      }
+   }
+   catch (const std::exception &exp)
+   {
+      std::cout << exp.what() << std::endl;
+   }
+   return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void usage()
 {
    std::cout << "Usage\n";
    std::cout << "  raw --send IfNameSrc MacDst [packetSize=1480]\n",
+   std::cout << "  raw --ring-send IfName MacDst [packetSize=1480]\n";
    std::cout << "  raw --recv\n";
+   std::cout << "  raw --ring [IfName]\n";
 }
 
 int main(int argc, char **argv)
@@ -164,10 +264,21 @@ int main(int argc, char **argv)
       return rawSender(src, dst, packetSize, time);
    }
 
+   else if (strcmp(argv[1], "--ring-send") == 0 && argc >= 4)
+   {
+      int pktSize = (argc >= 5) ? std::atoi(argv[4]) : 1480;
+      if (pktSize < 0) pktSize = 0;
+      return ringSender(argv[2], MacAddr_fromString(argv[3]), static_cast<uint32_t>(pktSize));
+   }
+
    else if (strcmp(argv[1], "--recv") == 0)
    {
       return rawReceiver();
    }
+   else if (strcmp(argv[1], "--ring") == 0)
+   {
+      return ringReceiver(argc >= 3 ? argv[2] : "");
+   }
    else
       usage();
 
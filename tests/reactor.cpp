@@ -0,0 +1,201 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : reactor.cpp
+// Contents  : gtests Reactor
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "reactor.h"
+#include "socketdgram.h"
+#include "socketstream.h"
+
+#include "extern.h"
+
+TEST(Reactor, dgram_read)
+{
+   auto Port = port + portOffset++;
+
+   SocketDGRAM sockRcv;
+   ASSERT_EQ(sockRcv.setAnyAddr(AF_INET, Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+
+   SocketDGRAM sockSnd;
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   Reactor reactor;
+   int received = 0;
+   ASSERT_EQ(reactor.add(sockRcv, Reactor::READ, [&](Socket &sock, uint32_t events) {
+      ASSERT_TRUE(events & Reactor::READ);
+      uint32_t value = 0;
+      // edge-triggered : drain the socket
+      while (sock.recv(value) == sizeof(value))
+         received++;
+      ASSERT_EQ(sock.error(), EAGAIN);
+   }), 0);
+   ASSERT_TRUE(sockRcv.isNONBLOCK());
+   ASSERT_EQ(reactor.size(), 1u);
+
+   ASSERT_EQ(reactor.poll(0), 0);
+
+   for (uint32_t i = 0; i < 10; i++)
+      ASSERT_EQ(sockSnd.send(i), sizeof(i));
+
+   while (received < 10)
+      ASSERT_GE(reactor.poll(100), 0);
+   ASSERT_EQ(received, 10);
+
+   ASSERT_EQ(reactor.remove(sockRcv), 0);
+   ASSERT_FALSE(reactor.contains(sockRcv));
+   ASSERT_EQ(reactor.remove(sockRcv), -1);
+}
+
+TEST(Reactor, stream_accept_echo)
+{
+   auto Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(16), 0);
+
+   Reactor reactor;
+   std::vector<std::unique_ptr<SocketSTREAM>> clients;
+
+   auto onClient = [&](Socket &sock, uint32_t events) {
+      if (events & Reactor::READ)
+      {
+         uint32_t value = 0;
+         while (sock.recv(value) == sizeof(value))
+            sock.send(value + 1);
+      }
+      if (events & Reactor::HANGUP)
+         reactor.remove(sock);
+   };
+
+   ASSERT_EQ(reactor.add(sockSrv, Reactor::READ, [&](Socket &, uint32_t) {
+      while (1)
+      {
+         std::unique_ptr<SocketSTREAM> wsock(new SocketSTREAM(sockSrv.accept(false)));
+         if (!wsock->isOpen())
+            break;
+         ASSERT_EQ(reactor.add(*wsock, Reactor::READ | Reactor::HANGUP, onClient), 0);
+         clients.push_back(std::move(wsock));
+      }
+   }), 0);
+
+   auto clientTh = std::thread([Port]() {
+      for (uint32_t i = 0; i < 3; i++)
+      {
+         SocketSTREAM sock(AF_INET);
+         ASSERT_EQ(sock.setAddr("127.0.0.1", Port), 0);
+         ASSERT_NE(sock.open(), INVALID_SOCKET);
+         ASSERT_EQ(sock.connect(), 0);
+         uint32_t value = 0;
+         ASSERT_EQ(sock.send(i), sizeof(i));
+         ASSERT_EQ(sock.recv(value), sizeof(value));
+         ASSERT_EQ(value, i + 1);
+         ASSERT_EQ(sock.close(), 0);
+      }
+   });
+
+   while (clients.size() < 3 || reactor.size() > 1)
+      ASSERT_GE(reactor.poll(100), 0);
+
+   clientTh.join();
+   ASSERT_EQ(reactor.size(), 1u);
+}
+
+TEST(Reactor, add_failure)
+{
+   SocketDGRAM sock(AF_INET);
+   ASSERT_EQ(sock.setAnyAddr(AF_INET, 0), 0);
+   ASSERT_NE(sock.open(), INVALID_SOCKET);
+   ASSERT_FALSE(sock.isNONBLOCK());
+
+   // epoll_ctl rejects EPOLLEXCLUSIVE with EPOLLONESHOT : the socket stays blocking
+   Reactor reactor;
+   ASSERT_EQ(reactor.add(sock, EPOLLEXCLUSIVE | EPOLLONESHOT, [](Socket &, uint32_t) {}), -1);
+   ASSERT_EQ(errno, EINVAL);
+   ASSERT_FALSE(sock.isNONBLOCK());
+   ASSERT_FALSE(reactor.contains(sock));
+}
+
+TEST(Reactor, stop)
+{
+   Reactor reactor;
+   auto th = std::thread([&reactor]() { reactor.run(); });
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   reactor.stop();
+   th.join();
+}
+
+TEST(Reactor, timers)
+{
+   Reactor reactor;
+   bool fired = false;
+   Timer deadline([&fired]() { fired = true; });
+   reactor.timers().arm(deadline, 20);
+
+   auto t0 = std::chrono::steady_clock::now();
+   while (!fired)
+      ASSERT_GE(reactor.poll(-1), 0);
+   auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+   ASSERT_GE(dt, 19);
+   ASSERT_LT(dt, 200);
+}
+
+TEST(Reactor, timer_armed_after_idle)
+{
+   auto Port = port + portOffset++;
+
+   SocketDGRAM sockRcv;
+   ASSERT_EQ(sockRcv.setAnyAddr(AF_INET, Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+
+   SocketDGRAM sockSnd;
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   Reactor reactor;
+   std::chrono::steady_clock::time_point armed, fired;
+   Timer deadline([&fired]() { fired = std::chrono::steady_clock::now(); });
+   ASSERT_EQ(reactor.add(sockRcv, Reactor::READ, [&](Socket &sock, uint32_t) {
+      uint32_t value = 0;
+      while (sock.recv(value) == sizeof(value))
+         ;
+      armed = std::chrono::steady_clock::now();
+      reactor.timers().arm(deadline, 100);
+   }), 0);
+
+   // The reactor is idle longer than the timer delay before the callback arms it
+   auto th = std::thread([&sockSnd]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+      uint32_t value = 1;
+      sockSnd.send(value);
+   });
+   while (!deadline.isArmed())
+      ASSERT_GE(reactor.poll(-1), 0);
+   th.join();
+
+   ASSERT_EQ(reactor.poll(0), 0);
+   ASSERT_TRUE(deadline.isArmed());
+
+   while (deadline.isArmed())
+      ASSERT_GE(reactor.poll(-1), 0);
+   auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(fired - armed).count();
+   ASSERT_GE(dt, 99);
+   ASSERT_LT(dt, 300);
+}
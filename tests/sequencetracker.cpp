@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : sequencetracker.cpp
+// Contents  : gtests SequenceTracker
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include "sequencetracker.h"
+#include "socketdgram.h"
+
+#include "extern.h"
+
+TEST(SequenceTracker, counters)
+{
+   SequenceTracker tracker(SequenceField(0, 4));
+   for (uint64_t seq : {1, 2, 3, 5, 6, 4, 4, 10})
+      tracker.update(seq);
+   tracker.update("x", 1);
+
+   auto s = tracker.snapshot();
+   ASSERT_EQ(s.received, 8u);
+   ASSERT_EQ(s.duplicates, 1u);
+   ASSERT_EQ(s.outOfOrder, 1u);
+   ASSERT_EQ(s.gaps, 2u);
+   ASSERT_EQ(s.missing, 3u);
+   ASSERT_EQ(s.malformed, 1u);
+   ASSERT_EQ(s.highest, 10u);
+   ASSERT_EQ(s.gapSizes[0], 1u);
+   ASSERT_EQ(s.gapSizes[1], 1u);
+
+   ASSERT_EQ(SequenceTracker::bucket(1), 0u);
+   ASSERT_EQ(SequenceTracker::bucket(7), 2u);
+   ASSERT_EQ(SequenceTracker::bucket(8), 3u);
+   ASSERT_EQ(SequenceTracker::bucket(uint64_t(1) << 40), SequenceTracker::HISTOGRAM_SIZE - 1);
+}
+
+TEST(SequenceTracker, socket)
+{
+   uint16_t Port = port + portOffset++;
+
+   SocketDGRAM sockRcv(AF_INET);
+   ASSERT_EQ(sockRcv.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   int size = 4096;
+   ASSERT_EQ(sockRcv.setOption(SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)), 0);
+   ASSERT_EQ(sockRcv.bind(), 0);
+
+   SequenceTracker tracker(SequenceField(0, 4));
+   ASSERT_EQ(sockRcv.setSequenceTracker(&tracker), 0);
+
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   // SocketDGRAM::send(uint32_t) sends in network order
+   for (uint32_t seq = 0; seq < 10; seq++)
+   {
+      if (seq != 4)
+      {
+         ASSERT_EQ(sockSnd.send(seq), 4);
+      }
+   }
+
+   uint32_t buffers[16];
+   datagram msgs[16] = {};
+   for (uint32_t i = 0; i < 16; i++)
+   {
+      msgs[i].buffer = &buffers[i];
+      msgs[i].size = sizeof(buffers[i]);
+   }
+   int received = 0;
+   while (received < 9)
+   {
+      int n = sockRcv.recvBatch(msgs, 16, 1000);
+      ASSERT_GT(n, 0);
+      received += n;
+   }
+
+   auto s = tracker.snapshot();
+   ASSERT_EQ(s.received, 9u);
+   ASSERT_EQ(s.gaps, 1u);
+   ASSERT_EQ(s.missing, 1u);
+   ASSERT_EQ(s.highest, 9u);
+   ASSERT_EQ(s.kernelDrops, 0u);
+
+#ifdef __linux__
+   // Overflow the socket buffer, the kernel drops are reported
+   for (uint32_t seq = 10; seq < 1000; seq++)
+      ASSERT_EQ(sockSnd.send(seq), 4);
+   while (sockRcv.recvBatch(msgs, 16, 100) > 0)
+      ;
+   // The counter comes with the datagrams queued after the drops
+   ASSERT_EQ(sockSnd.send(uint32_t(1000)), 4);
+   ASSERT_EQ(sockRcv.recvBatch(msgs, 16, 1000), 1);
+   s = tracker.snapshot();
+   ASSERT_GT(s.kernelDrops, 0u);
+   ASSERT_GE(s.missing, s.kernelDrops);
+#endif
+}
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : shardedlistener.cpp
+// Contents  : gtests ShardedListener
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "shardedlistener.h"
+
+#include "extern.h"
+
+TEST(ShardedListener, accept)
+{
+   auto Port = port + portOffset++;
+
+   ShardedListener listener(4);
+   ASSERT_EQ(listener.size(), 4u);
+   ASSERT_EQ(listener.setAnyAddr(AF_INET, Port), 0);
+   ASSERT_EQ(listener.listen(), 0);
+   ASSERT_EQ(listener.attachCpuSteering(), 0);
+
+   std::atomic<uint32_t> accepted(0);
+   std::mutex mutex;
+   std::vector<SocketSTREAM> clients;
+
+   listener.start([&](SocketSTREAM &client, uint32_t shard) {
+      ASSERT_LT(shard, 4u);
+      client.send(shard);
+      std::lock_guard<std::mutex> lock(mutex);
+      clients.push_back(std::move(client));
+      accepted++;
+   });
+
+   for (uint32_t i = 0; i < 20; i++)
+   {
+      SocketSTREAM sock(AF_INET);
+      ASSERT_EQ(sock.setAddr("127.0.0.1", Port), 0);
+      ASSERT_NE(sock.open(), INVALID_SOCKET);
+      ASSERT_EQ(sock.connect(), 0);
+      uint32_t shard = 99;
+      ASSERT_EQ(sock.recv(shard), sizeof(shard));
+      ASSERT_LT(shard, 4u);
+   }
+
+   listener.stop();
+   ASSERT_EQ(accepted, 20u);
+   ASSERT_EQ(clients.size(), 20u);
+   for (auto &client : clients)
+      ASSERT_TRUE(client.isOpen());
+}
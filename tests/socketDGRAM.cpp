@@ -15,6 +15,9 @@
 #include <string>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <vector>
 #include "socketdgram.h"
 
 #include "extern.h"
@@ -260,3 +263,403 @@ TEST(SocketDGRAM, getPort)
    ASSERT_NO_THROW(sock.getPort());
    ASSERT_EQ(sock.close(), 0);
 }
+
+TEST_F(SocketDGRAM_Fixture, recvBatch)
+{
+   constexpr uint32_t count = 16;
+   uint32_t values[count] = {};
+   datagram msgs[count];
+   for (uint32_t i = 0; i < count; i++)
+   {
+      msgs[i] = {};
+      msgs[i].buffer = &values[i];
+      msgs[i].size = sizeof(values[i]);
+   }
+
+   // Nothing is pending
+   ASSERT_EQ(sockRcv.recvBatch(msgs, count, 10), 0);
+
+   for (uint32_t i = 0; i < 10; i++)
+      ASSERT_EQ(sockSnd.send(i), sizeof(i));
+
+   int n = 0;
+   while (n < 10)
+   {
+      int rc = sockRcv.recvBatch(msgs + n, count - n, 100);
+      ASSERT_GT(rc, 0);
+      n += rc;
+   }
+   ASSERT_EQ(n, 10);
+   for (uint32_t i = 0; i < 10; i++)
+   {
+      ASSERT_EQ(msgs[i].length, sizeof(uint32_t));
+      ASSERT_FALSE(msgs[i].truncated);
+      ASSERT_EQ(ntohl(values[i]), i);
+      ASSERT_EQ(msgs[i].peer.sa.sa_family, AF_INET);
+      ASSERT_EQ(msgs[i].peer.s4.sin_port, htons(sockSnd.getPort()));
+   }
+
+   // A datagram larger than its buffer is truncated
+   ASSERT_EQ(sockSnd.send(uint64_t(1)), sizeof(uint64_t));
+   ASSERT_EQ(sockRcv.recvBatch(msgs, 1, 100), 1);
+   ASSERT_EQ(msgs[0].length, sizeof(uint32_t));
+   ASSERT_TRUE(msgs[0].truncated);
+}
+
+TEST_F(SocketDGRAM_Fixture, sendBatch)
+{
+   constexpr uint32_t count = 100;
+   uint32_t values[count] = {};
+   datagram msgs[count];
+   for (uint32_t i = 0; i < count; i++)
+   {
+      values[i] = htonl(i);
+      msgs[i] = {};
+      msgs[i].buffer = &values[i];
+      msgs[i].length = sizeof(values[i]);
+   }
+
+   // Larger than MMSG_BATCH_SIZE, sent in several sendmmsg calls
+   ASSERT_EQ(sockSnd.sendBatch(msgs, count), (int)count);
+
+   for (uint32_t i = 0; i < count; i++)
+   {
+      uint32_t value = 0;
+      ASSERT_EQ(sockRcv.recv(value), sizeof(value));
+      ASSERT_EQ(value, i);
+   }
+
+   // Per datagram destination
+   SocketDGRAM sockRcv2(AF_INET);
+   ASSERT_EQ(sockRcv2.setAnyAddr(sockRcv.getPort() + 1000), 0);
+   ASSERT_NE(sockRcv2.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv2.bind(), 0);
+   ASSERT_EQ(sockRcv2.setRecvTimeout(0, 100), 0);
+
+   msgs[1].peer = SockAddr("127.0.0.1", sockRcv2.getPort(), AF_INET);
+   ASSERT_NE(msgs[1].peer.size, 0u);
+   ASSERT_EQ(sockSnd.sendBatch(msgs, 2), 2);
+
+   uint32_t value = 0;
+   ASSERT_EQ(sockRcv.recv(value), sizeof(value));
+   ASSERT_EQ(value, 0u);
+   ASSERT_EQ(sockRcv2.recv(value), sizeof(value));
+   ASSERT_EQ(value, 1u);
+}
+
+TEST_F(SocketDGRAM_Fixture, sendSegments)
+{
+   constexpr uint16_t segmentSize = 100;
+   uint8_t buffer[10 * segmentSize + 50];
+   for (uint32_t i = 0; i < sizeof(buffer); i++)
+      buffer[i] = static_cast<uint8_t>(i / segmentSize);
+
+   // Per call segment size, the last datagram is shorter
+   ASSERT_EQ(sockSnd.sendSegments(buffer, sizeof(buffer), segmentSize), (int)sizeof(buffer));
+
+   uint8_t rcv[2 * segmentSize];
+   for (uint32_t i = 0; i < 11; i++)
+   {
+      int len = (i < 10) ? segmentSize : 50;
+      ASSERT_EQ(sockRcv.recv(rcv, sizeof(rcv)), len);
+      ASSERT_EQ(rcv[0], i);
+      ASSERT_EQ(rcv[len - 1], i);
+   }
+
+   // Per socket segment size, then disabled
+   if (sockSnd.setSegmentSize(segmentSize) == 0)
+   {
+      ASSERT_TRUE(sockSnd.hasGSO());
+      ASSERT_EQ(sockSnd.send(buffer, 3 * segmentSize), 3 * segmentSize);
+      for (uint32_t i = 0; i < 3; i++)
+         ASSERT_EQ(sockRcv.recv(rcv, sizeof(rcv)), segmentSize);
+
+      ASSERT_EQ(sockSnd.setSegmentSize(0), 0);
+      ASSERT_EQ(sockSnd.send(buffer, 150), 150);
+      ASSERT_EQ(sockRcv.recv(rcv, sizeof(rcv)), 150);
+   }
+   else
+      std::cout << "UDP_SEGMENT not supported, per socket GSO not tested" << std::endl;
+}
+
+TEST_F(SocketDGRAM_Fixture, recvSegments)
+{
+   if (sockRcv.enableGRO() != 0)
+   {
+      std::cout << "UDP_GRO not supported, not tested" << std::endl;
+      return;
+   }
+
+   constexpr uint16_t segmentSize = 100;
+   uint8_t buffer[10 * segmentSize + 50];
+   for (uint32_t i = 0; i < sizeof(buffer); i++)
+      buffer[i] = static_cast<uint8_t>(i / segmentSize);
+   ASSERT_EQ(sockSnd.sendSegments(buffer, sizeof(buffer), segmentSize), (int)sizeof(buffer));
+
+   // Coalesced or not, the 11 datagrams are received in order
+   uint8_t rcv[65536];
+   datagram segments[64];
+   uint32_t received = 0;
+   while (received < 11)
+   {
+      int n = sockRcv.recvSegments(rcv, sizeof(rcv), segments, 64, 100);
+      ASSERT_GT(n, 0);
+      for (int i = 0; i < n; i++, received++)
+      {
+         auto data = static_cast<uint8_t *>(segments[i].buffer);
+         ASSERT_GE(data, rcv);
+         ASSERT_LT(data, rcv + sizeof(rcv));
+         ASSERT_EQ(segments[i].length, (received < 10) ? segmentSize : 50u);
+         ASSERT_FALSE(segments[i].truncated);
+         ASSERT_EQ(data[0], received);
+         ASSERT_EQ(segments[i].peer.sa.sa_family, AF_INET);
+      }
+   }
+   ASSERT_EQ(received, 11u);
+}
+
+TEST_F(SocketDGRAM_Fixture, timestamping)
+{
+   if (sockRcv.setTimestamping(true, false) != 0)
+   {
+      std::cout << "SO_TIMESTAMPING not supported, not tested" << std::endl;
+      return;
+   }
+   // The RX stamps may be turned on asynchronously, wait for a stamped probe
+   timespec stamp = {};
+   for (int retry = 0; retry < 100 && stamp.tv_sec == 0; retry++)
+   {
+      uint32_t probe = 0;
+      ASSERT_EQ(sockSnd.send(probe), sizeof(probe));
+      ASSERT_EQ(sockRcv.recvStamped(&probe, sizeof(probe), stamp), sizeof(probe));
+      if (stamp.tv_sec == 0)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   ASSERT_NE(stamp.tv_sec, 0);
+   ASSERT_EQ(sockSnd.setTimestamping(false, true), 0);
+
+   timespec before = {};
+   clock_gettime(CLOCK_REALTIME, &before);
+   for (uint32_t i = 0; i < 3; i++)
+      ASSERT_EQ(sockSnd.send(i), sizeof(i));
+
+   uint32_t value = 0;
+   ASSERT_EQ(sockRcv.recvStamped(&value, sizeof(value), stamp), sizeof(value));
+   ASSERT_TRUE(stamp.tv_sec > before.tv_sec || (stamp.tv_sec == before.tv_sec && stamp.tv_nsec >= before.tv_nsec));
+   ASSERT_LE(stamp.tv_sec - before.tv_sec, 1);
+
+   datagram msgs[2];
+   uint32_t values[2];
+   for (uint32_t i = 0; i < 2; i++)
+   {
+      msgs[i] = {};
+      msgs[i].buffer = &values[i];
+      msgs[i].size = sizeof(values[i]);
+   }
+   ASSERT_EQ(sockRcv.recvBatch(msgs, 2, 100), 2);
+   ASSERT_NE(msgs[1].stamp.tv_sec, 0);
+   ASSERT_TRUE(msgs[1].stamp.tv_sec > msgs[0].stamp.tv_sec || msgs[1].stamp.tv_nsec >= msgs[0].stamp.tv_nsec);
+
+   // One TX timestamp per datagram, from the error queue
+   for (uint32_t i = 0; i < 3; i++)
+   {
+      uint32_t id = 0;
+      timespec txStamp = {};
+      int rc = -1;
+      for (int retry = 0; retry < 100 && rc == -1; retry++)
+      {
+         rc = sockSnd.recvTxTimestamp(id, txStamp);
+         if (rc == -1)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      ASSERT_EQ(rc, 0);
+      ASSERT_EQ(id, i);
+      ASSERT_NE(txStamp.tv_sec, 0);
+   }
+   uint32_t id = 0;
+   ASSERT_EQ(sockSnd.recvTxTimestamp(id, stamp), -1);
+   ASSERT_EQ(sockSnd.error(), EAGAIN);
+}
+
+TEST(SocketDGRAM, group_registry)
+{
+   SocketDGRAM sock(AF_INET);
+   ASSERT_EQ(sock.setAnyAddr(0), 0);
+   ASSERT_NE(sock.open(), INVALID_SOCKET);
+   ASSERT_EQ(sock.bind(), 0);
+
+   int index = IfIndex("lo");
+   for (int i = 1; i <= 15; i++)
+      ASSERT_EQ(sock.igmpJoin("239.1.2." + std::to_string(i), index), 0);
+   ASSERT_EQ(sock.groupCount(), 15u);
+
+   ASSERT_EQ(sock.igmpJoin("239.1.2.1", index), -1);
+   ASSERT_EQ(sock.error(), EADDRINUSE);
+
+   ASSERT_EQ(sock.igmpLeave("239.1.2.7", index), 0);
+   ASSERT_EQ(sock.groupCount(), 14u);
+   ASSERT_EQ(sock.igmpLeave("239.1.2.7", index), -1);
+   ASSERT_EQ(sock.error(), EADDRNOTAVAIL);
+   ASSERT_EQ(sock.igmpJoin("239.1.2.7", index), 0);
+
+   ASSERT_EQ(sock.igmpJoin("127.0.0.1", "232.1.2.1", index), 0);
+   ASSERT_EQ(sock.groupCount(), 16u);
+   ASSERT_EQ(sock.igmpLeave("127.0.0.1", "232.1.2.1", index), 0);
+
+   ASSERT_EQ(sock.setSourceFilter("239.1.2.2", index, true, {"127.0.0.1", "127.0.0.2"}), 0);
+   ASSERT_EQ(sock.setSourceFilter("239.1.2.2", index, false, {}), 0);
+
+   ASSERT_EQ(sock.igmpLeave(), 0);
+   ASSERT_EQ(sock.groupCount(), 0u);
+
+   SocketDGRAM sock6(AF_INET6);
+   ASSERT_EQ(sock6.setAnyAddr(0), 0);
+   ASSERT_NE(sock6.open(), INVALID_SOCKET);
+   ASSERT_EQ(sock6.bind(), 0);
+   if (sock6.igmpJoin("ff15::1:1", index) == -1)
+   {
+      std::cout << "IPV6 multicast not available : " << sock6.error() << std::endl;
+      return;
+   }
+   ASSERT_EQ(sock6.igmpJoin("ff15::1:2", index), 0);
+   ASSERT_EQ(sock6.groupCount(), 2u);
+   ASSERT_EQ(sock6.igmpLeave("ff15::1:1", index), 0);
+   ASSERT_EQ(sock6.groupCount(), 1u);
+}
+
+TEST(SocketDGRAM, connected)
+{
+   uint16_t PortA = port + portOffset++;
+   uint16_t PortB = port + portOffset++;
+
+   SocketDGRAM sockA(AF_INET);
+   ASSERT_EQ(sockA.setAddr("127.0.0.1", PortA), 0);
+   ASSERT_NE(sockA.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockA.bind(), 0);
+   ASSERT_EQ(sockA.setRecvTimeout(0, 100), 0);
+   ASSERT_EQ(sockA.setAddr("127.0.0.1", PortB), 0);
+   ASSERT_FALSE(sockA.isConnected());
+   ASSERT_EQ(sockA.connect(), 0);
+   ASSERT_TRUE(sockA.isConnected());
+
+   SocketDGRAM sockB(AF_INET);
+   ASSERT_EQ(sockB.setAddr("127.0.0.1", PortB), 0);
+   ASSERT_NE(sockB.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockB.bind(), 0);
+   ASSERT_EQ(sockB.setRecvTimeout(0, 100), 0);
+
+   SocketDGRAM sockC(AF_INET);
+   ASSERT_EQ(sockC.setAddr("127.0.0.1", PortA), 0);
+   ASSERT_NE(sockC.open(), INVALID_SOCKET);
+
+   // Sends go to the connected peer
+   uint32_t value = 0;
+   ASSERT_EQ(sockA.send(uint32_t(1)), sizeof(value));
+   ASSERT_EQ(sockB.recv(value), sizeof(value));
+   ASSERT_EQ(value, 1u);
+
+   datagram msgs[2] = {};
+   uint32_t values[2] = {2, 3};
+   for (uint32_t i = 0; i < 2; i++)
+   {
+      msgs[i].buffer = &values[i];
+      msgs[i].length = sizeof(values[i]);
+   }
+   ASSERT_EQ(sockA.sendBatch(msgs, 2), 2);
+   ASSERT_EQ(sockB.recv(&value, sizeof(value)), sizeof(value));
+   ASSERT_EQ(value, 2u);
+   ASSERT_EQ(sockB.recv(&value, sizeof(value)), sizeof(value));
+   ASSERT_EQ(value, 3u);
+
+   uint8_t payload[300] = {};
+   ASSERT_EQ(sockA.sendSegments(payload, sizeof(payload), 100), (int)sizeof(payload));
+   for (uint32_t i = 0; i < 3; i++)
+      ASSERT_EQ(sockB.recv(payload, sizeof(payload)), 100);
+
+   // Only the peer datagrams are received
+   ASSERT_EQ(sockB.setAddr("127.0.0.1", PortA), 0);
+   ASSERT_EQ(sockC.send(uint32_t(4)), sizeof(value));
+   ASSERT_EQ(sockB.send(uint32_t(5)), sizeof(value));
+   ASSERT_EQ(sockA.recv(value), sizeof(value));
+   ASSERT_EQ(value, 5u);
+   ASSERT_EQ(sockA.recv(value), -1);
+
+   ASSERT_EQ(sockA.disconnect(), 0);
+   ASSERT_FALSE(sockA.isConnected());
+   ASSERT_EQ(sockC.send(uint32_t(6)), sizeof(value));
+   ASSERT_EQ(sockA.recv(value), sizeof(value));
+   ASSERT_EQ(value, 6u);
+
+   ASSERT_EQ(sockA.close(), 0);
+   ASSERT_FALSE(sockA.isConnected());
+}
+
+TEST(SocketDGRAM, send_recv_peer)
+{
+   uint16_t Port = port + portOffset++;
+
+   SocketDGRAM sock(AF_INET);
+   ASSERT_EQ(sock.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sock.open(), INVALID_SOCKET);
+   ASSERT_EQ(sock.bind(), 0);
+   ASSERT_EQ(sock.setRecvTimeout(1, 0), 0);
+   auto local = sock.getSocketaddr();
+
+   const uint32_t clients = 4;
+   const uint32_t count = 100;
+   std::vector<std::thread> threads;
+   for (uint32_t c = 0; c < clients; c++)
+   {
+      threads.emplace_back([Port, count]() {
+         SocketDGRAM client(AF_INET);
+         ASSERT_EQ(client.setAddr("127.0.0.1", Port), 0);
+         ASSERT_NE(client.open(), INVALID_SOCKET);
+         ASSERT_EQ(client.setRecvTimeout(1, 0), 0);
+         for (uint32_t i = 0; i < count; i++)
+         {
+            uint32_t value = 0;
+            ASSERT_EQ(client.send(i), sizeof(i));
+            ASSERT_EQ(client.recv(value), sizeof(value));
+            ASSERT_EQ(value, i);
+         }
+      });
+   }
+
+   // The echo replies are sent by a second thread, sharing the socket
+   std::mutex mutex;
+   std::vector<std::pair<socketaddr, uint32_t>> replies;
+   std::atomic<bool> done(false);
+   auto sender = std::thread([&]() {
+      while (!done)
+      {
+         std::vector<std::pair<socketaddr, uint32_t>> batch;
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch.swap(replies);
+         }
+         for (auto &reply : batch)
+            ASSERT_EQ(sock.send(&reply.second, sizeof(reply.second), reply.first), sizeof(reply.second));
+         std::this_thread::yield();
+      }
+   });
+
+   for (uint32_t i = 0; i < clients * count; i++)
+   {
+      uint32_t value = 0;
+      socketaddr peer;
+      ASSERT_EQ(sock.recv(&value, sizeof(value), peer), sizeof(value));
+      ASSERT_EQ(peer.size, sizeof(sockaddr_in));
+      std::lock_guard<std::mutex> lock(mutex);
+      replies.emplace_back(peer, value);
+   }
+
+   for (auto &th : threads)
+      th.join();
+   done = true;
+   sender.join();
+
+   // The internal sockaddr is untouched
+   auto addr = sock.getSocketaddr();
+   ASSERT_EQ(addr.size, local.size);
+   ASSERT_EQ(memcmp(&addr.ss, &local.ss, addr.size), 0);
+}
@@ -155,3 +155,127 @@ TEST(SocketSTREAM, send_recv_file)
    rcvTh.join();
    sndTh.join();
 }
+
+TEST(SocketSTREAM, acceptBatch)
+{
+   auto Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(8), 0);
+
+   std::vector<SocketSTREAM> clients;
+   int error = -1;
+   ASSERT_EQ(sockSrv.acceptBatch(clients, 8, &error), 0u);
+   ASSERT_EQ(error, 0);
+
+   std::vector<SocketSTREAM> socks(5);
+   for (auto &sock : socks)
+   {
+      ASSERT_EQ(sock.setAddr(AF_INET, "127.0.0.1", Port), 0);
+      ASSERT_NE(sock.open(), INVALID_SOCKET);
+      ASSERT_EQ(sock.connect(), 0);
+   }
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+   ASSERT_EQ(sockSrv.acceptBatch(clients, 3, &error), 3u);
+   ASSERT_EQ(error, 0);
+   ASSERT_EQ(sockSrv.acceptBatch(clients, 8, &error), 2u);
+   ASSERT_EQ(error, 0);
+   ASSERT_EQ(clients.size(), 5u);
+
+   for (auto &client : clients)
+   {
+      ASSERT_TRUE(client.isOpen());
+      ASSERT_TRUE(client.isNONBLOCK());
+      ASSERT_EQ(client.getSocketaddr().sa.sa_family, AF_INET);
+   }
+}
+
+TEST(SocketSTREAM, connect_happy_eyeballs)
+{
+   auto Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(8), 0);
+
+   auto list = SockAddrList("localhost", Port);
+   ASSERT_FALSE(list.empty());
+
+   // Whatever the localhost addresses are, one of them reaches the IPV4 server
+   SocketSTREAM sock;
+   ASSERT_EQ(sock.connect("localhost", Port, 1000), 0);
+   ASSERT_TRUE(sock.isOpen());
+   ASSERT_FALSE(sock.isNONBLOCK());
+   ASSERT_EQ(sock.getSocketaddr().sa.sa_family, AF_INET);
+   ASSERT_EQ(sock.send(cu32), sizeof(cu32));
+
+   auto wsock = sockSrv.accept();
+   uint32_t u32 = 0;
+   ASSERT_EQ(wsock.recv(u32), sizeof(u32));
+   ASSERT_EQ(u32, cu32);
+
+   // Nobody listen on the next port, all the attempts are refused
+   SocketSTREAM sockRefused;
+   ASSERT_EQ(sockRefused.connect("127.0.0.1", Port + 1, 1000), -1);
+   ASSERT_EQ(sockRefused.error(), ECONNREFUSED);
+   ASSERT_FALSE(sockRefused.isOpen());
+}
+
+TEST(SocketSTREAM, timestamping)
+{
+   auto Port = port + portOffset++;
+
+   SocketSTREAM sockSrv(AF_INET);
+   ASSERT_EQ(sockSrv.setAnyAddr(Port), 0);
+   ASSERT_NE(sockSrv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockSrv.bind(), 0);
+   ASSERT_EQ(sockSrv.listen(1), 0);
+
+   SocketSTREAM sock(AF_INET);
+   ASSERT_EQ(sock.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sock.open(), INVALID_SOCKET);
+   ASSERT_EQ(sock.connect(), 0);
+   auto wsock = sockSrv.accept();
+
+   if (wsock.setTimestamping(true, false) != 0)
+   {
+      std::cout << "SO_TIMESTAMPING not supported, not tested" << std::endl;
+      return;
+   }
+   // The RX stamps may be turned on asynchronously, wait for a stamped probe
+   timespec stamp = {};
+   for (int retry = 0; retry < 100 && stamp.tv_sec == 0; retry++)
+   {
+      uint8_t probe = 0;
+      ASSERT_EQ(sock.send(probe), sizeof(probe));
+      ASSERT_EQ(wsock.recvStamped(&probe, sizeof(probe), stamp), sizeof(probe));
+      if (stamp.tv_sec == 0)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   ASSERT_NE(stamp.tv_sec, 0);
+
+   ASSERT_EQ(sock.setTimestamping(false, true), 0);
+   ASSERT_EQ(sock.send(cu64), sizeof(cu64));
+
+   uint64_t u64 = 0;
+   ASSERT_EQ(wsock.recvStamped(&u64, sizeof(u64), stamp), sizeof(u64));
+   ASSERT_NE(stamp.tv_sec, 0);
+
+   // The TCP id is the byte offset of the last byte of the send
+   uint32_t id = 0;
+   int rc = -1;
+   for (int retry = 0; retry < 100 && rc == -1; retry++)
+   {
+      rc = sock.recvTxTimestamp(id, stamp);
+      if (rc == -1)
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   ASSERT_EQ(rc, 0);
+   ASSERT_EQ(id, sizeof(cu64) - 1);
+}
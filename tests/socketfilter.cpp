@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : socketfilter.cpp
+// Contents  : gtests SocketFilter
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include "packetring.h"
+#include "socketfilter.h"
+
+#include "extern.h"
+
+TEST(SocketFilter, compile)
+{
+   // No criteria : accept all
+   auto code = SocketFilter().compile();
+   ASSERT_EQ(code.size(), 2u);
+   ASSERT_EQ(code[0].code, BPF_RET | BPF_K);
+   ASSERT_NE(code[0].k, 0u);
+
+   ASSERT_EQ(SocketFilter().etherType(ETH_P_ARP).snapLength(64).compile().size(), 4u);
+
+   // Contradictory families : reject all
+   code = SocketFilter().srcHost("10.0.0.1").dstHost("::1").compile();
+   ASSERT_EQ(code.size(), 1u);
+   ASSERT_EQ(code[0].k, 0u);
+
+   SocketFilter invalid;
+   invalid.host("not an address").dstPort(80);
+   ASSERT_TRUE(invalid.compile().empty());
+   ASSERT_EQ(errno, EINVAL);
+}
+
+TEST(SocketFilter, udp)
+{
+   uint16_t Port = port + portOffset++;
+   uint16_t PortA = port + portOffset++;
+   uint16_t PortB = port + portOffset++;
+
+   SocketDGRAM sockRcv(AF_INET);
+   ASSERT_EQ(sockRcv.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockRcv.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockRcv.bind(), 0);
+   ASSERT_EQ(sockRcv.setRecvTimeout(0, 100), 0);
+
+   SocketFilter filter;
+   filter.ipProtocol(IPPROTO_UDP).host("127.0.0.1").srcPort(PortA).dstPort(Port);
+   ASSERT_EQ(filter.attach(sockRcv, true), 0);
+   ASSERT_EQ(SocketFilter::detach(sockRcv), -1);
+   ASSERT_EQ(errno, EPERM);
+
+   SocketDGRAM sockA(AF_INET);
+   ASSERT_EQ(sockA.setAddr("127.0.0.1", PortA), 0);
+   ASSERT_NE(sockA.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockA.bind(), 0);
+   ASSERT_EQ(sockA.setAddr("127.0.0.1", Port), 0);
+
+   SocketDGRAM sockB(AF_INET);
+   ASSERT_EQ(sockB.setAddr("127.0.0.1", PortB), 0);
+   ASSERT_NE(sockB.open(), INVALID_SOCKET);
+   ASSERT_EQ(sockB.bind(), 0);
+   ASSERT_EQ(sockB.setAddr("127.0.0.1", Port), 0);
+
+   for (uint32_t i = 0; i < 5; i++)
+   {
+      ASSERT_EQ(sockB.send(i), sizeof(i));
+      ASSERT_EQ(sockA.send(i + 100), sizeof(i));
+   }
+
+   // Only the datagrams of sockA pass the filter
+   uint32_t value = 0;
+   for (uint32_t i = 0; i < 5; i++)
+   {
+      ASSERT_EQ(sockRcv.recv(value), sizeof(value));
+      ASSERT_EQ(value, i + 100);
+   }
+   ASSERT_EQ(sockRcv.recv(value), -1);
+}
+
+TEST(SocketFilter, packet_ipv6)
+{
+   uint16_t Port = port + portOffset++;
+
+   std::unique_ptr<PacketRing> ring;
+   try
+   {
+      ring.reset(new PacketRing(IfIndex("lo"), ETH_P_ALL, 1 << 16, 8, 5));
+   }
+   catch (const std::system_error &exp)
+   {
+      std::cout << "PacketRing not available, not tested : " << exp.what() << std::endl;
+      return;
+   }
+
+   SocketFilter filter;
+   filter.ipProtocol(IPPROTO_UDP).host("::1").port(Port);
+   ASSERT_EQ(filter.attach(ring->socket()), 0);
+   // Drain the frames queued before the attach
+   while (ring->poll([](const PacketRing::Frame &) {}, 20) > 0)
+      ;
+
+   SocketDGRAM sock4(AF_INET);
+   ASSERT_EQ(sock4.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sock4.open(), INVALID_SOCKET);
+   SocketDGRAM sock6(AF_INET6);
+   ASSERT_EQ(sock6.setAddr("::1", Port), 0);
+   ASSERT_NE(sock6.open(), INVALID_SOCKET);
+
+   const uint32_t count = 10;
+   for (uint32_t i = 0; i < count; i++)
+   {
+      ASSERT_EQ(sock4.send(i), sizeof(i));
+      ASSERT_EQ(sock6.send(i), sizeof(i));
+   }
+
+   // Each loopback datagram is seen twice, outgoing and incoming
+   uint32_t received = 0;
+   bool matching = true;
+   while (received < 2 * count)
+   {
+      int n = ring->poll([&](const PacketRing::Frame &frame) {
+         auto ip6 = reinterpret_cast<const ip6_hdr *>(frame.data + sizeof(ethhdr));
+         auto udp = reinterpret_cast<const udphdr *>(ip6 + 1);
+         matching &= (frame.protocol == ETH_P_IPV6 && ip6->ip6_nxt == IPPROTO_UDP && ntohs(udp->dest) == Port);
+         received++;
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_TRUE(matching);
+   ASSERT_EQ(received, 2 * count);
+   ASSERT_EQ(ring->poll([](const PacketRing::Frame &) {}, 50), 0);
+
+   // Without host both families match
+   ASSERT_EQ(SocketFilter().ipProtocol(IPPROTO_UDP).dstPort(Port).attach(ring->socket()), 0);
+   for (uint32_t i = 0; i < count; i++)
+   {
+      ASSERT_EQ(sock4.send(i), sizeof(i));
+      ASSERT_EQ(sock6.send(i), sizeof(i));
+   }
+
+   uint32_t received4 = 0;
+   uint32_t received6 = 0;
+   while (received4 + received6 < 4 * count)
+   {
+      int n = ring->poll([&](const PacketRing::Frame &frame) {
+         if (frame.protocol == ETH_P_IP)
+            received4++;
+         else if (frame.protocol == ETH_P_IPV6)
+            received6++;
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_EQ(received4, 2 * count);
+   ASSERT_EQ(received6, 2 * count);
+}
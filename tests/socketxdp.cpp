@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : socketxdp.cpp
+// Contents  : gtests SocketXDP
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <linux/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include "socketxdp.h"
+
+#include "extern.h"
+
+TEST(SocketXDP, loopback)
+{
+   uint16_t Port = port + portOffset++;
+   const uint16_t protocol = 0x88B5;   // IEEE local experimental
+
+   std::unique_ptr<SocketXDP> xsk;
+   try
+   {
+      xsk.reset(new SocketXDP(IfIndex("lo"), 0, SocketXDP::GENERIC, 2048, 64));
+   }
+   catch (const std::system_error &exp)
+   {
+      std::cout << "SocketXDP not available, not tested : " << exp.what() << std::endl;
+      return;
+   }
+   ASSERT_EQ(xsk->capacity(), 2048u);
+   ASSERT_EQ(xsk->available(), 64u);
+
+   // Receive : the program redirects the lo frames to the socket
+   SocketDGRAM sockSnd(AF_INET);
+   ASSERT_EQ(sockSnd.setAddr("127.0.0.1", Port), 0);
+   ASSERT_NE(sockSnd.open(), INVALID_SOCKET);
+
+   const uint32_t count = 10;
+   for (uint32_t i = 0; i < count; i++)
+      ASSERT_EQ(sockSnd.send(i), sizeof(i));
+
+   uint32_t received = 0;
+   bool ordered = true;
+   while (received < count)
+   {
+      int n = xsk->poll([&](const SocketXDP::Frame &frame) {
+         const uint32_t ipOffset = sizeof(ethhdr);
+         if (frame.length < ipOffset + sizeof(iphdr) + sizeof(udphdr))
+            return;
+         auto ip = reinterpret_cast<const iphdr *>(frame.data + ipOffset);
+         if (ip->protocol != IPPROTO_UDP)
+            return;
+         auto udp = reinterpret_cast<const udphdr *>(frame.data + ipOffset + ip->ihl * 4);
+         if (ntohs(udp->dest) != Port)
+            return;
+         uint32_t value;
+         memcpy(&value, udp + 1, sizeof(value));
+         ordered &= (ntohl(value) == received++);
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_TRUE(ordered);
+
+   // Send more frames than chunks : the sent frames loop back to the receive ring
+   const uint32_t txCount = 200;
+   uint32_t committed = 0;
+   received = 0;
+   while (received < txCount)
+   {
+      uint8_t *frame;
+      while (committed < txCount && (frame = xsk->acquire()) != nullptr)
+      {
+         auto eth = reinterpret_cast<ethhdr *>(frame);
+         memset(eth->h_dest, 0xFF, ETH_ALEN);
+         memset(eth->h_source, 0, ETH_ALEN);
+         eth->h_proto = htons(protocol);
+         uint32_t value = htonl(committed);
+         memcpy(frame + sizeof(ethhdr), &value, sizeof(value));
+         ASSERT_EQ(xsk->commit(sizeof(ethhdr) + 60), 0);
+         committed++;
+      }
+      if (xsk->pending() > 0)
+      {
+         ASSERT_GE(xsk->flush(), 0);
+      }
+
+      int n = xsk->poll([&](const SocketXDP::Frame &frame) {
+         auto eth = reinterpret_cast<const ethhdr *>(frame.data);
+         if (frame.length < sizeof(ethhdr) + sizeof(uint32_t) || ntohs(eth->h_proto) != protocol)
+            return;
+         uint32_t value;
+         memcpy(&value, frame.data + sizeof(ethhdr), sizeof(value));
+         ordered &= (ntohl(value) == received++);
+      }, 1000);
+      ASSERT_GT(n, 0);
+   }
+   ASSERT_TRUE(ordered);
+   ASSERT_EQ(xsk->commit(xsk->capacity() + 1), -1);
+   ASSERT_EQ(xsk->available(), 64u);
+   ASSERT_EQ(xsk->stats().txInvalid, 0u);
+}
@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+// File      : timerwheel.cpp
+// Contents  : gtests TimerWheel
+//
+// Author    : TheBigFred - thebigfred.github@gmail.com
+// URL       : https://github.com/TheBigFred/libSocket
+//
+//-----------------------------------------------------------------------------
+//  LGPL V3.0 - https://www.gnu.org/licences/lgpl-3.0.txt
+//-----------------------------------------------------------------------------
+////////////////////////////////////////////////////////////////////////////////
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include "timerwheel.h"
+
+#include "extern.h"
+
+using ms = std::chrono::milliseconds;
+
+TEST(TimerWheel, arm_cancel_expire)
+{
+   TimerWheel wheel;
+   auto t0 = TimerWheel::Clock::now();
+
+   int fired[4] = {};
+   Timer t5([&]() { fired[0]++; });
+   Timer t10([&]() { fired[1]++; });
+   Timer t300([&]() { fired[2]++; });
+   Timer t70000([&]() { fired[3]++; });
+
+   wheel.arm(t5, 5);
+   wheel.arm(t10, 10);
+   wheel.arm(t300, 300);
+   wheel.arm(t70000, 70000);
+   ASSERT_EQ(wheel.size(), 4u);
+   ASSERT_GE(wheel.nextTimeout(), 0);
+   ASSERT_LE(wheel.nextTimeout(), 6);
+
+   ASSERT_EQ(wheel.advance(t0 + ms(7)), 1u);
+   ASSERT_EQ(fired[0], 1);
+   ASSERT_FALSE(t5.isArmed());
+
+   t10.cancel();
+   ASSERT_FALSE(t10.isArmed());
+   ASSERT_EQ(wheel.size(), 2u);
+
+   ASSERT_EQ(wheel.advance(t0 + ms(299)), 0u);
+   ASSERT_EQ(wheel.advance(t0 + ms(302)), 1u);
+   ASSERT_EQ(fired[2], 1);
+
+   ASSERT_EQ(wheel.advance(t0 + ms(69990)), 0u);
+   ASSERT_EQ(wheel.advance(t0 + ms(70010)), 1u);
+   ASSERT_EQ(fired[3], 1);
+   ASSERT_EQ(fired[1], 0);
+
+   ASSERT_EQ(wheel.size(), 0u);
+   ASSERT_EQ(wheel.nextTimeout(), -1);
+}
+
+TEST(TimerWheel, rearm_from_callback)
+{
+   TimerWheel wheel;
+   auto t0 = TimerWheel::Clock::now();
+
+   int count = 0;
+   Timer timer;
+   timer.setCallback([&]() {
+      if (++count < 5)
+         wheel.arm(timer, 100);
+   });
+   wheel.arm(timer, 100);
+
+   for (int i = 1; i <= 10; i++)
+      wheel.advance(t0 + ms(i * 100 + 1));
+
+   ASSERT_EQ(count, 5);
+   ASSERT_FALSE(timer.isArmed());
+}
+
+TEST(TimerWheel, many_timers)
+{
+   TimerWheel wheel;
+   auto t0 = TimerWheel::Clock::now();
+
+   constexpr int N = 10000;
+   std::unique_ptr<Timer[]> timers(new Timer[N]);
+   int fired = 0;
+   for (int i = 0; i < N; i++)
+   {
+      timers[i].setCallback([&fired]() { fired++; });
+      wheel.arm(timers[i], (uint32_t)(i * 7));
+   }
+   for (int i = 0; i < N; i += 2)
+      timers[i].cancel();
+
+   wheel.advance(t0 + ms(N * 7 + 10));
+   ASSERT_EQ(fired, N / 2);
+   ASSERT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimerWheel, arm_after_idle)
+{
+   TimerWheel wheel;
+   int fired = 0;
+   Timer timer([&fired]() { fired++; });
+
+   // The wheel is not advanced while idle, the delay still counts from now
+   std::this_thread::sleep_for(ms(50));
+   auto t1 = TimerWheel::Clock::now();
+   wheel.arm(timer, 100);
+
+   ASSERT_EQ(wheel.advance(t1 + ms(90)), 0u);
+   ASSERT_EQ(wheel.advance(t1 + ms(110)), 1u);
+   ASSERT_EQ(fired, 1);
+}